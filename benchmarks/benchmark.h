@@ -0,0 +1,273 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//                                                                                  //
+//  Copyright (c) 2016-2025 Leonardo Consoni <leonardojc@protonmail.com>            //
+//                                                                                  //
+//  This file is part of Simple Async IPC.                                          //
+//                                                                                  //
+//  Simple Async IPC is free software: you can redistribute it and/or modify        //
+//  it under the terms of the GNU Lesser General Public License as published        //
+//  by the Free Software Foundation, either version 3 of the License, or            //
+//  (at your option) any later version.                                             //
+//                                                                                  //
+//  Simple Async IPC is distributed in the hope that it will be useful,             //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of                  //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                    //
+//  GNU Lesser General Public License for more details.                             //
+//                                                                                  //
+//  You should have received a copy of the GNU Lesser General Public License        //
+//  along with Simple Async IPC. If not, see <http://www.gnu.org/licenses/>.        //
+//                                                                                  //
+//////////////////////////////////////////////////////////////////////////////////////
+
+
+/////////////////////////////////////////////////////////////////////////////////////
+///// Settings, connection setup and CSV reporting shared by the benchmarks     /////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef IPC_BENCHMARK_H
+#define IPC_BENCHMARK_H
+
+#include "ipc_extensions.h"
+
+#include "threads/threads.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define BENCHMARK_MAX_SIZES 32
+#define BENCHMARK_SHM_HOST "ipc_benchmark"                      // Shared memory directory name
+#define BENCHMARK_IP_HOST "127.0.0.1"
+#define BENCHMARK_LOCAL_HOST "unix:/tmp"                        // Directory of local socket files
+#define BENCHMARK_LOCAL_TRANSPORT "local"
+#define BENCHMARK_BASE_PORT 50100                               // Each connection pair uses a new port, so that stale sockets don't interfere
+#define BENCHMARK_QUEUE_LENGTH 1024
+#define BENCHMARK_TIMEOUT_MS 1000                               // Messages not delivered within this time are counted as lost
+
+// Every benchmark message starts with its sequence number and the instant it was written
+typedef struct _BenchmarkHeaderData
+{
+  uint64_t sequence;
+  uint64_t sendTime;
+}
+BenchmarkHeaderData;
+
+// Connection pair of an IPC mode. The initiator talks first, so that servers know where to reply
+typedef struct _BenchmarkModeData
+{
+  const char* name;
+  enum IPCMode initiatorMode;
+  enum IPCMode responderMode;
+  const char* networkTransport;                                 // Protocol used by the mode for IP hosts
+  bool isInitiatorSource;                                       // One-way data flows from initiator to responder (otherwise the opposite)
+}
+BenchmarkModeData;
+
+typedef const BenchmarkModeData* BenchmarkMode;
+
+static const BenchmarkModeData BENCHMARK_MODES_LIST[] = { { "reqrep", IPC_REQ, IPC_REP, "tcp", true },
+                                                          { "pubsub", IPC_SUB, IPC_PUB, "udp", false },
+                                                          { "clientserver", IPC_CLIENT, IPC_SERVER, "udp", true } };
+#define BENCHMARK_MODES_COUNT ( sizeof(BENCHMARK_MODES_LIST) / sizeof(BenchmarkModeData) )
+
+typedef struct _BenchmarkSettingsData
+{
+  size_t messagesCount;                                         // Messages per mode, transport and size
+  size_t sizesList[ BENCHMARK_MAX_SIZES ];
+  size_t sizesCount;
+  const char* modeName;                                         // NULL for all modes
+  const char* transportName;                                    // "shm", "tcp", "udp", "local" or NULL for all transports
+  bool isSpinning;                                              // Busy poll connections instead of waiting on them
+}
+BenchmarkSettingsData;
+
+typedef BenchmarkSettingsData* BenchmarkSettings;
+
+// Fill settings from "--option=value" command line arguments. Returns false (after printing usage) on invalid ones
+static bool Benchmark_ParseArguments( BenchmarkSettings settings, int argc, char** argv, size_t defaultMessagesCount )
+{
+  const size_t DEFAULT_SIZES_LIST[] = { 16, 64, 256, 1024, 4096, 16384 };
+  
+  memset( settings, 0, sizeof(BenchmarkSettingsData) );
+  settings->messagesCount = defaultMessagesCount;
+  settings->sizesCount = sizeof(DEFAULT_SIZES_LIST) / sizeof(size_t);
+  memcpy( settings->sizesList, DEFAULT_SIZES_LIST, sizeof(DEFAULT_SIZES_LIST) );
+  
+  for( int argIndex = 1; argIndex < argc; argIndex++ )
+  {
+    const char* argument = argv[ argIndex ];
+    if( strncmp( argument, "--messages=", 11 ) == 0 ) settings->messagesCount = strtoul( argument + 11, NULL, 10 );
+    else if( strncmp( argument, "--mode=", 7 ) == 0 ) settings->modeName = argument + 7;
+    else if( strncmp( argument, "--transport=", 12 ) == 0 ) settings->transportName = argument + 12;
+    else if( strcmp( argument, "--spin" ) == 0 ) settings->isSpinning = true;
+    else if( strncmp( argument, "--sizes=", 8 ) == 0 )
+    {
+      settings->sizesCount = 0;
+      char* sizeString = (char*) argument + 8;
+      while( *sizeString != '\0' && settings->sizesCount < BENCHMARK_MAX_SIZES )
+      {
+        settings->sizesList[ settings->sizesCount++ ] = strtoul( sizeString, &sizeString, 10 );
+        if( *sizeString == ',' ) sizeString++;
+      }
+    }
+    else
+    {
+      fprintf( stderr, "usage: %s [--messages=<count>] [--sizes=<bytes>,...] [--mode=reqrep|pubsub|clientserver] [--transport=shm|tcp|udp|local] [--spin]\n", argv[ 0 ] );
+      return false;
+    }
+  }
+  
+  return ( settings->messagesCount > 0 && settings->sizesCount > 0 );
+}
+
+// Check if the given mode/transport combination was selected (network transport depends on the mode)
+static bool Benchmark_IsSelected( BenchmarkSettings settings, BenchmarkMode mode, const char* transportName )
+{
+  if( settings->modeName != NULL && strcmp( settings->modeName, mode->name ) != 0 ) return false;
+  if( settings->transportName != NULL && strcmp( settings->transportName, transportName ) != 0 ) return false;
+  return true;
+}
+
+// Messages have to fit the header, and the largest length accepted by the library
+static size_t Benchmark_GetMessageSize( size_t size )
+{
+  if( size < sizeof(BenchmarkHeaderData) ) return sizeof(BenchmarkHeaderData);
+  if( size > MAX_MESSAGE_LENGTH ) return MAX_MESSAGE_LENGTH;
+  return size;
+}
+
+// Monotonic clock, comparable between processes of the same host
+static uint64_t Benchmark_GetTimeNS( void )
+{
+  struct timespec currentTime;
+  clock_gettime( CLOCK_MONOTONIC, &currentTime );
+  return (uint64_t) currentTime.tv_sec * 1000000000 + (uint64_t) currentTime.tv_nsec;
+}
+
+// Read next message, waiting for it up to the given time
+static bool Benchmark_Read( IPCConnection connection, Byte* buffer, size_t* ref_length, bool isSpinning, unsigned long timeoutMs )
+{
+  uint64_t deadline = Benchmark_GetTimeNS() + (uint64_t) timeoutMs * 1000000;
+  while( !IPC_ReadSizedMessage( connection, buffer, MAX_MESSAGE_LENGTH, ref_length ) )
+  {
+    uint64_t currentTime = Benchmark_GetTimeNS();
+    if( currentTime >= deadline ) return false;
+    if( !isSpinning ) IPC_WaitAny( &connection, 1, (long) ( ( deadline - currentTime ) / 1000000 ) + 1 );
+  }
+  return true;
+}
+
+// Write message, retrying while queues are full
+static bool Benchmark_Write( IPCConnection connection, const Byte* buffer, size_t length )
+{
+  uint64_t deadline = Benchmark_GetTimeNS() + (uint64_t) BENCHMARK_TIMEOUT_MS * 1000000;
+  while( !IPC_WriteSizedMessage( connection, buffer, length ) )
+  {
+    if( Benchmark_GetTimeNS() >= deadline ) return false;
+  }
+  return true;
+}
+
+// Discard messages left by previous runs on reused connections
+static void Benchmark_Drain( IPCConnection connection, Byte* buffer )
+{
+  size_t length;
+  while( IPC_ReadSizedMessage( connection, buffer, MAX_MESSAGE_LENGTH, &length ) ) continue;
+}
+
+// Open both ends of the given mode over the given transport ("shm", "local" or the mode network one), and make sure
+// messages flow in both directions before measuring
+static bool Benchmark_OpenPair( BenchmarkMode mode, const char* transportName, size_t pairIndex, IPCConnection* ref_initiator, IPCConnection* ref_responder )
+{
+  IPCOptions options = { .queueLength = BENCHMARK_QUEUE_LENGTH, .queuePolicy = IPC_QUEUE_BLOCK };
+  
+  const char* responderHost = NULL;
+  const char* initiatorHost = BENCHMARK_IP_HOST;
+  char channel[ 32 ];
+  snprintf( channel, sizeof(channel), "%u", (unsigned int) ( BENCHMARK_BASE_PORT + pairIndex ) );
+  if( strcmp( transportName, "shm" ) == 0 )
+  {
+    responderHost = initiatorHost = BENCHMARK_SHM_HOST;
+    snprintf( channel, sizeof(channel), "%s", mode->name );
+  }
+  else if( strcmp( transportName, BENCHMARK_LOCAL_TRANSPORT ) == 0 )
+  {
+    responderHost = initiatorHost = BENCHMARK_LOCAL_HOST;
+    snprintf( channel, sizeof(channel), "ipc_benchmark_%u", (unsigned int) pairIndex );
+  }
+  
+  *ref_responder = IPC_OpenConnectionWithOptions( mode->responderMode, responderHost, channel, &options );
+  *ref_initiator = IPC_OpenConnectionWithOptions( mode->initiatorMode, initiatorHost, channel, &options );
+  if( *ref_responder == IPC_INVALID_CONNECTION || *ref_initiator == IPC_INVALID_CONNECTION )
+  {
+    fprintf( stderr, "%s: failed to open connections\n", mode->name );
+    return false;
+  }
+  
+  Byte* buffer = (Byte*) malloc( MAX_MESSAGE_LENGTH );
+  Benchmark_Drain( *ref_responder, buffer );
+  Benchmark_Drain( *ref_initiator, buffer );
+  
+  // Network connections may still be connecting: greetings are repeated until answered
+  BenchmarkHeaderData greeting = { .sequence = 0 };
+  size_t length;
+  bool isConnected = false;
+  for( size_t attemptsCount = 0; attemptsCount < 100 && !isConnected; attemptsCount++ )
+  {
+    IPC_WriteSizedMessage( *ref_initiator, (Byte*) &greeting, sizeof(greeting) );
+    if( !Benchmark_Read( *ref_responder, buffer, &length, false, 10 ) ) continue;
+    IPC_WriteSizedMessage( *ref_responder, (Byte*) &greeting, sizeof(greeting) );
+    isConnected = Benchmark_Read( *ref_initiator, buffer, &length, false, 100 );
+  }
+  // Let repeated greetings arrive before discarding them
+  Thread_Sleep( 100 );
+  Benchmark_Drain( *ref_responder, buffer );
+  Benchmark_Drain( *ref_initiator, buffer );
+  free( buffer );
+  
+  if( !isConnected ) fprintf( stderr, "%s: no messages exchanged over %s\n", mode->name, transportName );
+  
+  return isConnected;
+}
+
+static void Benchmark_ClosePair( IPCConnection initiator, IPCConnection responder )
+{
+  if( initiator != IPC_INVALID_CONNECTION ) IPC_CloseConnection( initiator );
+  if( responder != IPC_INVALID_CONNECTION ) IPC_CloseConnection( responder );
+}
+
+static int CompareSamples( const void* ref_sample, const void* ref_otherSample )
+{
+  uint64_t sample = *((const uint64_t*) ref_sample), otherSample = *((const uint64_t*) ref_otherSample);
+  return ( sample > otherSample ) - ( sample < otherSample );
+}
+
+static void Benchmark_PrintHeader( void )
+{
+  printf( "test,mode,transport,size,messages,lost,seconds,messages_per_second,megabytes_per_second,min_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n" );
+}
+
+// Print CSV line with latency percentiles of the given samples (sorted in place)
+static void Benchmark_PrintResult( const char* testName, BenchmarkMode mode, const char* transportName, size_t size,
+                                   uint64_t* samplesList, size_t samplesCount, size_t lostCount, uint64_t elapsedTimeNS )
+{
+  const double PERCENTILES_LIST[] = { 0.0, 0.5, 0.9, 0.99, 0.999, 1.0 };
+  
+  qsort( samplesList, samplesCount, sizeof(uint64_t), CompareSamples );
+  
+  double seconds = (double) elapsedTimeNS / 1e9;
+  double messagesRate = ( seconds > 0.0 ) ? samplesCount / seconds : 0.0;
+  printf( "%s,%s,%s,%lu,%lu,%lu,%.6f,%.1f,%.3f", testName, mode->name, transportName, (unsigned long) size,
+          (unsigned long) samplesCount, (unsigned long) lostCount, seconds, messagesRate, messagesRate * size / 1e6 );
+  for( size_t percentileIndex = 0; percentileIndex < sizeof(PERCENTILES_LIST) / sizeof(double); percentileIndex++ )
+  {
+    size_t sampleIndex = (size_t) ( PERCENTILES_LIST[ percentileIndex ] * ( samplesCount - 1 ) + 0.5 );
+    printf( ",%lu", ( samplesCount > 0 ) ? (unsigned long) samplesList[ sampleIndex ] : 0UL );
+  }
+  printf( "\n" );
+  fflush( stdout );
+}
+
+#endif // IPC_BENCHMARK_H
@@ -0,0 +1,130 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//                                                                                  //
+//  Copyright (c) 2016-2025 Leonardo Consoni <leonardojc@protonmail.com>            //
+//                                                                                  //
+//  This file is part of Simple Async IPC.                                          //
+//                                                                                  //
+//  Simple Async IPC is free software: you can redistribute it and/or modify        //
+//  it under the terms of the GNU Lesser General Public License as published        //
+//  by the Free Software Foundation, either version 3 of the License, or            //
+//  (at your option) any later version.                                             //
+//                                                                                  //
+//  Simple Async IPC is distributed in the hope that it will be useful,             //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of                  //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                    //
+//  GNU Lesser General Public License for more details.                             //
+//                                                                                  //
+//  You should have received a copy of the GNU Lesser General Public License        //
+//  along with Simple Async IPC. If not, see <http://www.gnu.org/licenses/>.        //
+//                                                                                  //
+//////////////////////////////////////////////////////////////////////////////////////
+
+
+/////////////////////////////////////////////////////////////////////////////////////
+///// Ping-pong benchmark: round trip time of single messages echoed back by    /////
+///// the other end, for each IPC mode, transport and message size              /////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#include <stdatomic.h>
+
+typedef struct _EchoData
+{
+  IPCConnection connection;
+  bool isSpinning;
+  atomic_bool isRunning;
+}
+EchoData;
+
+// Send every message received by the responder back to the initiator
+static void* AsyncEcho( void* ref_echo )
+{
+  EchoData* echo = (EchoData*) ref_echo;
+  Byte* buffer = (Byte*) malloc( MAX_MESSAGE_LENGTH );
+  size_t length;
+  
+  while( atomic_load( &(echo->isRunning) ) )
+  {
+    if( Benchmark_Read( echo->connection, buffer, &length, echo->isSpinning, 10 ) ) Benchmark_Write( echo->connection, buffer, length );
+  }
+  
+  free( buffer );
+  return NULL;
+}
+
+// Wait for the echo of the given message, discarding late echoes of messages already counted as lost
+static bool ReadEcho( IPCConnection connection, Byte* buffer, uint64_t sequence, bool isSpinning )
+{
+  size_t length;
+  while( Benchmark_Read( connection, buffer, &length, isSpinning, BENCHMARK_TIMEOUT_MS ) )
+  {
+    if( ((BenchmarkHeaderData*) buffer)->sequence == sequence ) return true;
+  }
+  return false;
+}
+
+static void RunLatencyTest( BenchmarkSettings settings, BenchmarkMode mode, const char* transportName, size_t size, size_t pairIndex )
+{
+  IPCConnection initiator, responder;
+  if( !Benchmark_OpenPair( mode, transportName, pairIndex, &initiator, &responder ) )
+  {
+    Benchmark_ClosePair( initiator, responder );
+    return;
+  }
+  
+  EchoData echo = { .connection = responder, .isSpinning = settings->isSpinning, .isRunning = true };
+  Thread echoThread = Thread_Start( AsyncEcho, (void*) &echo, THREAD_JOINABLE );
+  
+  Byte* message = (Byte*) calloc( size, 1 );
+  Byte* buffer = (Byte*) malloc( MAX_MESSAGE_LENGTH );
+  uint64_t* samplesList = (uint64_t*) calloc( settings->messagesCount, sizeof(uint64_t) );
+  size_t samplesCount = 0;
+  
+  uint64_t startTime = Benchmark_GetTimeNS();
+  for( size_t messageIndex = 0; messageIndex < settings->messagesCount; messageIndex++ )
+  {
+    // Sequence 0 is used by connection greetings
+    BenchmarkHeaderData* header = (BenchmarkHeaderData*) message;
+    header->sequence = messageIndex + 1;
+    header->sendTime = Benchmark_GetTimeNS();
+    if( !Benchmark_Write( initiator, message, size ) ) continue;
+    if( !ReadEcho( initiator, buffer, header->sequence, settings->isSpinning ) ) continue;
+    samplesList[ samplesCount++ ] = Benchmark_GetTimeNS() - header->sendTime;
+  }
+  uint64_t elapsedTime = Benchmark_GetTimeNS() - startTime;
+  
+  atomic_store( &(echo.isRunning), false );
+  Thread_WaitExit( echoThread, 5000 );
+  
+  Benchmark_PrintResult( "latency", mode, transportName, size,
+                         samplesList, samplesCount, settings->messagesCount - samplesCount, elapsedTime );
+  
+  free( samplesList );
+  free( buffer );
+  free( message );
+  Benchmark_ClosePair( initiator, responder );
+}
+
+int main( int argc, char** argv )
+{
+  BenchmarkSettingsData settings;
+  if( !Benchmark_ParseArguments( &settings, argc, argv, 10000 ) ) return EXIT_FAILURE;
+  
+  Benchmark_PrintHeader();
+  
+  size_t pairsCount = 0;
+  for( size_t modeIndex = 0; modeIndex < BENCHMARK_MODES_COUNT; modeIndex++ )
+  {
+    BenchmarkMode mode = &(BENCHMARK_MODES_LIST[ modeIndex ]);
+    for( size_t sizeIndex = 0; sizeIndex < settings.sizesCount; sizeIndex++ )
+    {
+      size_t size = Benchmark_GetMessageSize( settings.sizesList[ sizeIndex ] );
+      if( Benchmark_IsSelected( &settings, mode, "shm" ) ) RunLatencyTest( &settings, mode, "shm", size, pairsCount++ );
+      if( Benchmark_IsSelected( &settings, mode, mode->networkTransport ) ) RunLatencyTest( &settings, mode, mode->networkTransport, size, pairsCount++ );
+      if( Benchmark_IsSelected( &settings, mode, BENCHMARK_LOCAL_TRANSPORT ) ) RunLatencyTest( &settings, mode, BENCHMARK_LOCAL_TRANSPORT, size, pairsCount++ );
+    }
+  }
+  
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//                                                                                  //
+//  Copyright (c) 2016-2025 Leonardo Consoni <leonardojc@protonmail.com>            //
+//                                                                                  //
+//  This file is part of Simple Async IPC.                                          //
+//                                                                                  //
+//  Simple Async IPC is free software: you can redistribute it and/or modify        //
+//  it under the terms of the GNU Lesser General Public License as published        //
+//  by the Free Software Foundation, either version 3 of the License, or            //
+//  (at your option) any later version.                                             //
+//                                                                                  //
+//  Simple Async IPC is distributed in the hope that it will be useful,             //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of                  //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                    //
+//  GNU Lesser General Public License for more details.                             //
+//                                                                                  //
+//  You should have received a copy of the GNU Lesser General Public License        //
+//  along with Simple Async IPC. If not, see <http://www.gnu.org/licenses/>.        //
+//                                                                                  //
+//////////////////////////////////////////////////////////////////////////////////////
+
+
+/////////////////////////////////////////////////////////////////////////////////////
+///// One-way benchmark: messages written as fast as possible by one end, with  /////
+///// delivery rate and latency under load measured by the other                /////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+typedef struct _SinkData
+{
+  IPCConnection connection;
+  bool isSpinning;
+  size_t messagesCount;                                         // Messages expected
+  uint64_t* samplesList;                                        // One-way latency of each message received
+  size_t samplesCount;
+  uint64_t lastReceiveTime;
+}
+SinkData;
+
+// Read messages until all the expected ones arrive, or none arrives for a while (lost datagrams)
+static void* AsyncSink( void* ref_sink )
+{
+  SinkData* sink = (SinkData*) ref_sink;
+  Byte* buffer = (Byte*) malloc( MAX_MESSAGE_LENGTH );
+  size_t length;
+  
+  while( sink->samplesCount < sink->messagesCount )
+  {
+    if( !Benchmark_Read( sink->connection, buffer, &length, sink->isSpinning, BENCHMARK_TIMEOUT_MS ) ) break;
+    sink->lastReceiveTime = Benchmark_GetTimeNS();
+    sink->samplesList[ sink->samplesCount++ ] = sink->lastReceiveTime - ((BenchmarkHeaderData*) buffer)->sendTime;
+  }
+  
+  free( buffer );
+  return NULL;
+}
+
+static void RunThroughputTest( BenchmarkSettings settings, BenchmarkMode mode, const char* transportName, size_t size, size_t pairIndex )
+{
+  IPCConnection initiator, responder;
+  if( !Benchmark_OpenPair( mode, transportName, pairIndex, &initiator, &responder ) )
+  {
+    Benchmark_ClosePair( initiator, responder );
+    return;
+  }
+  
+  IPCConnection source = mode->isInitiatorSource ? initiator : responder;
+  SinkData sink = { .connection = mode->isInitiatorSource ? responder : initiator, .isSpinning = settings->isSpinning,
+                    .messagesCount = settings->messagesCount, .samplesCount = 0 };
+  sink.samplesList = (uint64_t*) calloc( settings->messagesCount, sizeof(uint64_t) );
+  
+  Byte* message = (Byte*) calloc( size, 1 );
+  BenchmarkHeaderData* header = (BenchmarkHeaderData*) message;
+  
+  uint64_t startTime = Benchmark_GetTimeNS();
+  sink.lastReceiveTime = startTime;
+  Thread sinkThread = Thread_Start( AsyncSink, (void*) &sink, THREAD_JOINABLE );
+  
+  for( size_t messageIndex = 0; messageIndex < settings->messagesCount; messageIndex++ )
+  {
+    header->sequence = messageIndex + 1;
+    header->sendTime = Benchmark_GetTimeNS();
+    // Give up on a stalled sink: remaining messages are counted as lost
+    if( !Benchmark_Write( source, message, size ) ) break;
+  }
+  
+  Thread_WaitExit( sinkThread, 2 * BENCHMARK_TIMEOUT_MS + 5000 );
+  
+  Benchmark_PrintResult( "throughput", mode, transportName, size, sink.samplesList, sink.samplesCount,
+                         settings->messagesCount - sink.samplesCount, sink.lastReceiveTime - startTime );
+  
+  free( message );
+  free( sink.samplesList );
+  Benchmark_ClosePair( initiator, responder );
+}
+
+int main( int argc, char** argv )
+{
+  BenchmarkSettingsData settings;
+  if( !Benchmark_ParseArguments( &settings, argc, argv, 100000 ) ) return EXIT_FAILURE;
+  
+  Benchmark_PrintHeader();
+  
+  size_t pairsCount = 0;
+  for( size_t modeIndex = 0; modeIndex < BENCHMARK_MODES_COUNT; modeIndex++ )
+  {
+    BenchmarkMode mode = &(BENCHMARK_MODES_LIST[ modeIndex ]);
+    for( size_t sizeIndex = 0; sizeIndex < settings.sizesCount; sizeIndex++ )
+    {
+      size_t size = Benchmark_GetMessageSize( settings.sizesList[ sizeIndex ] );
+      if( Benchmark_IsSelected( &settings, mode, "shm" ) ) RunThroughputTest( &settings, mode, "shm", size, pairsCount++ );
+      if( Benchmark_IsSelected( &settings, mode, mode->networkTransport ) ) RunThroughputTest( &settings, mode, mode->networkTransport, size, pairsCount++ );
+      if( Benchmark_IsSelected( &settings, mode, BENCHMARK_LOCAL_TRANSPORT ) ) RunThroughputTest( &settings, mode, BENCHMARK_LOCAL_TRANSPORT, size, pairsCount++ );
+    }
+  }
+  
+  return EXIT_SUCCESS;
+}
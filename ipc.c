@@ -23,55 +23,127 @@
 #include <stdio.h>
 
 #include "interface/ipc.h"
+#include "ipc_extensions.h"
 
 #include "ipc_base_ip.h"
 #include "ipc_base_shm.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FIXED_MESSAGE_LENGTH 512                    // Message length assumed by IPC_ReadMessage/IPC_WriteMessage
+#define POLL_WAIT_TIME_MS 5000                      // Longest single wait for network events when polling without timeout
+#define SHM_POLL_INTERVAL_US 100                    // Check interval when waiting on shared memory and other connections together
+#define WAIT_ANY_LOCAL_ITEMS 16                     // Connections waited for by IPC_WaitAny without allocating memory
   
   
 typedef struct _IPCConnectionData
 {
   void* baseConnection;
-  bool (*ref_ReadMessage)( void*, Byte* message );
-  bool (*ref_WriteMessage)( void*, const Byte* );
+  bool (*ref_ReadMessage)( void*, Byte*, size_t, size_t* );
+  bool (*ref_WriteMessage)( void*, const Byte*, size_t );
+  bool (*ref_ReadPeerMessage)( void*, Byte*, size_t, size_t*, uint64_t* );
+  bool (*ref_WritePeerMessage)( void*, uint64_t, const Byte*, size_t );
   void (*ref_Close)( void* );
+  bool (*ref_GetReceiveCounters)( void*, uint64_t*, uint64_t*, uint64_t* );
+  bool (*ref_GetQueueCounters)( void*, uint64_t*, uint64_t* );
+  bool (*ref_GetStats)( void*, IPCStats* );
+  size_t (*ref_GetMessagesCount)( void* );
+  bool (*ref_WaitMessages)( void*, unsigned long );
+  Byte* (*ref_AcquireWriteBuffer)( void*, size_t* );
+  bool (*ref_CommitWrite)( void*, size_t );
+  const Byte* (*ref_PeekMessage)( void*, size_t* );
+  void (*ref_ReleaseMessage)( void* );
+  bool (*ref_WriteRequest)( void*, const Byte*, size_t, uint32_t* );
+  bool (*ref_ReadReply)( void*, uint32_t, Byte*, size_t, size_t* );
+  bool isNetwork;                                   // Network connections signal received messages through IP_WaitReceiveEvent()
 }
 IPCConnectionData;
 
 
 IPCConnection IPC_OpenConnection( enum IPCMode mode, const char* host, const char* channel )
+{
+  return IPC_OpenConnectionWithOptions( mode, host, channel, NULL );
+}
+
+IPCConnection IPC_OpenConnectionWithOptions( enum IPCMode mode, const char* host, const char* channel, const IPCOptions* options )
 {  
+  IPCOptions defaultOptions = { 0 };
+  if( options == NULL ) options = &defaultOptions;
+  
   fprintf( stderr, "opening connection\n" );
   
   IPCConnectionData* newConnection = (IPCConnectionData*) malloc( sizeof(IPCConnectionData) );
+  memset( newConnection, 0, sizeof(IPCConnectionData) );
   
   if( IP_IsValidAddress( host ) )
   {
-    fprintf( stderr, "ip://%s:%s\n", ( host != NULL ) ? host : "*", ( channel != NULL ) ? channel : "0" );
+    // Local socket hosts use sequenced packet connections (as TCP) for client-server too, keeping datagrams only for PUB/SUB
+    bool isLocal = IP_IsLocalAddress( host );
+    if( isLocal ) fprintf( stderr, "%s/%s\n", host, ( channel != NULL ) ? channel : "" );
+    else fprintf( stderr, "ip://%s:%s\n", ( host != NULL ) ? host : "*", ( channel != NULL ) ? channel : "0" );
     uint8_t connectionType = 0;
-    if( mode == IPC_REQ ) connectionType = ( IP_TCP | IP_CLIENT );
-    else if( mode == IPC_REP ) connectionType = ( IP_TCP | IP_SERVER );
+    if( mode == IPC_REQ || ( mode == IPC_CLIENT && isLocal ) ) connectionType = ( IP_TCP | IP_CLIENT );
+    else if( mode == IPC_REP || ( mode == IPC_SERVER && isLocal ) ) connectionType = ( IP_TCP | IP_SERVER );
     else if( mode == IPC_SUB || mode == IPC_CLIENT ) connectionType = ( IP_UDP | IP_CLIENT );
     else if( mode == IPC_PUB || mode == IPC_SERVER ) connectionType = ( IP_UDP | IP_SERVER );
-    newConnection->baseConnection = IP_OpenConnection( connectionType, host, channel );
+    const uint8_t QUEUE_POLICIES[] = { [ IPC_QUEUE_DEFAULT ] = IP_QUEUE_DEFAULT, [ IPC_QUEUE_BLOCK ] = IP_QUEUE_BLOCK, 
+                                       [ IPC_QUEUE_DROP_NEWEST ] = IP_QUEUE_DROP_NEWEST, [ IPC_QUEUE_DROP_OLDEST ] = IP_QUEUE_DROP_OLDEST, 
+                                       [ IPC_QUEUE_ERROR ] = IP_QUEUE_ERROR };
+    uint8_t queuePolicy = ( options->queuePolicy <= IPC_QUEUE_ERROR ) ? QUEUE_POLICIES[ options->queuePolicy ] : IP_QUEUE_DEFAULT;
+    newConnection->baseConnection = IP_OpenConnection( connectionType, host, channel, options->queueLength, queuePolicy, options->outputBufferSize );
     newConnection->ref_ReadMessage = IP_ReceiveMessage;
     newConnection->ref_WriteMessage = IP_SendMessage;
+    newConnection->ref_ReadPeerMessage = IP_ReceivePeerMessage;
+    newConnection->ref_WritePeerMessage = IP_SendPeerMessage;
     newConnection->ref_Close = IP_CloseConnection;
+    newConnection->ref_GetReceiveCounters = IP_GetReceiveCounters;
+    newConnection->ref_GetQueueCounters = IP_GetQueueCounters;
+    newConnection->ref_GetStats = IP_GetStats;
+    newConnection->ref_GetMessagesCount = IP_GetMessagesCount;
+    newConnection->isNetwork = true;
   }
   else // SHM host
   {
     fprintf( stderr, "shm://%s/%s\n", host, channel );
+    uint16_t mappingFlags = 0;
+    if( options->useHugePages ) mappingFlags |= SHM_HUGE_PAGES;
+    if( options->prefaultMemory ) mappingFlags |= SHM_PREFAULT;
+    if( options->lockMemory ) mappingFlags |= SHM_LOCK_MEMORY;
+    if( options->keepLatestOnly && ( mode == IPC_PUB || mode == IPC_SUB ) ) mappingFlags |= SHM_LATEST_VALUE;
+    // Several clients may send to the same server, which replies to one of them or to all
+    if( mode == IPC_SERVER ) mappingFlags |= SHM_SHARED_INPUT | SHM_BROADCAST_OUTPUT;
+    else if( mode == IPC_CLIENT ) mappingFlags |= SHM_BROADCAST_INPUT | SHM_SHARED_OUTPUT;
+    // Every subscriber reads all publications, and all of them may send messages back to the publisher
+    else if( mode == IPC_PUB ) mappingFlags |= SHM_BROADCAST_OUTPUT | SHM_SHARED_INPUT;
+    else if( mode == IPC_SUB ) mappingFlags |= SHM_BROADCAST_INPUT | SHM_SHARED_OUTPUT;
+    else if( mode == IPC_REP ) mappingFlags |= SHM_REPLIER;
+    size_t segmentSize = options->sharedMemorySize;
     newConnection->baseConnection = NULL;
-    if( mode == IPC_REQ ) newConnection->baseConnection = SHM_OpenMapping( host, channel, "rep", "req" );
-    else if( mode == IPC_REP ) newConnection->baseConnection = SHM_OpenMapping( host, channel, "req", "rep" );
-    else if( mode == IPC_PUB ) newConnection->baseConnection = SHM_OpenMapping( host, channel, "sub", "pub" );
-    else if( mode == IPC_SUB ) newConnection->baseConnection = SHM_OpenMapping( host, channel, "pub", "sub" );
-    else if( mode == IPC_CLIENT ) newConnection->baseConnection = SHM_OpenMapping( host, channel, "server", "client" );
-    else if( mode == IPC_SERVER ) newConnection->baseConnection = SHM_OpenMapping( host, channel, "client", "server" );
+    if( mode == IPC_REQ ) newConnection->baseConnection = SHM_OpenMapping( host, channel, "rep", "req", segmentSize, mappingFlags );
+    else if( mode == IPC_REP ) newConnection->baseConnection = SHM_OpenMapping( host, channel, "req", "rep", segmentSize, mappingFlags );
+    else if( mode == IPC_PUB ) newConnection->baseConnection = SHM_OpenMapping( host, channel, "sub", "pub", segmentSize, mappingFlags );
+    else if( mode == IPC_SUB ) newConnection->baseConnection = SHM_OpenMapping( host, channel, "pub", "sub", segmentSize, mappingFlags );
+    else if( mode == IPC_CLIENT ) newConnection->baseConnection = SHM_OpenMapping( host, channel, "server", "client", segmentSize, mappingFlags );
+    else if( mode == IPC_SERVER ) newConnection->baseConnection = SHM_OpenMapping( host, channel, "client", "server", segmentSize, mappingFlags );
     newConnection->ref_ReadMessage = SHM_ReadData;
     newConnection->ref_WriteMessage = SHM_WriteData;
-    newConnection->ref_Close = SHM_CloseMapping;    
+    newConnection->ref_ReadPeerMessage = SHM_ReadPeerData;
+    newConnection->ref_WritePeerMessage = SHM_WritePeerData;
+    newConnection->ref_Close = SHM_CloseMapping;
+    newConnection->ref_GetMessagesCount = SHM_GetDataCount;
+    newConnection->ref_GetStats = SHM_GetStats;
+    newConnection->ref_WaitMessages = SHM_WaitData;
+    newConnection->ref_AcquireWriteBuffer = SHM_AcquireWriteBuffer;
+    newConnection->ref_CommitWrite = SHM_CommitWrite;
+    newConnection->ref_PeekMessage = SHM_PeekData;
+    newConnection->ref_ReleaseMessage = SHM_ReleaseData;
+    if( mode == IPC_REQ )
+    {
+      newConnection->ref_WriteRequest = SHM_WriteRequest;
+      newConnection->ref_ReadReply = SHM_ReadReply;
+    }
   }
   
   if( newConnection->baseConnection == NULL )
@@ -85,14 +157,43 @@ IPCConnection IPC_OpenConnection( enum IPCMode mode, const char* host, const cha
 
 bool IPC_ReadMessage( IPCConnection ref_connection, Byte* message )
 {
-  IPCConnectionData* connection = (IPCConnectionData*) ref_connection;
-  return connection->ref_ReadMessage( (void*) connection->baseConnection, message );
+  size_t messageLength = 0;
+  if( !IPC_ReadSizedMessage( ref_connection, message, FIXED_MESSAGE_LENGTH, &messageLength ) ) return false;
+  // Fixed length callers expect unused trailing bytes to be cleared
+  memset( message + messageLength, 0, FIXED_MESSAGE_LENGTH - messageLength );
+  return true;
 }
 
 bool IPC_WriteMessage( IPCConnection ref_connection, const Byte* message )
+{
+  return IPC_WriteSizedMessage( ref_connection, message, FIXED_MESSAGE_LENGTH );
+}
+
+bool IPC_ReadSizedMessage( IPCConnection ref_connection, Byte* message, size_t maxLength, size_t* ref_length )
+{
+  IPCConnectionData* connection = (IPCConnectionData*) ref_connection;
+  return connection->ref_ReadMessage( (void*) connection->baseConnection, message, maxLength, ref_length );
+}
+
+bool IPC_WriteSizedMessage( IPCConnection ref_connection, const Byte* message, size_t length )
+{
+  IPCConnectionData* connection = (IPCConnectionData*) ref_connection;
+  return connection->ref_WriteMessage( (void*) connection->baseConnection, message, length );
+}
+
+bool IPC_ReadPeerMessage( IPCConnection ref_connection, Byte* message, size_t maxLength, size_t* ref_length, IPCPeer* ref_peer )
+{
+  IPCConnectionData* connection = (IPCConnectionData*) ref_connection;
+  *ref_peer = IPC_ALL_PEERS;
+  if( connection->ref_ReadPeerMessage == NULL ) return IPC_ReadSizedMessage( ref_connection, message, maxLength, ref_length );
+  return connection->ref_ReadPeerMessage( (void*) connection->baseConnection, message, maxLength, ref_length, ref_peer );
+}
+
+bool IPC_WritePeerMessage( IPCConnection ref_connection, IPCPeer peer, const Byte* message, size_t length )
 {
   IPCConnectionData* connection = (IPCConnectionData*) ref_connection;
-  return connection->ref_WriteMessage( (void*) connection->baseConnection, message );
+  if( connection->ref_WritePeerMessage == NULL ) return ( peer == IPC_ALL_PEERS ) && IPC_WriteSizedMessage( ref_connection, message, length );
+  return connection->ref_WritePeerMessage( (void*) connection->baseConnection, peer, message, length );
 }
 
 void IPC_CloseConnection( IPCConnection ref_connection )
@@ -100,3 +201,170 @@ void IPC_CloseConnection( IPCConnection ref_connection )
   IPCConnectionData* connection = (IPCConnectionData*) ref_connection;
   connection->ref_Close( (void*) connection->baseConnection );
 }
+
+bool IPC_GetReceiveCounters( IPCConnection ref_connection, IPCReceiveCounters* ref_counters )
+{
+  IPCConnectionData* connection = (IPCConnectionData*) ref_connection;
+  if( connection->ref_GetReceiveCounters == NULL ) return false;
+  return connection->ref_GetReceiveCounters( (void*) connection->baseConnection, &(ref_counters->callsCount), 
+                                             &(ref_counters->messagesCount), &(ref_counters->largestBatch) );
+}
+
+bool IPC_GetQueueCounters( IPCConnection ref_connection, IPCQueueCounters* ref_counters )
+{
+  IPCConnectionData* connection = (IPCConnectionData*) ref_connection;
+  if( connection->ref_GetQueueCounters == NULL ) return false;
+  return connection->ref_GetQueueCounters( (void*) connection->baseConnection, &(ref_counters->readDropsCount), &(ref_counters->writeDropsCount) );
+}
+
+bool IPC_GetStats( IPCConnection ref_connection, IPCStats* ref_stats )
+{
+  IPCConnectionData* connection = (IPCConnectionData*) ref_connection;
+  if( connection->ref_GetStats == NULL ) return false;
+  return connection->ref_GetStats( (void*) connection->baseConnection, ref_stats );
+}
+
+Byte* IPC_AcquireWriteBuffer( IPCConnection ref_connection, size_t* ref_capacity )
+{
+  IPCConnectionData* connection = (IPCConnectionData*) ref_connection;
+  if( connection->ref_AcquireWriteBuffer == NULL ) return NULL;
+  return connection->ref_AcquireWriteBuffer( (void*) connection->baseConnection, ref_capacity );
+}
+
+bool IPC_CommitWrite( IPCConnection ref_connection, size_t length )
+{
+  IPCConnectionData* connection = (IPCConnectionData*) ref_connection;
+  if( connection->ref_CommitWrite == NULL ) return false;
+  return connection->ref_CommitWrite( (void*) connection->baseConnection, length );
+}
+
+const Byte* IPC_PeekMessage( IPCConnection ref_connection, size_t* ref_length )
+{
+  IPCConnectionData* connection = (IPCConnectionData*) ref_connection;
+  if( connection->ref_PeekMessage == NULL ) return NULL;
+  return connection->ref_PeekMessage( (void*) connection->baseConnection, ref_length );
+}
+
+void IPC_ReleaseMessage( IPCConnection ref_connection )
+{
+  IPCConnectionData* connection = (IPCConnectionData*) ref_connection;
+  if( connection->ref_ReleaseMessage == NULL ) return;
+  connection->ref_ReleaseMessage( (void*) connection->baseConnection );
+}
+
+IPCRequestToken IPC_Request( IPCConnection ref_connection, const Byte* message, size_t length )
+{
+  IPCConnectionData* connection = (IPCConnectionData*) ref_connection;
+  if( connection->ref_WriteRequest == NULL ) return IPC_INVALID_TOKEN;
+  
+  uint32_t requestID = IPC_INVALID_TOKEN;
+  if( !connection->ref_WriteRequest( (void*) connection->baseConnection, message, length, &requestID ) ) return IPC_INVALID_TOKEN;
+  
+  return (IPCRequestToken) requestID;
+}
+
+bool IPC_ReadReply( IPCConnection ref_connection, IPCRequestToken token, Byte* message, size_t maxLength, size_t* ref_length )
+{
+  IPCConnectionData* connection = (IPCConnectionData*) ref_connection;
+  if( connection->ref_ReadReply == NULL || token == IPC_INVALID_TOKEN ) return false;
+  return connection->ref_ReadReply( (void*) connection->baseConnection, (uint32_t) token, message, maxLength, ref_length );
+}
+
+static uint64_t GetMonotonicTimeUS( void )
+{
+  struct timespec currentTime;
+  clock_gettime( CLOCK_MONOTONIC, &currentTime );
+  return (uint64_t) currentTime.tv_sec * 1000000 + (uint64_t) currentTime.tv_nsec / 1000;
+}
+
+size_t IPC_Poll( IPCPollItem* itemsList, size_t itemsCount, long timeoutMs )
+{
+  uint64_t deadlineUS = GetMonotonicTimeUS() + ( ( timeoutMs > 0 ) ? (uint64_t) timeoutMs * 1000 : 0 );
+  
+  while( true )
+  {
+    // Read events count before checking queues, so that messages arriving in between still end the wait
+    uint64_t lastEventsCount = IP_GetReceiveEventsCount();
+    
+    size_t readyItemsCount = 0, sharedMemoryItemsCount = 0;
+    bool hasNetworkItems = false;
+    IPCConnectionData* sharedMemoryConnection = NULL;
+    for( size_t itemIndex = 0; itemIndex < itemsCount; itemIndex++ )
+    {
+      IPCConnectionData* connection = (IPCConnectionData*) itemsList[ itemIndex ].connection;
+      itemsList[ itemIndex ].isReadable = false;
+      if( connection == NULL ) continue;
+      itemsList[ itemIndex ].isReadable = ( connection->ref_GetMessagesCount( (void*) connection->baseConnection ) > 0 );
+      if( itemsList[ itemIndex ].isReadable ) readyItemsCount++;
+      if( connection->isNetwork ) hasNetworkItems = true;
+      else
+      {
+        sharedMemoryConnection = connection;
+        sharedMemoryItemsCount++;
+      }
+    }
+    
+    if( readyItemsCount > 0 || timeoutMs == 0 ) return readyItemsCount;
+    
+    uint64_t waitTimeUS = POLL_WAIT_TIME_MS * 1000;
+    if( timeoutMs > 0 )
+    {
+      uint64_t currentTimeUS = GetMonotonicTimeUS();
+      if( currentTimeUS >= deadlineUS ) return 0;
+      if( deadlineUS - currentTimeUS < waitTimeUS ) waitTimeUS = deadlineUS - currentTimeUS;
+    }
+    
+    // A single shared memory queue can be slept on directly. Otherwise, only network events wake us up
+    if( sharedMemoryItemsCount == 1 && !hasNetworkItems )
+    {
+      sharedMemoryConnection->ref_WaitMessages( (void*) sharedMemoryConnection->baseConnection, ( waitTimeUS + 999 ) / 1000 );
+      continue;
+    }
+    if( sharedMemoryItemsCount > 0 && waitTimeUS > SHM_POLL_INTERVAL_US ) waitTimeUS = SHM_POLL_INTERVAL_US;
+    
+    if( hasNetworkItems ) 
+    {
+      IP_WaitReceiveEvent( lastEventsCount, ( waitTimeUS + 999 ) / 1000 );
+    }
+    else
+    {
+      struct timespec sleepTime = { .tv_sec = waitTimeUS / 1000000, .tv_nsec = ( waitTimeUS % 1000000 ) * 1000 };
+      nanosleep( &sleepTime, NULL );
+    }
+  }
+}
+
+int IPC_WaitAny( IPCConnection* connectionsList, size_t connectionsCount, long timeoutMs )
+{
+  if( connectionsCount == 0 ) return -1;
+  
+  // Usual (short) lists are polled from the stack, as this is called on every wait of the application loop
+  IPCPollItem localItemsList[ WAIT_ANY_LOCAL_ITEMS ];
+  IPCPollItem* itemsList = localItemsList;
+  if( connectionsCount > WAIT_ANY_LOCAL_ITEMS ) itemsList = (IPCPollItem*) malloc( connectionsCount * sizeof(IPCPollItem) );
+  if( itemsList == NULL ) return -1;
+  for( size_t connectionIndex = 0; connectionIndex < connectionsCount; connectionIndex++ )
+    itemsList[ connectionIndex ].connection = connectionsList[ connectionIndex ];
+  
+  int readyIndex = -1;
+  if( IPC_Poll( itemsList, connectionsCount, timeoutMs ) > 0 )
+  {
+    for( size_t connectionIndex = 0; connectionIndex < connectionsCount; connectionIndex++ )
+    {
+      if( itemsList[ connectionIndex ].isReadable ) 
+      {
+        readyIndex = (int) connectionIndex;
+        break;
+      }
+    }
+  }
+  
+  if( itemsList != localItemsList ) free( itemsList );
+  
+  return readyIndex;
+}
+
+bool IPC_SetNetworkThreadsCount( size_t threadsCount )
+{
+  return IP_SetReactorsCount( threadsCount );
+}
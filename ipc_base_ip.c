@@ -22,18 +22,24 @@
 
 /////////////////////////////////////////////////////////////////////////////////////
 ///// Multiplatform library for creation and handling of IP sockets connections /////
-///// as server or client, using TCP or UDP protocols                           /////
+///// as server or client, using TCP or UDP protocols (or local sockets)        /////
 /////////////////////////////////////////////////////////////////////////////////////
 
+#ifdef __linux__
+  #define _GNU_SOURCE                                           // Linux specific socket calls (e.g. sendmmsg)
+#endif
+
 #include "ipc_base_ip.h"
+#include "ipc_stats_counters.h"
 
 #include "threads/threads.h"
-#include "threads/thread_safe_queues.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <stdalign.h>
   
 #ifdef __unix__
   #define _XOPEN_SOURCE 700
@@ -63,6 +69,9 @@
   #include <netinet/in.h>
   #include <arpa/inet.h>
   #include <netdb.h>
+  #include <poll.h>
+  #include <pthread.h>
+  #include <time.h>
 
   const int SOCKET_ERROR = -1;
   const int INVALID_SOCKET = -1;
@@ -70,108 +79,436 @@
   typedef int Socket;
 #endif
 
-#define IP_MAX_MESSAGE_LENGTH 512
+// Readiness notification method: select for legacy systems, epoll where available, poll otherwise
+#if defined( IP_NETWORK_LEGACY )
+  #define IP_EVENTS_SELECT
+#elif defined( __linux__ )
+  #define IP_EVENTS_EPOLL
+  #include <sys/epoll.h>
+  #include <sys/eventfd.h>
+#else
+  #define IP_EVENTS_POLL
+#endif
+
+// Optional io_uring engine (built with IP_IO_URING), reading sockets with multishot requests into receive buffers registered
+// with the kernel, and submitting requests in batches with each wait. Reactors fall back to epoll on kernels older than 6.1
+#if defined( IP_IO_URING ) && defined( IP_EVENTS_EPOLL )
+  #include <linux/io_uring.h>
+  #ifdef IORING_SETUP_DEFER_TASKRUN
+    #define IP_EVENTS_RING
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+  #endif
+#endif
+
+// Multiple datagrams per system call (sendmmsg/recvmmsg) on modern Linux systems
+#if defined( __linux__ ) && !defined( IP_NETWORK_LEGACY )
+  #define IP_MULTIPLE_MESSAGES
+#endif
+
+// Same host connections through sockets bound to file system paths, with sequenced packets support
+#if defined( __linux__ ) && !defined( IP_NETWORK_LEGACY )
+  #define IP_LOCAL_SOCKETS
+  #include <sys/un.h>
+  #include <sys/stat.h>
+#endif
+
+#ifndef MAX_MESSAGE_LENGTH
+  #define MAX_MESSAGE_LENGTH 65507                              // Maximum UDP datagram payload
+#endif
+#define IP_MAX_MESSAGE_LENGTH MAX_MESSAGE_LENGTH
 #define PORT_LENGTH 6                                           // Maximum length of short integer string representation
-  
-typedef uint8_t Message[ IP_MAX_MESSAGE_LENGTH ];  
+#define CACHE_LINE_SIZE 64
+
+#define TCP_FRAME_HEADER_LENGTH 4                               // Length prefix of each message sent over TCP streams
+#define TCP_RECEIVE_CHUNK_LENGTH 65536                          // Minimum free space on TCP receive buffers before each read
+#define TCP_OUTPUT_BUFFER_SIZE ( 4 * 1024 * 1024 )              // Default limit of bytes pending on each TCP server client before it is disconnected
+
+#define MESSAGE_POOL_MIN_LENGTH 64                              // Payload capacity of the smallest pooled buffers (size classes are powers of 2)
+#define MESSAGE_POOL_MAX_CLASSES 32
+#define MESSAGE_POOL_CLASS_SIZE ( 256 * 1024 )                  // Bytes of free buffers kept by each size class
+#define MESSAGE_POOL_MIN_COUNT 16                               // Free buffers kept by size classes too large for the above limit
+
+// Variable length message, stored on a pooled buffer of the smallest size class that fits its payload.
+// A single copy may be referenced by multiple queues or sends, being recycled after the last reference is dropped
+typedef struct _MessageData
+{
+  uint64_t queueTime;                                           // Creation instant, for latency statistics
+  uint64_t peerID;                                              // Remote that sent (or should only receive) the message on server connections
+  atomic_uint referencesCount;
+  uint8_t sizeClass;                                            // Index of the pool the buffer returns to
+  size_t length;
+  uint8_t frameHeader[ TCP_FRAME_HEADER_LENGTH ];               // Contiguous to data, so that a TCP frame is sent with a single call
+  uint8_t data[];
+}
+MessageData;
+
+typedef MessageData* Message;
+
+typedef struct _MessageSlotData
+{
+  atomic_size_t sequence;                                       // Position + 1 once filled, position + capacity once read (shared rings only)
+  Message message;
+}
+MessageSlotData;
+
+// Bounded lock-free ring of message references. Rings with a single writer and a single reader only synchronize
+// through head and tail, while shared ones claim positions with atomic exchanges and mark each slot through its sequence number
+typedef struct _MessageRingData
+{
+  size_t capacity;
+  bool isShared;                                                // Multiple writers or readers (dropping old messages makes writers read too)
+  alignas(CACHE_LINE_SIZE) atomic_size_t head;                  // Next slot to be written
+  size_t cachedTail;                                            // Last tail position seen by the (single) writer
+  alignas(CACHE_LINE_SIZE) atomic_size_t tail;                  // Next slot to be read
+  size_t cachedHead;                                            // Last head position seen by the reader
+  alignas(CACHE_LINE_SIZE) MessageSlotData slotsList[];
+}
+MessageRingData;
+
+typedef MessageRingData* MessageRing;
 
 #ifndef IP_NETWORK_LEGACY
-  #include <poll.h>
-  typedef struct pollfd SocketPoller;
   #define ADDRESS_LENGTH INET6_ADDRSTRLEN                       // Maximum length of IPv6 address (host+port) string
-  typedef struct sockaddr_in6 IPAddressData;                    // IPv6 structure can store both IPv4 and IPv6 data
-  #define IS_IPV6_MULTICAST_ADDRESS( address ) ( ((struct sockaddr_in6*) address)->sin6_addr.s6_addr[ 0 ] == 0xFF )
+  typedef struct sockaddr_storage IPAddressData;                // Can store IPv4, IPv6 and local socket addresses
+  #define IS_IPV6_MULTICAST_ADDRESS( address ) ( ((struct sockaddr*) address)->sa_family == AF_INET6 && \
+                                                 ((struct sockaddr_in6*) address)->sin6_addr.s6_addr[ 0 ] == 0xFF )
   #define ARE_EQUAL_IPV6_ADDRESSES( address_1, address_2 ) ( ((struct sockaddr*) address_1)->sa_family == AF_INET6 && \
-                                                             ((IPAddressData*) address_1)->sin6_port == ((IPAddressData*) address_2)->sin6_port && \
-                                                             memcmp( ((IPAddressData*) address_1)->sin6_addr.s6_addr, ((IPAddressData*) address_2)->sin6_addr.s6_addr, 16 ) == 0 )
+                                                             ((struct sockaddr*) address_2)->sa_family == AF_INET6 && \
+                                                             ((struct sockaddr_in6*) address_1)->sin6_port == ((struct sockaddr_in6*) address_2)->sin6_port && \
+                                                             memcmp( ((struct sockaddr_in6*) address_1)->sin6_addr.s6_addr, ((struct sockaddr_in6*) address_2)->sin6_addr.s6_addr, 16 ) == 0 )
 #else
-  typedef struct { Socket fd; } SocketPoller;
   #define ADDRESS_LENGTH INET_ADDRSTRLEN + PORT_LENGTH          // Maximum length of IPv4 address (host+port) string
   typedef struct sockaddr_in IPAddressData;                     // Legacy mode only works with IPv4 addresses
   #define IS_IPV6_MULTICAST_ADDRESS( address ) false
   #define ARE_EQUAL_IPV6_ADDRESSES( address_1, address_2 ) false
 #endif
 typedef struct sockaddr* IPAddress;                             // Opaque IP address type
-#define IS_IPV4_MULTICAST_ADDRESS( address ) ( (ntohl( ((struct sockaddr_in*) address)->sin_addr.s_addr ) & 0xF0000000) == 0xE0000000 )
+#define IS_IPV4_MULTICAST_ADDRESS( address ) ( ((struct sockaddr*) address)->sa_family == AF_INET && \
+                                               (ntohl( ((struct sockaddr_in*) address)->sin_addr.s_addr ) & 0xF0000000) == 0xE0000000 )
 #define ARE_EQUAL_IPV4_ADDRESSES( address_1, address_2 ) ( ((struct sockaddr*) address_1)->sa_family == AF_INET && \
-                                                           ((struct sockaddr_in*) address_1)->sin_port == ((struct sockaddr_in*) address_2)->sin_port )
+                                                           ((struct sockaddr*) address_2)->sa_family == AF_INET && \
+                                                           ((struct sockaddr_in*) address_1)->sin_port == ((struct sockaddr_in*) address_2)->sin_port && \
+                                                           ((struct sockaddr_in*) address_1)->sin_addr.s_addr == ((struct sockaddr_in*) address_2)->sin_addr.s_addr )
+
+#ifdef IP_LOCAL_SOCKETS
+  #define LOCAL_ADDRESS_PREFIX "unix:"                                // Hosts selecting local sockets, followed by their directory path
+  #define IS_LOCAL_ADDRESS( address ) ( ((struct sockaddr*) address)->sa_family == AF_UNIX )
+  // Bytes after the path (or abstract name) are always cleared, so that whole paths can be compared
+  #define ARE_EQUAL_LOCAL_ADDRESSES( address_1, address_2 ) ( IS_LOCAL_ADDRESS( address_1 ) && IS_LOCAL_ADDRESS( address_2 ) && \
+                                                              memcmp( ((struct sockaddr_un*) address_1)->sun_path, ((struct sockaddr_un*) address_2)->sun_path, \
+                                                                      sizeof(((struct sockaddr_un*) address_1)->sun_path) ) == 0 )
+#else
+  #define IS_LOCAL_ADDRESS( address ) false
+  #define ARE_EQUAL_LOCAL_ADDRESSES( address_1, address_2 ) false
+#endif
 
 #define IS_IP_MULTICAST_ADDRESS( address ) ( IS_IPV4_MULTICAST_ADDRESS( address ) || IS_IPV6_MULTICAST_ADDRESS( address ) )
-#define ARE_EQUAL_IP_ADDRESSES( address_1, address_2 ) ( ARE_EQUAL_IPV4_ADDRESSES( address_1, address_2 ) || ARE_EQUAL_IPV6_ADDRESSES( address_1, address_2 ) )
+#define ARE_EQUAL_IP_ADDRESSES( address_1, address_2 ) ( ARE_EQUAL_IPV4_ADDRESSES( address_1, address_2 ) || ARE_EQUAL_IPV6_ADDRESSES( address_1, address_2 ) || \
+                                                         ARE_EQUAL_LOCAL_ADDRESSES( address_1, address_2 ) )
+
+#ifdef MSG_NOSIGNAL
+  #define SEND_FLAGS MSG_NOSIGNAL                               // Broken TCP connections should not kill the process with SIGPIPE
+#else
+  #define SEND_FLAGS 0
+#endif
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 /////                                      INTERFACE DEFINITION                                       /////
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-const size_t QUEUE_MAX_ITEMS = 10;
 const unsigned long EVENT_WAIT_TIME_MS = 5000;
+const unsigned long SEND_WAIT_TIME_MS = 1000;
+
+#define EVENTS_BATCH_LENGTH 256                                 // Maximum number of ready sockets handled per wait call
+#define SEND_BATCH_LENGTH 64                                    // Maximum number of queued messages handed to each send method call
+#define DATAGRAMS_BATCH_LENGTH 1024                             // Maximum number of datagrams per sendmmsg call (UIO_MAXIOV)
+#ifndef RECEIVE_BATCH_LENGTH
+  #define RECEIVE_BATCH_LENGTH 32                               // Maximum number of datagrams read per recvmmsg call
+#endif
+#ifndef IP_REACTORS_COUNT
+  #define IP_REACTORS_COUNT 1                                   // Default number of threads servicing network connections
+#endif
+#ifndef IP_DEFAULT_QUEUE_LENGTH
+  #define IP_DEFAULT_QUEUE_LENGTH 10                            // Capacity (in messages) of read and write queues not set on connection options
+#endif
+#define QUEUE_RETRY_TIME_NS 100000                              // Pause between attempts of blocking writes on a full write queue
+#ifndef UDP_PEER_IDLE_TIME_MS
+  #define UDP_PEER_IDLE_TIME_MS 30000                           // UDP server remotes not heard from for this long stop receiving messages
+#endif
+#define UDP_KEEPALIVE_TIME_MS ( UDP_PEER_IDLE_TIME_MS / 3 )     // UDP clients that sent nothing for this long send an empty datagram
+#define UDP_PEERS_CHECK_TIME_MS 1000                            // Minimum interval between searches for idle UDP server remotes
+#define UDP_PEERS_MIN_TABLE_SIZE 16
+#ifndef RING_QUEUE_LENGTH
+  #define RING_QUEUE_LENGTH 1024                                // Submission entries of each reactor io_uring (4 times as many completion entries)
+#endif
+#define RING_BUFFERS_COUNT 64                                   // Receive buffers registered by each reactor (power of 2)
+#define RING_BUFFERS_GROUP 0
 
 typedef struct _IPConnectionData IPConnectionData;
 typedef IPConnectionData* IPConnection;
 
+typedef struct _SocketPoller SocketPoller;
+
+typedef struct _ReactorData ReactorData;
+typedef ReactorData* Reactor;
+
+// Storage for data read from TCP streams, where partial frames are kept until completed
+typedef struct _StreamBufferData
+{
+  uint8_t* data;
+  size_t length;
+}
+StreamBufferData;
+
+typedef StreamBufferData* StreamBuffer;
+
+#define STREAM_BUFFER_CAPACITY ( TCP_FRAME_HEADER_LENGTH + IP_MAX_MESSAGE_LENGTH + TCP_RECEIVE_CHUNK_LENGTH )
+
+// Frames waiting for a TCP stream to become writable, sent in order (the first one possibly already in part)
+typedef struct _StreamOutputData
+{
+  Message* messagesList;                                        // References shared with other clients of the same server
+  size_t messagesCount;
+  size_t sentLength;                                            // Bytes of the first frame already written
+  size_t queuedLength;                                          // Bytes of all frames not written yet
+}
+StreamOutputData;
+
+typedef StreamOutputData* StreamOutput;
+
+// Remote client accepted by a TCP server connection
+typedef struct _TCPClientData
+{
+  SocketPoller* socket;
+  uint64_t peerID;
+  StreamBufferData inputBuffer;
+  StreamOutputData outputBuffer;
+}
+TCPClientData;
+
+typedef TCPClientData* TCPClient;
+
+// Socket registered for reading events, with references to the connection (and remote client) it belongs to
+struct _SocketPoller
+{
+  Socket fd;
+  IPConnection connection;
+  TCPClient client;                                             // Remote client of TCP servers (NULL for the connection's own socket)
+  bool isWriting;                                               // Also waiting for the socket to become writable, while output is pending
+  #ifdef IP_EVENTS_EPOLL
+  uint32_t polledEvents;                                        // Currently registered events (0 if removed from the poller)
+  #endif
+  #ifdef IP_EVENTS_RING
+  uint32_t ringSlot;                                            // Position on the reactor ring sockets list, carried by requests
+  uint8_t ringRequests;                                         // Requests in flight (RING_READ and RING_WRITE), or being canceled (RING_CANCEL)
+  #endif
+};
+
+// Scratch buffers for datagram system calls, owned by a single reactor thread
+typedef struct _DatagramsBatchData
+{
+  Message messagesList[ RECEIVE_BATCH_LENGTH ];                 // Largest class buffers, handed over to read queues when filled with large datagrams
+  IPAddressData addressesList[ RECEIVE_BATCH_LENGTH ];
+  #ifdef IP_MULTIPLE_MESSAGES
+  struct mmsghdr receiveDatagramsList[ RECEIVE_BATCH_LENGTH ];
+  struct iovec receiveBuffersList[ RECEIVE_BATCH_LENGTH ];
+  struct mmsghdr sendDatagramsList[ DATAGRAMS_BATCH_LENGTH ];
+  struct iovec sendBuffersList[ SEND_BATCH_LENGTH ];
+  #endif
+}
+DatagramsBatchData;
+
+typedef DatagramsBatchData* DatagramsBatch;
+
+#ifdef IP_EVENTS_RING
+#define RING_READ 0x01                                          // Request types, on the lowest bits of request identifiers
+#define RING_WRITE 0x02
+#define RING_CANCEL 0x04
+// Rounded up to 8 bytes, so that every buffer starts with an aligned receive header
+#define RING_BUFFER_LENGTH ( ( sizeof(struct io_uring_recvmsg_out) + sizeof(IPAddressData) + IP_MAX_MESSAGE_LENGTH + 7 ) & ~((size_t) 7) )
+
+// Socket with requests on a reactor ring. Slots are reused with a new generation, so that completions of removed sockets are ignored
+typedef struct _RingSlotData
+{
+  SocketPoller* socket;
+  uint32_t generation;
+}
+RingSlotData;
+
+// Submission and completion queues shared with the kernel, along with the receive buffers provided to it
+typedef struct _EventsRingData
+{
+  int fd;
+  void* queuesMap;                                              // Both queues on a single mapping
+  size_t queuesMapSize;
+  struct io_uring_sqe* submissionsList;
+  size_t submissionsCount;
+  atomic_uint* submissionHead;                                  // Advanced by the kernel
+  atomic_uint* submissionTail;
+  uint32_t submissionMask;
+  struct io_uring_cqe* completionsList;
+  atomic_uint* completionHead;
+  atomic_uint* completionTail;                                  // Advanced by the kernel
+  uint32_t completionMask;
+  struct io_uring_buf_ring* buffersRing;                        // Free receive buffers, taken by the kernel as data arrives
+  uint8_t* buffersData;
+  struct msghdr datagramHeader;                                 // Layout of received datagrams: source address, then payload
+  RingSlotData* slotsList;
+  size_t slotsCount;
+  uint32_t* freeSlotsList;
+  size_t freeSlotsCount;
+  bool isEnabled;
+  pthread_t submitterThread;                                    // Only thread allowed to submit requests, once enabled
+  struct io_uring_sqe* overflowList;                            // Requests queued by other threads while the submission queue was full
+  size_t overflowCount;
+  bool isOverflowing;                                           // Last entry given for a new request is on the overflow list
+}
+EventsRingData;
+
+typedef EventsRingData* EventsRing;
+#endif
+
+// Thread handling reading and writing of all sockets of its connections, with its own events poller
+struct _ReactorData
+{
+  Thread thread;
+  volatile bool isRunning;
+  pthread_mutex_t lock;                                         // Held by the reactor thread, except while waiting for events
+  pthread_cond_t closeCondition;                                // Signaled when closing connections are released by the reactor
+  IPConnection* connectionsList;
+  size_t connectionsCount;
+  size_t assignedConnectionsCount;                              // Only changed on open/close calls, for load balancing
+  size_t pausedConnectionsCount;                                // Connections not being read until their read queues have room
+  #ifdef IP_EVENTS_EPOLL
+  int eventsPollerFD;
+  #ifdef IP_EVENTS_RING
+  EventsRing eventsRing;                                        // Used instead of the events poller, if supported by the kernel
+  #endif
+  #else
+  SocketPoller** polledSocketsList;                             // Registered sockets, checked one by one after each wait
+  size_t polledSocketsNumber;
+  #endif
+  #ifdef IP_EVENTS_POLL
+  struct pollfd* pollRequestsList;
+  #endif
+  #ifndef WIN32
+  int writeEventFDs[ 2 ];                                       // Wake up notification (eventfd uses the same descriptor for both ends)
+  #endif
+  SocketPoller* writeEventPoller;
+  atomic_bool isWriteEventPending;                              // Avoids signaling again before the reactor resumes
+  DatagramsBatch datagramsBatch;
+  uint64_t lastKeepalivesTime;
+};
+
 // Generic structure to store methods and data of any connection type handled by the library
 struct _IPConnectionData
 {
   SocketPoller* socket;
-  void (*ref_ReceiveMessage)( IPConnection );
-  void (*ref_SendMessage)( IPConnection, const uint8_t* );
+  void (*ref_ReceiveMessage)( IPConnection, SocketPoller* );
+  void (*ref_SendMessages)( IPConnection, Message*, size_t );
   void (*ref_Close)( IPConnection );
   IPAddressData addressData;
   union {
-    SocketPoller** clientsList;
+    TCPClient* clientsList;
     IPAddressData* addressesList;
   };
   size_t remotesCount;
-  TSQueue readQueue;
-  TSQueue writeQueue;
+  uint64_t lastPeerID;                                          // Remotes of server connections get increasing identifiers (0 is for all of them)
+  uint64_t* peerIDsList;                                        // Identifier of each UDP server remote (address hash on the upper 32 bits)
+  uint64_t* peerTimesList;                                      // Last reception time of each UDP server remote (same order as addressesList)
+  uint32_t* peersTable;                                         // Open addressing index of addressesList positions (+1, 0 for empty slots)
+  size_t peersTableSize;                                        // Power of 2, at least twice the remotes count (also the lists capacity)
+  uint64_t lastPeersCheckTime;
+  uint64_t lastSendTime;                                        // Only used by UDP client connections, to send keepalives when idle
+  StreamBufferData inputBuffer;                                 // Only used by TCP client connections
+  StreamOutputData outputBuffer;
+  size_t frameHeaderLength;                                     // Length prefix of stream messages (0 for local sequenced packets)
+  atomic_uint_fast64_t receiveCallsCount;                       // Receive system calls that returned data
+  atomic_uint_fast64_t messagesReceivedCount;
+  atomic_uint_fast64_t largestReceiveBatch;                     // Most messages delivered by a single receive call
+  MessageRing readQueue;                                        // Filled by the reactor thread, consumed by the application
+  MessageRing writeQueue;                                       // Shared by any application thread, consumed by the reactor thread
+  uint8_t queuePolicy;                                          // Handling of messages that don't fit on full queues
+  size_t outputBufferSize;                                      // Limit of bytes pending on each TCP stream
+  atomic_uint_fast64_t readDropsCount;
+  atomic_uint_fast64_t writeDropsCount;
+  Message* pendingMessagesList;                                 // Received messages waiting for room on a full read queue
+  size_t pendingMessagesCount;
+  atomic_bool isReadPaused;                                     // Sockets are not polled while messages are pending
+  Reactor reactor;                                              // Thread that services all sockets of this connection
+  bool isClosing;                                               // Set (under reactor lock) to have the reactor release the connection
+  StatsCountersData stats;
 };
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 /////                                        GLOBAL VARIABLES                                         /////
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-// Thread for asyncronous connections update
-static Thread globalReadThread = THREAD_INVALID_HANDLE;
-static Thread globalWriteThread = THREAD_INVALID_HANDLE;
-static volatile bool isNetworkRunning = false;
+// Threads for asyncronous connections update, started with the first connection
+static Reactor reactorsList = NULL;
+static size_t reactorsCount = IP_REACTORS_COUNT;
+
+// Notification of new messages on any read queue, for threads waiting on multiple connections
+static atomic_uint_fast64_t receiveEventsCount = 0;
+static atomic_int receiveEventWaitersCount = 0;                // Condition is only signaled if someone is waiting on it
+static pthread_mutex_t receiveEventLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t receiveEventCondition = PTHREAD_COND_INITIALIZER;
 
-static IPConnection* globalConnectionsList = NULL;
+static pthread_mutex_t connectionsLock = PTHREAD_MUTEX_INITIALIZER;  // Serializes opening and closing of connections
 static int activeConnectionsCount = 0;
 
-#ifdef IP_NETWORK_LEGACY
-static fd_set polledSocketsSet = { 0 };
-static fd_set activeSocketsSet = { 0 };
-#else
-static SocketPoller polledSocketsList[ 1024 ] = { 0 };
-#endif
-static size_t polledSocketsNumber = 0;
+// Free message buffers of each size class, shared by all threads (created with the reactors)
+static MessageRing messagePoolsList[ MESSAGE_POOL_MAX_CLASSES ];
+static size_t messagePoolsCount = 0;
 
 /////////////////////////////////////////////////////////////////////////////
 /////                        FORWARD DECLARATIONS                       /////
 /////////////////////////////////////////////////////////////////////////////
 
 
-static void ReceiveTCPClientMessage( IPConnection );
-static void ReceiveUDPClientMessage( IPConnection );
-static void ReceiveTCPServerMessages( IPConnection );
-static void ReceiveUDPServerMessages( IPConnection );
-static void SendTCPClientMessage( IPConnection, const uint8_t* );
-static void SendUDPClientMessage( IPConnection, const uint8_t* );
-static void SendTCPServerMessages( IPConnection, const uint8_t* );
-static void SendUDPServerMessages( IPConnection, const uint8_t* );
+static void ReceiveTCPClientMessage( IPConnection, SocketPoller* );
+static void ReceiveUDPClientMessage( IPConnection, SocketPoller* );
+static void ReceiveTCPServerMessages( IPConnection, SocketPoller* );
+static void ReceiveUDPServerMessages( IPConnection, SocketPoller* );
+static void SendTCPClientMessages( IPConnection, Message*, size_t );
+static void SendUDPClientMessages( IPConnection, Message*, size_t );
+static void SendTCPServerMessages( IPConnection, Message*, size_t );
+static void SendUDPServerMessages( IPConnection, Message*, size_t );
+static bool FlushTCPClientOutput( IPConnection, TCPClient );
+static void ExpireUDPPeers( IPConnection, uint64_t );
+static uint64_t UpdateUDPPeer( IPConnection, IPAddress, uint64_t );
+static IPAddressData* FindUDPPeerAddress( IPConnection, uint64_t );
 static void CloseTCPServer( IPConnection );
 static void CloseUDPServer( IPConnection );
 static void CloseTCPClient( IPConnection );
 static void CloseUDPClient( IPConnection );
 
-static void* AsyncReadQueues( void* );
-static void* AsyncWriteQueues( void* );
+static void* AsyncUpdateReactor( void* );
+static void SignalWriteEvent( Reactor );
+static void SignalReceiveEvent( void );
+#ifdef IP_EVENTS_RING
+static size_t WaitRingEvents( Reactor, SocketPoller**, unsigned long, bool* );
+#endif
+
 
+// Local socket addresses are directory paths with an explicit prefix, so that plain paths keep naming shared memory directories
+bool IP_IsLocalAddress( const char* addressString )
+{
+  #ifdef IP_LOCAL_SOCKETS
+  if( addressString == NULL ) return false;
+  return ( strncmp( addressString, LOCAL_ADDRESS_PREFIX, strlen( LOCAL_ADDRESS_PREFIX ) ) == 0 );
+  #else
+  (void) addressString;
+  return false;
+  #endif
+}
 
 bool IP_IsValidAddress( const char* addressString )
 {
   if( addressString == NULL ) return true;
+  if( IP_IsLocalAddress( addressString ) ) return true;
   #ifndef IP_NETWORK_LEGACY
   struct sockaddr_in ipv4Address;
   if( inet_pton( AF_INET, addressString, &ipv4Address ) == 1 ) return true;
@@ -184,690 +521,2518 @@ bool IP_IsValidAddress( const char* addressString )
   return false;
 }
 
+bool IP_SetReactorsCount( size_t threadsCount )
+{
+  if( threadsCount == 0 ) return false;
+  
+  pthread_mutex_lock( &connectionsLock );
+  // Connections are pinned to their reactors, so the pool can't be resized while any of them is open
+  bool isIdle = ( activeConnectionsCount == 0 );
+  if( isIdle ) reactorsCount = threadsCount;
+  pthread_mutex_unlock( &connectionsLock );
+  
+  if( !isIdle ) fprintf( stderr, "%s: can't change number of network threads with open connections\n", __func__ );
+  
+  return isIdle;
+}
+
 //////////////////////////////////////////////////////////////////////////////////
-/////                             INITIALIZATION                             /////
+/////                             MESSAGE QUEUES                             /////
 //////////////////////////////////////////////////////////////////////////////////
 
-#ifndef IP_NETWORK_LEGACY
-static int CompareSockets( const void* ref_socket_1, const void* ref_socket_2 )
+static MessageRing CreateMessageRing( size_t capacity, bool isShared )
 {
-  return ( ((SocketPoller*) ref_socket_1)->fd - ((SocketPoller*) ref_socket_2)->fd );
+  size_t ringSize = sizeof(MessageRingData) + capacity * sizeof(MessageSlotData);
+  ringSize = ( ( ringSize + CACHE_LINE_SIZE - 1 ) / CACHE_LINE_SIZE ) * CACHE_LINE_SIZE;
+  MessageRing ring = (MessageRing) aligned_alloc( CACHE_LINE_SIZE, ringSize );
+  memset( ring, 0, ringSize );
+  
+  ring->capacity = capacity;
+  ring->isShared = isShared;
+  for( size_t slotIndex = 0; slotIndex < capacity; slotIndex++ )
+    atomic_store_explicit( &(ring->slotsList[ slotIndex ].sequence), slotIndex, memory_order_relaxed );
+  
+  return ring;
 }
-#endif
 
-static SocketPoller* AddSocketPoller( Socket socketFD )
+static void ReleaseMessage( Message );
+
+// Deallocate given ring, releasing all messages still stored on it
+static void DiscardMessageRing( MessageRing ring )
 {
-  #ifndef IP_NETWORK_LEGACY
-  SocketPoller cmpPoller = { .fd = socketFD };
-  SocketPoller* socketPoller = (SocketPoller*) bsearch( &cmpPoller, polledSocketsList, polledSocketsNumber, sizeof(SocketPoller), CompareSockets );
-  if( socketPoller == NULL )
-  {
-    socketPoller = &(polledSocketsList[ polledSocketsNumber ]);
-    socketPoller->fd = socketFD;
-    socketPoller->events = POLLIN | POLLHUP;
-    polledSocketsNumber++;
-    qsort( polledSocketsList, polledSocketsNumber, sizeof(SocketPoller), CompareSockets );
-  }
-  #else
-  SocketPoller* socketPoller = (SocketPoller*) malloc( sizeof(SocketPoller) );
-  FD_SET( socketFD, &polledSocketsSet );
-  if( socketFD >= polledSocketsNumber ) polledSocketsNumber = socketFD + 1;
-  socketPoller->fd = socketFD;
-  #endif
-  return socketPoller;
+  size_t head = atomic_load( &(ring->head) );
+  for( size_t position = atomic_load( &(ring->tail) ); position < head; position++ )
+    ReleaseMessage( ring->slotsList[ position % ring->capacity ].message );
+  free( ring );
 }
 
-// Handle construction of a IPConnection structure with the defined properties
-static IPConnection AddConnection( Socket socketFD, IPAddress address, uint8_t transportProtocol, uint8_t networkRole )
+// Append message to a shared ring: writers compete for the head position, then fill their slots independently
+static bool PushSharedMessage( MessageRing ring, Message message )
 {
-  IPConnection connection = (IPConnection) malloc( sizeof(IPConnectionData) );
-  memset( connection, 0, sizeof(IPConnectionData) );
-  
-  connection->socket = AddSocketPoller( socketFD );
-  
-  memcpy( &(connection->addressData), address, sizeof(IPAddressData) );
-  
-  connection->clientsList = NULL;
-  connection->remotesCount = 0;
-  
-  connection->readQueue = TSQ_Create( QUEUE_MAX_ITEMS, IP_MAX_MESSAGE_LENGTH );
-  connection->writeQueue = TSQ_Create( QUEUE_MAX_ITEMS, IP_MAX_MESSAGE_LENGTH );
-  
-  if( networkRole == IP_SERVER ) // Server role connection
+  size_t head = atomic_load_explicit( &(ring->head), memory_order_relaxed );
+  while( true )
   {
-    connection->ref_ReceiveMessage = ( transportProtocol == IP_TCP ) ? ReceiveTCPServerMessages : ReceiveUDPServerMessages;
-    connection->ref_SendMessage = ( transportProtocol == IP_TCP ) ? SendTCPServerMessages : SendUDPServerMessages;
-    if( transportProtocol == IP_UDP && IS_IP_MULTICAST_ADDRESS( address ) ) connection->ref_SendMessage = SendUDPClientMessage;
-    connection->ref_Close = ( transportProtocol == IP_TCP ) ? CloseTCPServer : CloseUDPServer;
-  }
-  else
-  { 
-    //connection->address->sin6_family = AF_INET6;
-    connection->ref_ReceiveMessage = ( transportProtocol == IP_TCP ) ? ReceiveTCPClientMessage : ReceiveUDPClientMessage;
-    connection->ref_SendMessage = ( transportProtocol == IP_TCP ) ? SendTCPClientMessage : SendUDPClientMessage;
-    connection->ref_Close = ( transportProtocol == IP_TCP ) ? CloseTCPClient : CloseUDPClient;
+    MessageSlotData* slot = &(ring->slotsList[ head % ring->capacity ]);
+    intptr_t positionsAhead = (intptr_t) atomic_load_explicit( &(slot->sequence), memory_order_acquire ) - (intptr_t) head;
+    if( positionsAhead == 0 )
+    {
+      if( atomic_compare_exchange_weak_explicit( &(ring->head), &head, head + 1, memory_order_relaxed, memory_order_relaxed ) ) break;
+    }
+    else if( positionsAhead < 0 ) return false; // Ring full: slot from previous lap not read yet
+    else head = atomic_load_explicit( &(ring->head), memory_order_relaxed );
   }
   
-  return connection;
+  MessageSlotData* slot = &(ring->slotsList[ head % ring->capacity ]);
+  slot->message = message;
+  atomic_store_explicit( &(slot->sequence), head + 1, memory_order_release );
+  
+  return true;
 }
 
-IPAddress LoadAddressInfo( const char* host, const char* port, uint8_t networkRole )
+// Remove oldest message from a shared ring: readers compete for filled slots at the tail position
+static Message PopSharedMessage( MessageRing ring )
 {
-  static IPAddressData addressData;
-  
-  #ifdef WIN32
-  static WSADATA wsa;
-  if( wsa.wVersion == 0 )
+  size_t tail = atomic_load_explicit( &(ring->tail), memory_order_relaxed );
+  while( true )
   {
-    if( WSAStartup( MAKEWORD( 2, 2 ), &wsa ) != 0 )
+    MessageSlotData* slot = &(ring->slotsList[ tail % ring->capacity ]);
+    intptr_t positionsAhead = (intptr_t) atomic_load_explicit( &(slot->sequence), memory_order_acquire ) - (intptr_t) ( tail + 1 );
+    if( positionsAhead == 0 )
     {
-      fprintf( stderr, "%s: error initialiasing windows sockets: code: %d\n", __func__, WSAGetLastError() );
-      return NULL;
+      if( atomic_compare_exchange_weak_explicit( &(ring->tail), &tail, tail + 1, memory_order_relaxed, memory_order_relaxed ) ) break;
     }
-    
-    fprintf( stderr, "%s: initialiasing windows sockets version: %d\n", __func__, wsa.wVersion );
+    else if( positionsAhead < 0 ) return NULL; // Oldest slot not filled yet
+    else tail = atomic_load_explicit( &(ring->tail), memory_order_relaxed );
   }
-  #endif
   
-  #ifndef IP_NETWORK_LEGACY
-  struct addrinfo hints = { .ai_family = AF_UNSPEC }; // IPv6 (AF_INET6) or IPv4 (AF_INET) address
-  struct addrinfo* hostsInfoList;
-  struct addrinfo* hostInfo = NULL;
-                        
-  if( host == NULL )
-  {
-    if( networkRole == IP_SERVER )
-    {
-      hints.ai_flags |= AI_PASSIVE;                   // Set address for me
-      hints.ai_family = AF_INET6;                     // IPv6 address
-    }
-    else // if( networkRole == IP_CLIENT )
-      return NULL;
-  }
+  MessageSlotData* slot = &(ring->slotsList[ tail % ring->capacity ]);
+  Message message = slot->message;
+  // Free slot for the writer that reaches this position on the next lap
+  atomic_store_explicit( &(slot->sequence), tail + ring->capacity, memory_order_release );
   
-  int errorCode = 0;
-  if( (errorCode = getaddrinfo( host, port, &hints, &hostsInfoList )) != 0 )
+  return message;
+}
+
+// Append message to given ring. Returns false if the ring is full
+static bool PushMessage( MessageRing ring, Message message )
+{
+  if( ring->isShared ) return PushSharedMessage( ring, message );
+  
+  size_t head = atomic_load_explicit( &(ring->head), memory_order_relaxed );
+  if( head - ring->cachedTail >= ring->capacity )
   {
-    fprintf( stderr, "getaddrinfo: error reading host info: %s\n", gai_strerror( errorCode ) );
-    return NULL;
+    ring->cachedTail = atomic_load_explicit( &(ring->tail), memory_order_acquire );
+    if( head - ring->cachedTail >= ring->capacity ) return false;
   }
   
-  memcpy( &addressData, hostInfo->ai_addr, hostInfo->ai_addrlen );
+  ring->slotsList[ head % ring->capacity ].message = message;
+  atomic_store_explicit( &(ring->head), head + 1, memory_order_release );
   
-  freeaddrinfo( hostsInfoList ); // Don't need this struct anymore
+  return true;
+}
+
+// Remove oldest message from given ring. Returns NULL if the ring is empty
+static Message PopMessage( MessageRing ring )
+{
+  if( ring->isShared ) return PopSharedMessage( ring );
   
-  if( hostInfo == NULL ) return (IPAddress) NULL;
-  #else
-  addressData.sin_family = AF_INET;   // IPv4 address
-  uint16_t portNumber = ( port != NULL ) ? (uint16_t) strtoul( port, NULL, 0 ) : 0;
-  addressData.sin_port = htons( portNumber );
-  if( host == NULL ) addressData.sin_addr.s_addr = INADDR_ANY;
-  else if( strcmp( host, "255.255.255.255" ) == 0 ) addressData.sin_addr.s_addr = INADDR_BROADCAST; 
-  else if ( (addressData.sin_addr.s_addr = inet_addr( host )) == INADDR_NONE ) return NULL;
-  #endif
+  size_t tail = atomic_load_explicit( &(ring->tail), memory_order_relaxed );
+  if( tail == ring->cachedHead )
+  {
+    ring->cachedHead = atomic_load_explicit( &(ring->head), memory_order_acquire );
+    if( tail == ring->cachedHead ) return NULL;
+  }
   
-  return (IPAddress) &addressData;
+  Message message = ring->slotsList[ tail % ring->capacity ].message;
+  atomic_store_explicit( &(ring->tail), tail + 1, memory_order_release );
+  
+  return message;
 }
 
-int CreateSocket( uint8_t protocol, IPAddress address )
+// Number of stored messages (including the ones still being written to shared rings)
+static size_t GetRingMessagesCount( MessageRing ring )
 {
-  int socketType, transportProtocol;
+  size_t tail = atomic_load_explicit( &(ring->tail), memory_order_acquire );
+  size_t head = atomic_load_explicit( &(ring->head), memory_order_acquire );
+  return ( head > tail ) ? head - tail : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+/////                            MESSAGE BUFFERS                             /////
+//////////////////////////////////////////////////////////////////////////////////
+
+// Size classes go from MESSAGE_POOL_MIN_LENGTH up to the first one that fits the largest message
+static void CreateMessagePools( void )
+{
+  messagePoolsCount = 1;
+  while( ( (size_t) MESSAGE_POOL_MIN_LENGTH << ( messagePoolsCount - 1 ) ) < IP_MAX_MESSAGE_LENGTH && messagePoolsCount < MESSAGE_POOL_MAX_CLASSES ) 
+    messagePoolsCount++;
   
-  if( protocol == IP_TCP ) 
+  for( size_t classIndex = 0; classIndex < messagePoolsCount; classIndex++ )
   {
-    socketType = SOCK_STREAM;
-    transportProtocol = IPPROTO_TCP;
+    size_t buffersCount = MESSAGE_POOL_CLASS_SIZE / ( (size_t) MESSAGE_POOL_MIN_LENGTH << classIndex );
+    messagePoolsList[ classIndex ] = CreateMessageRing( ( buffersCount > MESSAGE_POOL_MIN_COUNT ) ? buffersCount : MESSAGE_POOL_MIN_COUNT, true );
   }
-  else if( protocol == IP_UDP ) 
+}
+
+// Deallocate pools and their buffers (only called after all messages were released)
+static void DiscardMessagePools( void )
+{
+  for( size_t classIndex = 0; classIndex < messagePoolsCount; classIndex++ )
   {
-    socketType = SOCK_DGRAM;
-    transportProtocol = IPPROTO_UDP;
+    Message message;
+    while( (message = PopMessage( messagePoolsList[ classIndex ] )) != NULL )
+      free( message );
+    free( messagePoolsList[ classIndex ] );
   }
-  else
+  messagePoolsCount = 0;
+}
+
+static size_t GetMessageSizeClass( size_t length )
+{
+  size_t classIndex = 0;
+  while( ( (size_t) MESSAGE_POOL_MIN_LENGTH << classIndex ) < length ) classIndex++;
+  return classIndex;
+}
+
+// Get buffer for a message with the given length (not filled), reusing a free one from its size class if available.
+// The caller holds the only reference to it
+static Message AllocateMessage( size_t length )
+{
+  size_t classIndex = GetMessageSizeClass( length );
+  Message message = PopMessage( messagePoolsList[ classIndex ] );
+  if( message == NULL ) 
   {
-    return INVALID_SOCKET;
+    message = (Message) malloc( sizeof(MessageData) + ( (size_t) MESSAGE_POOL_MIN_LENGTH << classIndex ) );
+    message->sizeClass = (uint8_t) classIndex;
   }
+  atomic_store_explicit( &(message->referencesCount), 1, memory_order_relaxed );
+  message->queueTime = Stats_GetTimeNS();
+  message->peerID = 0;
+  message->length = length;
+  return message;
+}
 
-  // Create IP socket
-  int socketFD = socket( address->sa_family, socketType, transportProtocol );
-  if( socketFD == INVALID_SOCKET )
-    fprintf( stderr, "socket: failed opening %s %s socket\n", ( protocol == IP_TCP ) ? "TCP" : "UDP", ( address->sa_family == AF_INET6 ) ? "IPv6" : "IPv4" );                                                              
-  
-  return socketFD;
+// Add reference for another holder of the given message (e.g. each destination of a fan-out)
+static inline Message RetainMessage( Message message )
+{
+  atomic_fetch_add_explicit( &(message->referencesCount), 1, memory_order_relaxed );
+  return message;
 }
 
-bool SetSocketConfig( int socketFD )
+// Drop a reference to the given message, returning its buffer to the pool after the last one
+static void ReleaseMessage( Message message )
 {
-  #ifdef WIN32
-  u_long nonBlocking = 1;
-  if( ioctlsocket( socketFD, FIONBIO, &nonBlocking ) == SOCKET_ERROR )
-  #else
-  if( fcntl( socketFD, F_SETFL, O_NONBLOCK ) == SOCKET_ERROR )
-  #endif
+  if( message == NULL ) return;
+  if( atomic_fetch_sub_explicit( &(message->referencesCount), 1, memory_order_acq_rel ) > 1 ) return;
+  if( !PushMessage( messagePoolsList[ message->sizeClass ], message ) ) free( message );
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+/////                             INITIALIZATION                             /////
+//////////////////////////////////////////////////////////////////////////////////
+
+// Only sockets of connections with room on their read queues are waited for
+static inline bool IsSocketPaused( SocketPoller* socket )
+{
+  return ( socket->connection != NULL && atomic_load_explicit( &(socket->connection->isReadPaused), memory_order_relaxed ) );
+}
+
+#ifdef IP_EVENTS_RING
+// Release kernel shared queues and buffers of the given ring (possibly partially created)
+static void DiscardEventsRing( EventsRing ring )
+{
+  if( ring->queuesMap != NULL && ring->queuesMap != MAP_FAILED ) munmap( ring->queuesMap, ring->queuesMapSize );
+  if( ring->submissionsList != NULL && ring->submissionsList != MAP_FAILED ) munmap( ring->submissionsList, ring->submissionsCount * sizeof(struct io_uring_sqe) );
+  if( ring->buffersRing != NULL && ring->buffersRing != MAP_FAILED ) munmap( ring->buffersRing, RING_BUFFERS_COUNT * sizeof(struct io_uring_buf) );
+  close( ring->fd );
+  free( ring->buffersData );
+  free( ring->slotsList );
+  free( ring->freeSlotsList );
+  free( ring->overflowList );
+  free( ring );
+}
+
+// Hand given receive buffer (back) to the kernel. Only the reactor thread (or its creator, before starting it) adds buffers
+static void RecycleRingBuffer( EventsRing ring, uint16_t bufferID )
+{
+  atomic_ushort* bufferTail = (atomic_ushort*) &(ring->buffersRing->tail);
+  uint16_t position = atomic_load_explicit( bufferTail, memory_order_relaxed );
+  struct io_uring_buf* buffer = &(ring->buffersRing->bufs[ position & ( RING_BUFFERS_COUNT - 1 ) ]);
+  buffer->addr = (uint64_t) (uintptr_t) ( ring->buffersData + bufferID * RING_BUFFER_LENGTH );
+  buffer->len = RING_BUFFER_LENGTH;
+  buffer->bid = bufferID;
+  atomic_store_explicit( bufferTail, position + 1, memory_order_release );
+}
+
+// Create io_uring instance with its receive buffers, or NULL if the running kernel can't provide every needed feature.
+// It's created disabled, so that the reactor thread enables it as its only submitter
+static EventsRing CreateEventsRing( void )
+{
+  struct io_uring_params parameters = { .flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED |
+                                                 IORING_SETUP_SUBMIT_ALL | IORING_SETUP_CQSIZE, .cq_entries = 4 * RING_QUEUE_LENGTH };
+  int ringFD = (int) syscall( __NR_io_uring_setup, RING_QUEUE_LENGTH, &parameters );
+  if( ringFD == SOCKET_ERROR )
   {
-    fprintf( stderr, "failure setting socket %d to non-blocking state\n", socketFD );
-    close( socketFD );
-    return false;
+    fprintf( stderr, "io_uring_setup: not supported (%s), using epoll\n", strerror( errno ) );
+    return NULL;
   }
   
-  int reuseAddress = 1; // Allow sockets to be binded to the same local port
-  if( setsockopt( socketFD, SOL_SOCKET, SO_REUSEADDR, (const char*) &reuseAddress, sizeof(reuseAddress) ) == SOCKET_ERROR ) 
+  EventsRing ring = (EventsRing) calloc( 1, sizeof(EventsRingData) );
+  ring->fd = ringFD;
+  
+  size_t submissionQueueSize = parameters.sq_off.array + parameters.sq_entries * sizeof(uint32_t);
+  size_t completionQueueSize = parameters.cq_off.cqes + parameters.cq_entries * sizeof(struct io_uring_cqe);
+  ring->queuesMapSize = ( submissionQueueSize > completionQueueSize ) ? submissionQueueSize : completionQueueSize;
+  ring->queuesMap = mmap( NULL, ring->queuesMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFD, IORING_OFF_SQ_RING );
+  ring->submissionsCount = parameters.sq_entries;
+  ring->submissionsList = mmap( NULL, ring->submissionsCount * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFD, IORING_OFF_SQES );
+  // Buffers ring has to be page aligned
+  ring->buffersRing = mmap( NULL, RING_BUFFERS_COUNT * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+  if( !( parameters.features & IORING_FEAT_SINGLE_MMAP ) || ring->queuesMap == MAP_FAILED || ring->submissionsList == MAP_FAILED || ring->buffersRing == MAP_FAILED )
   {
-    fprintf( stderr, "setsockopt: failed setting socket %d option SO_REUSEADDR\n", socketFD );
-    close( socketFD );
+    fprintf( stderr, "%s: failed mapping io_uring queues, using epoll\n", __func__ );
+    DiscardEventsRing( ring );
     return NULL;
   }
   
+  uint8_t* queuesData = (uint8_t*) ring->queuesMap;
+  ring->submissionHead = (atomic_uint*) ( queuesData + parameters.sq_off.head );
+  ring->submissionTail = (atomic_uint*) ( queuesData + parameters.sq_off.tail );
+  ring->submissionMask = *((uint32_t*) ( queuesData + parameters.sq_off.ring_mask ));
+  ring->completionsList = (struct io_uring_cqe*) ( queuesData + parameters.cq_off.cqes );
+  ring->completionHead = (atomic_uint*) ( queuesData + parameters.cq_off.head );
+  ring->completionTail = (atomic_uint*) ( queuesData + parameters.cq_off.tail );
+  ring->completionMask = *((uint32_t*) ( queuesData + parameters.cq_off.ring_mask ));
+  // Submission entries are always used in order
+  uint32_t* submissionIndexesList = (uint32_t*) ( queuesData + parameters.sq_off.array );
+  for( uint32_t submissionIndex = 0; submissionIndex < parameters.sq_entries; submissionIndex++ )
+    submissionIndexesList[ submissionIndex ] = submissionIndex;
+  
+  struct io_uring_buf_reg buffersRegistration = { .ring_addr = (uint64_t) (uintptr_t) ring->buffersRing, .ring_entries = RING_BUFFERS_COUNT, .bgid = RING_BUFFERS_GROUP };
+  if( syscall( __NR_io_uring_register, ringFD, IORING_REGISTER_PBUF_RING, &buffersRegistration, 1 ) == SOCKET_ERROR )
+  {
+    fprintf( stderr, "io_uring_register: failed registering receive buffers (%s), using epoll\n", strerror( errno ) );
+    DiscardEventsRing( ring );
+    return NULL;
+  }
+  ring->buffersData = (uint8_t*) malloc( RING_BUFFERS_COUNT * RING_BUFFER_LENGTH );
+  for( uint16_t bufferID = 0; bufferID < RING_BUFFERS_COUNT; bufferID++ )
+    RecycleRingBuffer( ring, bufferID );
+  
+  ring->datagramHeader.msg_namelen = sizeof(IPAddressData);
+  
+  return ring;
+}
+
+// Rings are set up with a single issuer: the reactor thread that enabled it
+static inline bool IsRingSubmitter( EventsRing ring )
+{
+  return ( ring->isEnabled && pthread_equal( pthread_self(), ring->submitterThread ) );
+}
+
+static inline bool IsRingQueueFull( EventsRing ring )
+{
+  return ( atomic_load_explicit( ring->submissionTail, memory_order_relaxed ) - atomic_load_explicit( ring->submissionHead, memory_order_acquire ) >= ring->submissionsCount );
+}
+
+// Submit all queued requests (only from the reactor thread)
+static void SubmitRingRequests( EventsRing ring )
+{
+  uint32_t submissionsCount = atomic_load_explicit( ring->submissionTail, memory_order_relaxed ) - atomic_load_explicit( ring->submissionHead, memory_order_acquire );
+  if( submissionsCount > 0 && syscall( __NR_io_uring_enter, ring->fd, submissionsCount, 0, 0, NULL, 0 ) == SOCKET_ERROR )
+    fprintf( stderr, "io_uring_enter: failed submitting requests: %s\n", strerror( errno ) );
+}
+
+// Move requests kept on the overflow list to the submission queue, submitting it whenever it gets full (only from the reactor thread)
+static void FlushRingOverflow( EventsRing ring )
+{
+  size_t overflowIndex = 0;
+  while( true )
+  {
+    if( IsRingQueueFull( ring ) ) SubmitRingRequests( ring );
+    if( IsRingQueueFull( ring ) || overflowIndex == ring->overflowCount ) break;
+    uint32_t tail = atomic_load_explicit( ring->submissionTail, memory_order_relaxed );
+    ring->submissionsList[ tail & ring->submissionMask ] = ring->overflowList[ overflowIndex++ ];
+    atomic_store_explicit( ring->submissionTail, tail + 1, memory_order_release );
+  }
+  
+  ring->overflowCount -= overflowIndex;
+  if( ring->overflowCount > 0 ) memmove( ring->overflowList, ring->overflowList + overflowIndex, ring->overflowCount * sizeof(struct io_uring_sqe) );
+}
+
+// Get next (cleared) submission entry, to be queued with QueueRingSubmission(). Requests queued by other threads (under
+// the reactor lock) are submitted by the reactor on its next wait. Only the reactor can flush a full queue, so other threads
+// keep their requests on the overflow list meanwhile (in order), and the reactor moves them to the queue before waiting
+static struct io_uring_sqe* GetRingSubmission( EventsRing ring )
+{
+  if( IsRingSubmitter( ring ) && ( ring->overflowCount > 0 || IsRingQueueFull( ring ) ) ) FlushRingOverflow( ring );
+  
+  struct io_uring_sqe* submission;
+  ring->isOverflowing = ( ring->overflowCount > 0 || IsRingQueueFull( ring ) );
+  if( ring->isOverflowing )
+  {
+    ring->overflowList = (struct io_uring_sqe*) realloc( ring->overflowList, ( ring->overflowCount + 1 ) * sizeof(struct io_uring_sqe) );
+    submission = &(ring->overflowList[ ring->overflowCount ]);
+  }
+  else
+  {
+    uint32_t tail = atomic_load_explicit( ring->submissionTail, memory_order_relaxed );
+    submission = &(ring->submissionsList[ tail & ring->submissionMask ]);
+  }
+  
+  memset( submission, 0, sizeof(struct io_uring_sqe) );
+  return submission;
+}
+
+static inline void QueueRingSubmission( EventsRing ring )
+{
+  if( ring->isOverflowing ) ring->overflowCount++;
+  else atomic_store_explicit( ring->submissionTail, atomic_load_explicit( ring->submissionTail, memory_order_relaxed ) + 1, memory_order_release );
+}
+
+// Requests carry the generation and slot of their socket, along with their type
+static inline uint64_t GetRingRequestID( EventsRing ring, SocketPoller* socket, uint8_t requestType )
+{
+  return ( (uint64_t) ring->slotsList[ socket->ringSlot ].generation << 32 ) | ( (uint64_t) socket->ringSlot << 3 ) | requestType;
+}
+
+// Get socket of the given request, or NULL if it was removed meanwhile (or the request was a cancelation)
+static SocketPoller* GetRingRequestSocket( EventsRing ring, uint64_t requestID )
+{
+  size_t slotIndex = (size_t) ( ( requestID & 0xFFFFFFFF ) >> 3 );
+  if( ( requestID & 0x07 ) == RING_CANCEL || slotIndex >= ring->slotsCount ) return NULL;
+  if( ring->slotsList[ slotIndex ].generation != (uint32_t) ( requestID >> 32 ) ) return NULL;
+  return ring->slotsList[ slotIndex ].socket;
+}
+
+// Start receiving from the given socket with a single multishot request: new connections for listening sockets, data read
+// directly into provided buffers for stream and datagram ones, and readiness for the wake up notification
+static void SubmitRingRead( EventsRing ring, SocketPoller* socket )
+{
+  struct io_uring_sqe* submission = GetRingSubmission( ring );
+  
+  IPConnection connection = socket->connection;
+  submission->fd = socket->fd;
+  submission->user_data = GetRingRequestID( ring, socket, RING_READ );
+  if( connection == NULL )
+  {
+    submission->opcode = IORING_OP_POLL_ADD;
+    submission->poll32_events = POLLIN;
+    submission->len = IORING_POLL_ADD_MULTI;
+  }
+  else if( connection->ref_ReceiveMessage == ReceiveTCPServerMessages && socket->client == NULL )
+  {
+    submission->opcode = IORING_OP_ACCEPT;
+    submission->ioprio = IORING_ACCEPT_MULTISHOT;
+  }
+  else
+  {
+    bool isDatagram = ( connection->ref_ReceiveMessage == ReceiveUDPClientMessage || connection->ref_ReceiveMessage == ReceiveUDPServerMessages );
+    submission->opcode = isDatagram ? IORING_OP_RECVMSG : IORING_OP_RECV;
+    if( isDatagram ) submission->addr = (uint64_t) (uintptr_t) &(ring->datagramHeader);
+    submission->ioprio = IORING_RECV_MULTISHOT;
+    submission->flags = IOSQE_BUFFER_SELECT;
+    submission->buf_group = RING_BUFFERS_GROUP;
+  }
+  QueueRingSubmission( ring );
+  socket->ringRequests |= RING_READ;
+}
+
+// Wait for the given socket to become writable (single shot)
+static void SubmitRingWrite( EventsRing ring, SocketPoller* socket )
+{
+  struct io_uring_sqe* submission = GetRingSubmission( ring );
+  
+  submission->opcode = IORING_OP_POLL_ADD;
+  submission->fd = socket->fd;
+  submission->poll32_events = POLLOUT;
+  submission->user_data = GetRingRequestID( ring, socket, RING_WRITE );
+  QueueRingSubmission( ring );
+  socket->ringRequests |= RING_WRITE;
+}
+
+// Cancel the read request of given socket, which still reports completions already made until its last one
+static void CancelRingRead( EventsRing ring, SocketPoller* socket )
+{
+  struct io_uring_sqe* submission = GetRingSubmission( ring );
+  
+  submission->opcode = IORING_OP_ASYNC_CANCEL;
+  submission->fd = -1;
+  submission->addr = GetRingRequestID( ring, socket, RING_READ );
+  submission->user_data = RING_CANCEL;
+  QueueRingSubmission( ring );
+  socket->ringRequests |= RING_CANCEL;
+}
+
+// Give a ring slot to the given socket, and start reading from it unless its connection is paused
+static void AddRingSocket( EventsRing ring, SocketPoller* socket )
+{
+  if( ring->freeSlotsCount > 0 )
+  {
+    socket->ringSlot = ring->freeSlotsList[ --ring->freeSlotsCount ];
+  }
+  else
+  {
+    ring->slotsList = (RingSlotData*) realloc( ring->slotsList, ( ring->slotsCount + 1 ) * sizeof(RingSlotData) );
+    ring->freeSlotsList = (uint32_t*) realloc( ring->freeSlotsList, ( ring->slotsCount + 1 ) * sizeof(uint32_t) );
+    ring->slotsList[ ring->slotsCount ].generation = 0;
+    socket->ringSlot = (uint32_t) ring->slotsCount++;
+  }
+  ring->slotsList[ socket->ringSlot ].socket = socket;
+  socket->ringRequests = 0;
+  
+  if( !IsSocketPaused( socket ) ) SubmitRingRead( ring, socket );
+}
+
+// Cancel every request of the given socket before it's closed (so that the kernel releases it), and free its slot
+static void RemoveRingSocket( EventsRing ring, SocketPoller* socket )
+{
+  struct io_uring_sqe* submission = GetRingSubmission( ring );
+  submission->opcode = IORING_OP_ASYNC_CANCEL;
+  submission->fd = socket->fd;
+  submission->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+  submission->user_data = RING_CANCEL;
+  QueueRingSubmission( ring );
+  // Sockets are only closed by the reactor thread, right after this
+  if( IsRingSubmitter( ring ) )
+  {
+    FlushRingOverflow( ring );
+    SubmitRingRequests( ring );
+  }
+  
+  ring->slotsList[ socket->ringSlot ].socket = NULL;
+  ring->slotsList[ socket->ringSlot ].generation++;
+  ring->freeSlotsList[ ring->freeSlotsCount++ ] = socket->ringSlot;
+}
+
+// Keep read request only while the socket should be read, and wait for writability while it has pending output
+static void SetRingSocketEvents( EventsRing ring, SocketPoller* socket, bool isEnabled )
+{
+  // Read requests still being canceled are restarted when their last completion arrives
+  if( isEnabled && !( socket->ringRequests & RING_READ ) ) SubmitRingRead( ring, socket );
+  else if( !isEnabled && ( socket->ringRequests & RING_READ ) && !( socket->ringRequests & RING_CANCEL ) ) CancelRingRead( ring, socket );
+  if( socket->isWriting && !( socket->ringRequests & RING_WRITE ) ) SubmitRingWrite( ring, socket );
+}
+#endif
+
+// Register socket for reading events on the given reactor. Events are reported with the returned poller, so that
+// only the owner connection (and remote client) of each ready socket needs to be updated
+static SocketPoller* AddSocketPoller( Reactor reactor, Socket socketFD, IPConnection connection, TCPClient client )
+{
+  SocketPoller* socketPoller = (SocketPoller*) malloc( sizeof(SocketPoller) );
+  socketPoller->fd = socketFD;
+  socketPoller->connection = connection;
+  socketPoller->client = client;
+  socketPoller->isWriting = false;
+  
+  #ifdef IP_EVENTS_EPOLL
+  #ifdef IP_EVENTS_RING
+  if( reactor->eventsRing != NULL )
+  {
+    AddRingSocket( reactor->eventsRing, socketPoller );
+    return socketPoller;
+  }
+  #endif
+  socketPoller->polledEvents = EPOLLIN;
+  struct epoll_event socketEvent = { .events = EPOLLIN, .data.ptr = socketPoller };
+  if( epoll_ctl( reactor->eventsPollerFD, EPOLL_CTL_ADD, socketFD, &socketEvent ) == SOCKET_ERROR )
+    fprintf( stderr, "epoll_ctl: failed adding socket %d\n", socketFD );
+  #else
+  reactor->polledSocketsList = (SocketPoller**) realloc( reactor->polledSocketsList, ( reactor->polledSocketsNumber + 1 ) * sizeof(SocketPoller*) );
+  reactor->polledSocketsList[ reactor->polledSocketsNumber++ ] = socketPoller;
+  #endif
+  
+  return socketPoller;
+}
+
+// Stop (or restart) reporting reading events of given socket (writing events are kept while it has pending output)
+static void SetSocketEvents( Reactor reactor, SocketPoller* socket, bool isEnabled )
+{
+  if( socket->fd == INVALID_SOCKET ) return;
+  #ifdef IP_EVENTS_EPOLL
+  #ifdef IP_EVENTS_RING
+  if( reactor->eventsRing != NULL )
+  {
+    SetRingSocketEvents( reactor->eventsRing, socket, isEnabled );
+    return;
+  }
+  #endif
+  uint32_t events = ( isEnabled ? EPOLLIN : 0 ) | ( socket->isWriting ? EPOLLOUT : 0 );
+  if( events == socket->polledEvents ) return;
+  // Removing the socket also avoids hang up events, which are reported even with no requested events
+  int operation = ( events == 0 ) ? EPOLL_CTL_DEL : ( ( socket->polledEvents == 0 ) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD );
+  struct epoll_event socketEvent = { .events = events, .data.ptr = socket };
+  if( epoll_ctl( reactor->eventsPollerFD, operation, socket->fd, &socketEvent ) == SOCKET_ERROR )
+    fprintf( stderr, "epoll_ctl: failed updating socket %d\n", socket->fd );
+  socket->polledEvents = events;
+  #else
+  // Poll and select requests are rebuilt before each wait, skipping paused connections
+  (void) reactor;
+  (void) isEnabled;
+  #endif
+}
+
+// Stop (or restart) reporting reading events of all sockets of given connection
+static void SetConnectionEvents( IPConnection connection, bool isEnabled )
+{
+  SetSocketEvents( connection->reactor, connection->socket, isEnabled );
+  if( connection->ref_ReceiveMessage != ReceiveTCPServerMessages ) return;
+  for( size_t clientIndex = 0; clientIndex < connection->remotesCount; clientIndex++ )
+    SetSocketEvents( connection->reactor, connection->clientsList[ clientIndex ]->socket, isEnabled );
+}
+
+// Start (or stop) waiting for given socket to become writable, independently of its reading events
+static void SetSocketWriteEvents( SocketPoller* socket, bool isEnabled )
+{
+  if( socket->isWriting == isEnabled ) return;
+  socket->isWriting = isEnabled;
+  SetSocketEvents( socket->connection->reactor, socket, !IsSocketPaused( socket ) );
+}
+
+// Wait for sockets registered on the given reactor to become ready for reading, and store the corresponding pollers
+// on given list (telling if write queues should be checked). The reactor lock is released while waiting, so that
+// connections can be added or closed meanwhile
+static size_t WaitSocketEvents( Reactor reactor, SocketPoller** readyPollersList, unsigned long milliseconds, bool* ref_hasWriteEvent )
+{
+  size_t readyPollersNumber = 0;
+  
+  #if defined( IP_EVENTS_EPOLL )
+  #ifdef IP_EVENTS_RING
+  if( reactor->eventsRing != NULL ) return WaitRingEvents( reactor, readyPollersList, milliseconds, ref_hasWriteEvent );
+  #endif
+  struct epoll_event eventsList[ EVENTS_BATCH_LENGTH ];
+  pthread_mutex_unlock( &(reactor->lock) );
+  int eventsNumber = epoll_wait( reactor->eventsPollerFD, eventsList, EVENTS_BATCH_LENGTH, milliseconds );
+  int waitError = errno;
+  pthread_mutex_lock( &(reactor->lock) );
+  for( int eventIndex = 0; eventIndex < eventsNumber; eventIndex++ )
+    readyPollersList[ readyPollersNumber++ ] = (SocketPoller*) eventsList[ eventIndex ].data.ptr;
+  #elif defined( IP_EVENTS_POLL )
+  // Sockets are only removed by the reactor itself, so polled indexes remain valid after waiting
+  size_t pollRequestsNumber = reactor->polledSocketsNumber;
+  reactor->pollRequestsList = (struct pollfd*) realloc( reactor->pollRequestsList, ( pollRequestsNumber + 1 ) * sizeof(struct pollfd) );
+  struct pollfd* pollRequestsList = reactor->pollRequestsList;
+  for( size_t pollerIndex = 0; pollerIndex < pollRequestsNumber; pollerIndex++ )
+  {
+    SocketPoller* socket = reactor->polledSocketsList[ pollerIndex ];
+    short events = ( IsSocketPaused( socket ) ? 0 : POLLIN ) | ( socket->isWriting ? POLLOUT : 0 );
+    pollRequestsList[ pollerIndex ] = (struct pollfd) { .fd = ( events == 0 ) ? INVALID_SOCKET : socket->fd, .events = events };
+  }
+  pthread_mutex_unlock( &(reactor->lock) );
+  int eventsNumber = poll( pollRequestsList, pollRequestsNumber, milliseconds );
+  int waitError = errno;
+  pthread_mutex_lock( &(reactor->lock) );
+  for( size_t pollerIndex = 0; pollerIndex < pollRequestsNumber && eventsNumber > 0; pollerIndex++ )
+  {
+    if( pollRequestsList[ pollerIndex ].revents == 0 ) continue;
+    if( readyPollersNumber < EVENTS_BATCH_LENGTH ) readyPollersList[ readyPollersNumber++ ] = reactor->polledSocketsList[ pollerIndex ];
+  }
+  #else
+  fd_set activeSocketsSet, writingSocketsSet;
+  Socket maxSocketFD = 0;
+  FD_ZERO( &activeSocketsSet );
+  FD_ZERO( &writingSocketsSet );
+  size_t polledSocketsNumber = reactor->polledSocketsNumber;
+  for( size_t pollerIndex = 0; pollerIndex < polledSocketsNumber; pollerIndex++ )
+  {
+    SocketPoller* socket = reactor->polledSocketsList[ pollerIndex ];
+    bool isReading = !IsSocketPaused( socket );
+    if( !isReading && !socket->isWriting ) continue;
+    if( isReading ) FD_SET( socket->fd, &activeSocketsSet );
+    if( socket->isWriting ) FD_SET( socket->fd, &writingSocketsSet );
+    if( socket->fd > maxSocketFD ) maxSocketFD = socket->fd;
+  }
+  struct timeval waitTime = { .tv_sec = milliseconds / 1000, .tv_usec = ( milliseconds % 1000 ) * 1000 };
+  pthread_mutex_unlock( &(reactor->lock) );
+  int eventsNumber = select( maxSocketFD + 1, &activeSocketsSet, &writingSocketsSet, NULL, &waitTime );
+  int waitError = errno;
+  pthread_mutex_lock( &(reactor->lock) );
+  for( size_t pollerIndex = 0; pollerIndex < polledSocketsNumber && eventsNumber > 0; pollerIndex++ )
+  {
+    Socket socketFD = reactor->polledSocketsList[ pollerIndex ]->fd;
+    if( !FD_ISSET( socketFD, &activeSocketsSet ) && !FD_ISSET( socketFD, &writingSocketsSet ) ) continue;
+    if( readyPollersNumber < EVENTS_BATCH_LENGTH ) readyPollersList[ readyPollersNumber++ ] = reactor->polledSocketsList[ pollerIndex ];
+  }
+  #endif
+  if( eventsNumber == SOCKET_ERROR && waitError != EINTR ) fprintf( stderr, "%s: error waiting for socket events\n", __func__ );
+  
+  // Write queues are also checked periodically
+  *ref_hasWriteEvent = ( readyPollersNumber == 0 );
+  
+  return readyPollersNumber;
+}
+
+// Handle construction of a IPConnection structure with the defined properties
+static IPConnection AddConnection( Reactor reactor, Socket socketFD, IPAddress address, uint8_t transportProtocol, uint8_t networkRole,
+                                   size_t queueLength, uint8_t queuePolicy, size_t outputBufferSize )
+{
+  IPConnection connection = (IPConnection) malloc( sizeof(IPConnectionData) );
+  memset( connection, 0, sizeof(IPConnectionData) );
+  
+  memcpy( &(connection->addressData), address, sizeof(IPAddressData) );
+  // Local sequenced packets keep message boundaries by themselves
+  connection->frameHeaderLength = IS_LOCAL_ADDRESS( address ) ? 0 : TCP_FRAME_HEADER_LENGTH;
+  
+  connection->clientsList = NULL;
+  connection->remotesCount = 0;
+  
+  // Queues only store references to messages, so that copies don't depend on maximum length
+  // Dropping old messages makes the reactor also read from its queue, and application threads read from theirs
+  if( queueLength == 0 ) queueLength = IP_DEFAULT_QUEUE_LENGTH;
+  connection->queuePolicy = queuePolicy;
+  connection->readQueue = CreateMessageRing( queueLength, ( queuePolicy == IP_QUEUE_DROP_OLDEST ) );
+  connection->writeQueue = CreateMessageRing( queueLength, true );
+  connection->outputBufferSize = ( outputBufferSize > 0 ) ? outputBufferSize : TCP_OUTPUT_BUFFER_SIZE;
+  
+  if( networkRole == IP_SERVER ) // Server role connection
+  {
+    connection->ref_ReceiveMessage = ( transportProtocol == IP_TCP ) ? ReceiveTCPServerMessages : ReceiveUDPServerMessages;
+    connection->ref_SendMessages = ( transportProtocol == IP_TCP ) ? SendTCPServerMessages : SendUDPServerMessages;
+    if( transportProtocol == IP_UDP && IS_IP_MULTICAST_ADDRESS( address ) ) connection->ref_SendMessages = SendUDPClientMessages;
+    connection->ref_Close = ( transportProtocol == IP_TCP ) ? CloseTCPServer : CloseUDPServer;
+  }
+  else
+  { 
+    //connection->address->sin6_family = AF_INET6;
+    connection->ref_ReceiveMessage = ( transportProtocol == IP_TCP ) ? ReceiveTCPClientMessage : ReceiveUDPClientMessage;
+    connection->ref_SendMessages = ( transportProtocol == IP_TCP ) ? SendTCPClientMessages : SendUDPClientMessages;
+    connection->ref_Close = ( transportProtocol == IP_TCP ) ? CloseTCPClient : CloseUDPClient;
+  }
+  
+  connection->reactor = reactor;
+  connection->socket = AddSocketPoller( reactor, socketFD, connection, NULL );
+  
+  reactor->connectionsList = (IPConnection*) realloc( reactor->connectionsList, ( reactor->connectionsCount + 1 ) * sizeof(IPConnection) );
+  reactor->connectionsList[ reactor->connectionsCount++ ] = connection;
+  
+  return connection;
+}
+
+// Length of the given address structure actually used by its family, as expected by bind, connect or send calls
+static socklen_t GetAddressLength( IPAddress address )
+{
+  #ifdef IP_LOCAL_SOCKETS
+  if( IS_LOCAL_ADDRESS( address ) )
+  {
+    // Abstract names (as of autobound clients) start with a null character, while paths are null terminated
+    const char* path = ((struct sockaddr_un*) address)->sun_path;
+    size_t maxPathLength = sizeof(((struct sockaddr_un*) address)->sun_path);
+    size_t pathLength = ( path[ 0 ] == '\0' ) ? 1 + strnlen( path + 1, maxPathLength - 1 ) : strnlen( path, maxPathLength );
+    return (socklen_t) ( offsetof( struct sockaddr_un, sun_path ) + pathLength );
+  }
+  #endif
+  
+  return ( address->sa_family == AF_INET6 ) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+}
+
+IPAddress LoadAddressInfo( const char* host, const char* port, uint8_t networkRole )
+{
+  static IPAddressData addressData;
+  
+  #ifdef IP_LOCAL_SOCKETS
+  // Local socket path: the channel (port string), if any, names the socket file inside the host directory
+  if( IP_IsLocalAddress( host ) )
+  {
+    const char* directoryPath = host + strlen( LOCAL_ADDRESS_PREFIX );
+    struct sockaddr_un* localAddress = (struct sockaddr_un*) &addressData;
+    memset( &addressData, 0, sizeof(IPAddressData) );
+    localAddress->sun_family = AF_UNIX;
+    size_t pathLength = ( port != NULL ) ? snprintf( localAddress->sun_path, sizeof(localAddress->sun_path), "%s/%s", directoryPath, port )
+                                         : snprintf( localAddress->sun_path, sizeof(localAddress->sun_path), "%s", directoryPath );
+    if( pathLength >= sizeof(localAddress->sun_path) )
+    {
+      fprintf( stderr, "%s: local socket path on %s is too long\n", __func__, host );
+      return NULL;
+    }
+    return (IPAddress) &addressData;
+  }
+  #endif
+  
+  #ifdef WIN32
+  static WSADATA wsa;
+  if( wsa.wVersion == 0 )
+  {
+    if( WSAStartup( MAKEWORD( 2, 2 ), &wsa ) != 0 )
+    {
+      fprintf( stderr, "%s: error initialiasing windows sockets: code: %d\n", __func__, WSAGetLastError() );
+      return NULL;
+    }
+    
+    fprintf( stderr, "%s: initialiasing windows sockets version: %d\n", __func__, wsa.wVersion );
+  }
+  #endif
+  
+  #ifndef IP_NETWORK_LEGACY
+  struct addrinfo hints = { .ai_family = AF_UNSPEC }; // IPv6 (AF_INET6) or IPv4 (AF_INET) address
+  struct addrinfo* hostsInfoList;
+  struct addrinfo* hostInfo = NULL;
+                        
+  if( host == NULL )
+  {
+    if( networkRole == IP_SERVER )
+    {
+      hints.ai_flags |= AI_PASSIVE;                   // Set address for me
+      hints.ai_family = AF_INET6;                     // IPv6 address
+    }
+    else // if( networkRole == IP_CLIENT )
+      return NULL;
+  }
+  
+  int errorCode = 0;
+  if( (errorCode = getaddrinfo( host, port, &hints, &hostsInfoList )) != 0 )
+  {
+    fprintf( stderr, "getaddrinfo: error reading host info: %s\n", gai_strerror( errorCode ) );
+    return NULL;
+  }
+  
+  hostInfo = hostsInfoList; // First valid address is used
+  if( hostInfo != NULL ) memcpy( &addressData, hostInfo->ai_addr, hostInfo->ai_addrlen );
+  
+  freeaddrinfo( hostsInfoList ); // Don't need this struct anymore
+  
+  if( hostInfo == NULL ) return (IPAddress) NULL;
+  #else
+  (void) networkRole;
+  addressData.sin_family = AF_INET;   // IPv4 address
+  uint16_t portNumber = ( port != NULL ) ? (uint16_t) strtoul( port, NULL, 0 ) : 0;
+  addressData.sin_port = htons( portNumber );
+  if( host == NULL ) addressData.sin_addr.s_addr = INADDR_ANY;
+  else if( strcmp( host, "255.255.255.255" ) == 0 ) addressData.sin_addr.s_addr = INADDR_BROADCAST; 
+  else if ( (addressData.sin_addr.s_addr = inet_addr( host )) == INADDR_NONE ) return NULL;
+  #endif
+  
+  return (IPAddress) &addressData;
+}
+
+int CreateSocket( uint8_t protocol, IPAddress address )
+{
+  int socketType, transportProtocol;
+  
+  if( protocol == IP_TCP ) 
+  {
+    socketType = SOCK_STREAM;
+    transportProtocol = IPPROTO_TCP;
+  }
+  else if( protocol == IP_UDP ) 
+  {
+    socketType = SOCK_DGRAM;
+    transportProtocol = IPPROTO_UDP;
+  }
+  else
+  {
+    return INVALID_SOCKET;
+  }
+  
+  // Local sockets keep message boundaries on connections too, with sequenced packets
+  if( IS_LOCAL_ADDRESS( address ) )
+  {
+    if( protocol == IP_TCP ) socketType = SOCK_SEQPACKET;
+    transportProtocol = 0;
+  }
+
+  // Create IP socket
+  int socketFD = socket( address->sa_family, socketType, transportProtocol );
+  if( socketFD == INVALID_SOCKET )
+    fprintf( stderr, "socket: failed opening %s %s socket\n", ( protocol == IP_TCP ) ? "TCP" : "UDP",
+             IS_LOCAL_ADDRESS( address ) ? "local" : ( address->sa_family == AF_INET6 ) ? "IPv6" : "IPv4" );                                                              
+  
+  return socketFD;
+}
+
+bool SetSocketConfig( int socketFD )
+{
+  #ifdef WIN32
+  u_long nonBlocking = 1;
+  if( ioctlsocket( socketFD, FIONBIO, &nonBlocking ) == SOCKET_ERROR )
+  #else
+  if( fcntl( socketFD, F_SETFL, O_NONBLOCK ) == SOCKET_ERROR )
+  #endif
+  {
+    fprintf( stderr, "failure setting socket %d to non-blocking state\n", socketFD );
+    close( socketFD );
+    return false;
+  }
+  
+  int reuseAddress = 1; // Allow sockets to be binded to the same local port
+  if( setsockopt( socketFD, SOL_SOCKET, SO_REUSEADDR, (const char*) &reuseAddress, sizeof(reuseAddress) ) == SOCKET_ERROR ) 
+  {
+    fprintf( stderr, "setsockopt: failed setting socket %d option SO_REUSEADDR\n", socketFD );
+    close( socketFD );
+    return NULL;
+  }
+  
+  return true;
+}
+
+#ifdef IP_LOCAL_SOCKETS
+// Check if a server is still bound to the given local socket file, by connecting to it with a socket of the same type as the given one
+// (files of closed servers refuse connections)
+static bool IsLocalPathInUse( int socketFD, IPAddress address )
+{
+  int socketType;
+  socklen_t optionLength = sizeof(socketType);
+  if( getsockopt( socketFD, SOL_SOCKET, SO_TYPE, &socketType, &optionLength ) == SOCKET_ERROR ) return true;
+  
+  Socket probeSocketFD = socket( AF_UNIX, socketType | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+  if( probeSocketFD == INVALID_SOCKET ) return true;
+  bool isInUse = ( connect( probeSocketFD, address, GetAddressLength( address ) ) == 0 || errno != ECONNREFUSED );
+  close( probeSocketFD );
+  
+  return isInUse;
+}
+#endif
+
+bool BindServerSocket( int socketFD, IPAddress address )
+{
+  if( address->sa_family == AF_INET6 )
+  {
+    int ipv6Only = 0; // Let IPV6 servers accept IPV4 clients
+    if( setsockopt( socketFD, IPPROTO_IPV6, IPV6_V6ONLY, (const char*) &ipv6Only, sizeof(ipv6Only) ) == SOCKET_ERROR )
+    {
+      fprintf( stderr, "setsockopt: failed setting socket %d option IPV6_V6ONLY\n", socketFD );
+      close( socketFD );
+      return false;
+    }
+  }
+  
+  #ifdef IP_LOCAL_SOCKETS
+  // Socket files left behind by servers that didn't close properly would make binding fail, but running ones keep their path
+  const char* localPath = ((struct sockaddr_un*) address)->sun_path;
+  struct stat pathStatus;
+  if( IS_LOCAL_ADDRESS( address ) && stat( localPath, &pathStatus ) == 0 && S_ISSOCK( pathStatus.st_mode ) )
+  {
+    if( IsLocalPathInUse( socketFD, address ) )
+    {
+      fprintf( stderr, "bind: local socket %s is in use by another server\n", localPath );
+      close( socketFD );
+      return false;
+    }
+    unlink( localPath );
+  }
+  #endif
+  
+  // Bind server socket to the given local address
+  if( bind( socketFD, address, GetAddressLength( address ) ) == SOCKET_ERROR )
+  {
+    fprintf( stderr, "bind: failed on binding socket %d\n", socketFD );
+    close( socketFD );
+    return false;
+  }
+  
+  return true;
+}
+
+bool BindTCPServerSocket( int socketFD, IPAddress address )
+{
+  const size_t QUEUE_SIZE = 20;
+  
+  if( !BindServerSocket( socketFD, address ) ) return false;
+  
+  // Set server socket to listen to remote connections
+  if( listen( socketFD, QUEUE_SIZE ) == SOCKET_ERROR )
+  {
+    fprintf( stderr, "listen: failed listening on socket %d\n", socketFD );
+    close( socketFD );
+    return false;
+  }
+  
+  return true;
+}
+
+bool BindUDPServerSocket( int socketFD, IPAddress address )
+{
+  if( !BindServerSocket( socketFD, address ) ) return false;
+  
+  #ifndef IP_NETWORK_LEGACY
+  int multicastTTL = 255; // Set TTL of multicast packet
+  if( address->sa_family == AF_INET6 )
+  {
+    if( setsockopt( socketFD, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, (const char*) &multicastTTL, sizeof(multicastTTL)) != 0 ) 
+    {
+      fprintf( stderr, "setsockopt: failed setting socket %d option IPV6_MULTICAST_HOPS\n", socketFD );
+      close( socketFD );
+      return false;
+    }
+    unsigned int interfaceIndex = 0; // 0 means default interface
+    if( setsockopt( socketFD, IPPROTO_IPV6, IPV6_MULTICAST_IF, (const char*) &interfaceIndex, sizeof(interfaceIndex)) != 0 ) 
+    {
+      fprintf( stderr, "setsockopt: failed setting socket %d option IPV6_MULTICAST_IF\n", socketFD );
+      close( socketFD );
+      return false;
+    }
+  }
+  else if( address->sa_family == AF_INET )
+  {
+    if( setsockopt( socketFD, IPPROTO_IP, IP_MULTICAST_TTL, (const char*) &multicastTTL, sizeof(multicastTTL)) != 0 ) 
+    {
+      fprintf( stderr, "setsockopt: failed setting socket %d option IP_MULTICAST_TTL\n", socketFD );
+      close( socketFD );
+      return false;
+    }
+    in_addr_t interface = htonl( INADDR_ANY );
+	  if( setsockopt( socketFD, IPPROTO_IP, IP_MULTICAST_IF, (const char*) &interface, sizeof(interface)) != 0 ) 
+    {
+      fprintf( stderr, "setsockopt: failed setting socket %d option IP_MULTICAST_IF\n", socketFD );
+      close( socketFD );
+      return false;
+    }
+  }
+  #else
+  int broadcast = 1; // Enable broadcast for IPv4 connections
+  if( setsockopt( socketFD, SOL_SOCKET, SO_BROADCAST, (const char*) &broadcast, sizeof(broadcast) ) == SOCKET_ERROR )
+  {
+    fprintf( stderr, "setsockopt: failed setting socket %d option SO_BROADCAST\n", socketFD );
+    close( socketFD );
+    return false;
+  }
+  #endif
+  
+  return true;
+}
+
+bool ConnectTCPClientSocket( int socketFD, IPAddress address )
+{
+  // Connect TCP client socket to given remote address
+  if( connect( socketFD, address, GetAddressLength( address ) ) == SOCKET_ERROR )
+  {
+    // Non-blocking sockets complete connection asynchronously: wait for it before proceeding
+    int connectionError = errno;
+    if( errno == EINPROGRESS )
+    {
+      struct pollfd connectionPoller = { .fd = socketFD, .events = POLLOUT };
+      socklen_t errorLength = sizeof(connectionError);
+      if( poll( &connectionPoller, 1, EVENT_WAIT_TIME_MS ) <= 0 ) connectionError = ETIMEDOUT;
+      else if( getsockopt( socketFD, SOL_SOCKET, SO_ERROR, (char*) &connectionError, &errorLength ) == SOCKET_ERROR ) connectionError = errno;
+    }
+    
+    if( connectionError != 0 )
+    {
+      fprintf( stderr, "connect: failed on connecting socket %d to remote address: %s\n", socketFD, strerror( connectionError ) );
+      close( socketFD );
+      return false;
+    }
+  }
+  
+  return true;
+}
+
+bool ConnectUDPClientSocket( int socketFD, IPAddress address )
+{
+  // Bind UDP client socket to available local address
+  static struct sockaddr_storage localAddress;
+  localAddress.ss_family = address->sa_family;
+  // Local sockets get an unique abstract name when bound with only the family field
+  socklen_t addressLength = IS_LOCAL_ADDRESS( address ) ? sizeof(sa_family_t) : sizeof(localAddress);
+  if( bind( socketFD, (struct sockaddr*) &localAddress, addressLength ) == SOCKET_ERROR )
+  {
+    fprintf( stderr, "bind: failed on binding socket %d to arbitrary local port\n", socketFD );
+    close( socketFD );
+    return false;
+  }
+  
+  #ifndef IP_NETWORK_LEGACY
+  // Joint the multicast group
+  if( address->sa_family == AF_INET6 )
+  {
+    if( IS_IPV6_MULTICAST_ADDRESS( address ) )
+    {
+      struct ipv6_mreq multicastRequest;  // Specify the multicast group
+      memcpy( &multicastRequest.ipv6mr_multiaddr, &(((struct sockaddr_in6*) address)->sin6_addr), sizeof(multicastRequest.ipv6mr_multiaddr) );
+
+      multicastRequest.ipv6mr_interface = 0; // Accept multicast from any interface
+
+      // Join the multicast address
+      if ( setsockopt( socketFD, IPPROTO_IPV6, IPV6_ADD_MEMBERSHIP, (char*) &multicastRequest, sizeof(multicastRequest) ) != 0 ) 
+      {
+        fprintf( stderr, "setsockopt: failed setting socket %d option IPV6_ADD_MEMBERSHIP\n", socketFD );
+        close( socketFD );
+        return false;
+      }
+    }
+  }
+  else if( address->sa_family == AF_INET )
+  {
+    if( IS_IPV4_MULTICAST_ADDRESS( address ) )
+    {
+      struct ip_mreq multicastRequest;  // Specify the multicast group
+      memcpy( &(multicastRequest.imr_multiaddr), &(((struct sockaddr_in*) address)->sin_addr), sizeof(multicastRequest.imr_multiaddr) );
+
+      multicastRequest.imr_interface.s_addr = htonl( INADDR_ANY ); // Accept multicast from any interface
+
+      // Join the multicast address
+      if( setsockopt( socketFD, IPPROTO_IP, IP_ADD_MEMBERSHIP, (char*) &multicastRequest, sizeof(multicastRequest)) != 0 ) 
+      {
+        fprintf( stderr, "setsockopt: failed setting socket %d option IP_ADD_MEMBERSHIP\n", socketFD );
+        close( socketFD );
+        return false;
+      }
+    }
+  }
+  #endif
+  
+  // Register with the server right away, instead of on the first keepalive (see SendUDPKeepalives)
+  if( !IS_IP_MULTICAST_ADDRESS( address ) ) sendto( socketFD, "", 0, 0, address, GetAddressLength( address ) );
+  
+  return true;
+}
+
+// Create the configured number of reactors, each one with its own events poller and wake up notification
+static void StartReactors( void )
+{
+  CreateMessagePools();
+  
+  reactorsList = (Reactor) calloc( reactorsCount, sizeof(ReactorData) );
+  for( size_t reactorIndex = 0; reactorIndex < reactorsCount; reactorIndex++ )
+  {
+    Reactor reactor = &(reactorsList[ reactorIndex ]);
+    pthread_mutex_init( &(reactor->lock), NULL );
+    pthread_cond_init( &(reactor->closeCondition), NULL );
+    #ifdef IP_EVENTS_EPOLL
+    reactor->eventsPollerFD = epoll_create1( EPOLL_CLOEXEC );
+    reactor->writeEventFDs[ 0 ] = reactor->writeEventFDs[ 1 ] = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    #ifdef IP_EVENTS_RING
+    reactor->eventsRing = CreateEventsRing();
+    #endif
+    #elif !defined( WIN32 )
+    if( pipe( reactor->writeEventFDs ) == 0 )
+    {
+      fcntl( reactor->writeEventFDs[ 0 ], F_SETFL, O_NONBLOCK );
+      fcntl( reactor->writeEventFDs[ 1 ], F_SETFL, O_NONBLOCK );
+    }
+    #endif
+    #ifndef WIN32
+    // Wake up notification is polled like any socket, but with no owner connection
+    reactor->writeEventPoller = AddSocketPoller( reactor, reactor->writeEventFDs[ 0 ], NULL, NULL );
+    #endif
+    reactor->datagramsBatch = (DatagramsBatch) malloc( sizeof(DatagramsBatchData) );
+    for( size_t datagramIndex = 0; datagramIndex < RECEIVE_BATCH_LENGTH; datagramIndex++ )
+      reactor->datagramsBatch->messagesList[ datagramIndex ] = AllocateMessage( IP_MAX_MESSAGE_LENGTH );
+    reactor->isRunning = true;
+    reactor->thread = Thread_Start( AsyncUpdateReactor, (void*) reactor, THREAD_JOINABLE );
+  }
+}
+
+// Get the reactor with the fewest connections assigned to it
+static Reactor GetAvailableReactor( void )
+{
+  Reactor availableReactor = &(reactorsList[ 0 ]);
+  for( size_t reactorIndex = 1; reactorIndex < reactorsCount; reactorIndex++ )
+  {
+    if( reactorsList[ reactorIndex ].assignedConnectionsCount < availableReactor->assignedConnectionsCount )
+      availableReactor = &(reactorsList[ reactorIndex ]);
+  }
+  return availableReactor;
+}
+
+// Generic method for opening a new socket and providing a corresponding IPConnection structure for use
+void* IP_OpenConnection( uint8_t connectionType, const char* host, const char* port, size_t queueLength, uint8_t queuePolicy,
+                         size_t outputBufferSize )
+{
+  const uint8_t TRANSPORT_MASK = 0xF0, ROLE_MASK = 0x0F;
+  
+  // Ensure that the port number is in the Dynamic/Private range (49152-65535). Local sockets take any channel name instead
+  uint16_t portNumber = ( port != NULL && !IP_IsLocalAddress( host ) ) ? (uint16_t) strtoul( port, NULL, 0 ) : 0;
+  if( portNumber > 0 && portNumber < 49152 )
+  {
+    fprintf( stderr, "invalid port number value: %u\n", portNumber );
+    return NULL;
+  }
+
+  IPAddress address = LoadAddressInfo( host, port, (connectionType & ROLE_MASK) );
+  if( address == NULL ) return NULL;
+
+  Socket socketFD = CreateSocket( (connectionType & TRANSPORT_MASK), address );
+  if( socketFD == INVALID_SOCKET ) return NULL;
+  
+  if( !SetSocketConfig( socketFD ) ) return NULL;
+  
+  switch( connectionType )
+  {
+    case( IP_TCP | IP_SERVER ): if( !BindTCPServerSocket( socketFD, address ) ) return NULL;
+      break;
+    case( IP_UDP | IP_SERVER ): if( !BindUDPServerSocket( socketFD, address ) ) return NULL;
+      break;
+    case( IP_TCP | IP_CLIENT ): if( !ConnectTCPClientSocket( socketFD, address ) ) return NULL;
+      break;
+    case( IP_UDP | IP_CLIENT ): if( !ConnectUDPClientSocket( socketFD, address ) ) return NULL;
+      break;
+    default: fprintf( stderr, "invalid connection type: %x\n", connectionType );
+      return NULL;
+  } 
+  
+  pthread_mutex_lock( &connectionsLock );
+  if( activeConnectionsCount == 0 ) StartReactors();
+  
+  // Build the IPConnection structure, pinned to the least busy reactor
+  Reactor reactor = GetAvailableReactor();
+  pthread_mutex_lock( &(reactor->lock) );
+  IPConnection newConnection = AddConnection( reactor, socketFD, address, (connectionType & TRANSPORT_MASK), (connectionType & ROLE_MASK),
+                                              queueLength, queuePolicy, outputBufferSize );
+  pthread_mutex_unlock( &(reactor->lock) );
+  #ifdef IP_EVENTS_RING
+  // Requests of the new socket are only submitted by the reactor thread
+  if( reactor->eventsRing != NULL ) SignalWriteEvent( reactor );
+  #endif
+  
+  reactor->assignedConnectionsCount++;
+  activeConnectionsCount++;
+  pthread_mutex_unlock( &connectionsLock );
+  
+  return (void*) newConnection;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+/////                                     ASYNCRONOUS UPDATE                                          /////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Consume pending wake up notifications of the given reactor
+static void ConsumeWriteEvent( Reactor reactor )
+{
+  #ifndef WIN32
+  uint64_t eventsCount[ 8 ];
+  while( read( reactor->writeEventFDs[ 0 ], eventsCount, sizeof(eventsCount) ) > 0 ); // Consume all notifications
+  #endif
+  // Messages enqueued after this point trigger a new notification
+  atomic_store( &(reactor->isWriteEventPending), false );
+}
+
+// Send everything available on write queues of the given reactor connections, so that throughput is not limited by wake ups
+static void WriteReactorQueues( Reactor reactor )
+{
+  Message messagesOutList[ SEND_BATCH_LENGTH ];
+  
+  for( size_t connectionIndex = 0; connectionIndex < reactor->connectionsCount; connectionIndex++ )
+  {
+    IPConnection connection = reactor->connectionsList[ connectionIndex ];
+    
+    size_t messagesOutCount = 0;
+    do
+    {
+      // Messages of TCP client connections stay on their write queues while the output buffer is full, so that
+      // slow servers are handled by the queue policy (taking them again after the socket becomes writable)
+      if( connection->outputBuffer.queuedLength >= connection->outputBufferSize ) break;
+      messagesOutCount = 0;
+      while( messagesOutCount < SEND_BATCH_LENGTH && ( messagesOutList[ messagesOutCount ] = PopMessage( connection->writeQueue ) ) != NULL )
+        messagesOutCount++;
+      
+      if( messagesOutCount > 0 ) connection->ref_SendMessages( connection, messagesOutList, messagesOutCount );
+      
+      uint64_t sendTime = ( messagesOutCount > 0 ) ? Stats_GetTimeNS() : 0;
+      for( size_t messageIndex = 0; messageIndex < messagesOutCount; messageIndex++ )
+      {
+        Stats_AddLatency( connection->stats.writeLatencyHistogram, messagesOutList[ messageIndex ]->queueTime, sendTime );
+        ReleaseMessage( messagesOutList[ messageIndex ] );
+      }
+    } while( messagesOutCount == SEND_BATCH_LENGTH );
+  }
+}
+
+// Move pending messages to read queues with room, and restart reading from the sockets of connections with none left
+static void ResumeConnections( Reactor reactor )
+{
+  bool hasResumed = false;
+  for( size_t connectionIndex = 0; connectionIndex < reactor->connectionsCount; connectionIndex++ )
+  {
+    IPConnection connection = reactor->connectionsList[ connectionIndex ];
+    if( !atomic_load_explicit( &(connection->isReadPaused), memory_order_relaxed ) ) continue;
+    
+    size_t messagesMovedCount = 0;
+    while( messagesMovedCount < connection->pendingMessagesCount && PushMessage( connection->readQueue, connection->pendingMessagesList[ messagesMovedCount ] ) )
+      messagesMovedCount++;
+    connection->pendingMessagesCount -= messagesMovedCount;
+    memmove( connection->pendingMessagesList, connection->pendingMessagesList + messagesMovedCount, connection->pendingMessagesCount * sizeof(Message) );
+    hasResumed = hasResumed || ( messagesMovedCount > 0 );
+    
+    if( connection->pendingMessagesCount > 0 ) continue;
+    atomic_store( &(connection->isReadPaused), false );
+    SetConnectionEvents( connection, true );
+    reactor->pausedConnectionsCount--;
+  }
+  
+  if( hasResumed ) SignalReceiveEvent();
+}
+
+// Send empty datagrams from UDP client connections that haven't sent anything for a while, so that servers don't
+// expire them (subscribers may never write). Multicast groups have no registered remotes
+static void SendUDPKeepalives( Reactor reactor )
+{
+  const uint64_t CHECK_TIME_NS = UDP_PEERS_CHECK_TIME_MS * 1000000ULL, KEEPALIVE_TIME_NS = UDP_KEEPALIVE_TIME_MS * 1000000ULL;
+  
+  uint64_t currentTime = Stats_GetTimeNS();
+  if( currentTime - reactor->lastKeepalivesTime < CHECK_TIME_NS ) return;
+  reactor->lastKeepalivesTime = currentTime;
+  
+  for( size_t connectionIndex = 0; connectionIndex < reactor->connectionsCount; connectionIndex++ )
+  {
+    IPConnection connection = reactor->connectionsList[ connectionIndex ];
+    if( connection->ref_ReceiveMessage != ReceiveUDPClientMessage || connection->isClosing ) continue;
+    if( currentTime - connection->lastSendTime < KEEPALIVE_TIME_NS ) continue;
+    IPAddress address = (IPAddress) &(connection->addressData);
+    if( IS_IP_MULTICAST_ADDRESS( address ) ) continue;
+    // Failures are not reported: servers that are not up yet miss nothing
+    sendto( connection->socket->fd, "", 0, 0, address, GetAddressLength( address ) );
+    connection->lastSendTime = currentTime;
+  }
+}
+
+// Close sockets of connections flagged for closing, and hand them back to the threads waiting for it
+static void ReleaseClosingConnections( Reactor reactor )
+{
+  bool hasReleased = false;
+  size_t connectionIndex = 0;
+  while( connectionIndex < reactor->connectionsCount )
+  {
+    IPConnection connection = reactor->connectionsList[ connectionIndex ];
+    if( !connection->isClosing )
+    {
+      connectionIndex++;
+      continue;
+    }
+    // Each TCP connection has its own socket, so we can close it without problem. But UDP connections
+    // from the same server share the socket, so we need to wait for all of them to be stopped to close the socket
+    connection->ref_Close( connection );
+    if( atomic_load( &(connection->isReadPaused) ) ) reactor->pausedConnectionsCount--;
+    reactor->connectionsList[ connectionIndex ] = reactor->connectionsList[ --reactor->connectionsCount ];
+    connection->reactor = NULL;
+    hasReleased = true;
+  }
+  
+  if( hasReleased ) pthread_cond_broadcast( &(reactor->closeCondition) );
+}
+
+// Loop of message reading (storing in queue) and writing (removing in order from queue), to be called
+// asyncronously for all connections pinned to the given reactor
+static void* AsyncUpdateReactor( void* args )
+{
+  Reactor reactor = (Reactor) args;
+  SocketPoller* readyPollersList[ EVENTS_BATCH_LENGTH ];
+  
+  #ifndef WIN32
+  // Idle reactors still wake up in time to send keepalives
+  const unsigned long REACTOR_WAIT_TIME_MS = ( UDP_KEEPALIVE_TIME_MS < EVENT_WAIT_TIME_MS ) ? UDP_KEEPALIVE_TIME_MS : EVENT_WAIT_TIME_MS;
+  #else
+  const unsigned long REACTOR_WAIT_TIME_MS = 1;               // No wake up notification: check write queues periodically
+  #endif
+  
+  pthread_mutex_lock( &(reactor->lock) );
+  #ifdef IP_EVENTS_RING
+  // The reactor thread becomes the only one allowed to submit requests to its ring
+  if( reactor->eventsRing != NULL )
+  {
+    if( syscall( __NR_io_uring_register, reactor->eventsRing->fd, IORING_REGISTER_ENABLE_RINGS, NULL, 0 ) == SOCKET_ERROR )
+      fprintf( stderr, "io_uring_register: failed enabling ring: %s\n", strerror( errno ) );
+    reactor->eventsRing->submitterThread = pthread_self();
+    reactor->eventsRing->isEnabled = true;
+  }
+  #endif
+  while( reactor->isRunning )
+  { 
+    // Blocking call
+    bool hasWriteEvent;
+    size_t readyPollersNumber = WaitSocketEvents( reactor, readyPollersList, REACTOR_WAIT_TIME_MS, &hasWriteEvent );
+    
+    // Only connections with ready sockets are updated
+    bool hasReadEvents = false;
+    for( size_t pollerIndex = 0; pollerIndex < readyPollersNumber; pollerIndex++ )
+    {
+      SocketPoller* poller = readyPollersList[ pollerIndex ];
+      if( poller == reactor->writeEventPoller )
+      {
+        ConsumeWriteEvent( reactor );
+        hasWriteEvent = true;
+        continue;
+      }
+      // Pending output is written first, as failures discard the remote client (along with its poller)
+      if( poller->isWriting )
+      {
+        if( !FlushTCPClientOutput( poller->connection, poller->client ) ) continue;
+        hasWriteEvent = true;                                   // Room made for messages held on write queues
+      }
+      // Sockets of a connection paused by earlier events of the same batch are left to be read later
+      if( atomic_load_explicit( &(poller->connection->isReadPaused), memory_order_relaxed ) ) continue;
+      poller->connection->ref_ReceiveMessage( poller->connection, poller );
+      hasReadEvents = true;
+    }
+    
+    if( hasReadEvents ) SignalReceiveEvent();
+    
+    if( hasWriteEvent ) WriteReactorQueues( reactor );
+    
+    if( reactor->pausedConnectionsCount > 0 ) ResumeConnections( reactor );
+    
+    SendUDPKeepalives( reactor );
+    
+    ReleaseClosingConnections( reactor );
+  }
+  pthread_mutex_unlock( &(reactor->lock) );
+  
+  return NULL;
+}
+
+// Notify threads waiting for messages on any connection (called once per batch of read events)
+static void SignalReceiveEvent( void )
+{
+  atomic_fetch_add( &receiveEventsCount, 1 );
+  if( atomic_load( &receiveEventWaitersCount ) == 0 ) return;
+  
+  pthread_mutex_lock( &receiveEventLock );
+  pthread_cond_broadcast( &receiveEventCondition );
+  pthread_mutex_unlock( &receiveEventLock );
+}
+
+// Wake up given reactor, if it's not already awake
+static void SignalWriteEvent( Reactor reactor )
+{
+  if( atomic_exchange( &(reactor->isWriteEventPending), true ) ) return;
+  #ifndef WIN32
+  uint64_t eventCount = 1;
+  if( write( reactor->writeEventFDs[ 1 ], &eventCount, ( reactor->writeEventFDs[ 0 ] == reactor->writeEventFDs[ 1 ] ) ? sizeof(uint64_t) : 1 ) == SOCKET_ERROR )
+    fprintf( stderr, "%s: failed signaling write event\n", __func__ );
+  #endif
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+/////                                      SYNCRONOUS UPDATE                                          /////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Get new message with a copy of the given data (the only one made until it's sent)
+static Message CreateMessage( const uint8_t* data, size_t length )
+{
+  Message message = AllocateMessage( length );
+  memcpy( message->data, data, length );
+  return message;
+}
+
+// Store message that doesn't fit on the read queue, and stop polling the connection sockets
+static void PauseConnection( IPConnection connection, Message message )
+{
+  connection->pendingMessagesList = (Message*) realloc( connection->pendingMessagesList, ( connection->pendingMessagesCount + 1 ) * sizeof(Message) );
+  connection->pendingMessagesList[ connection->pendingMessagesCount++ ] = message;
+  Stats_UpdateMaximum( &(connection->stats.readQueueHighWater), connection->readQueue->capacity + connection->pendingMessagesCount );
+  if( atomic_load_explicit( &(connection->isReadPaused), memory_order_relaxed ) ) return;
+  
+  // Ordered against the read queue check of IP_ReceiveMessage(): either the reader sees the flag or the reactor sees the room
+  atomic_store( &(connection->isReadPaused), true );
+  atomic_thread_fence( memory_order_seq_cst );
+  SetConnectionEvents( connection, false );
+  connection->reactor->pausedConnectionsCount++;
+  SignalWriteEvent( connection->reactor );                      // Make sure room made meanwhile is not missed
+}
+
+// Store received message on the given connection read queue, handling a full queue according to the connection policy
+static void EnqueueReceivedMessage( IPConnection connection, Message message )
+{
+  // Messages received after the queue filled up go after the ones already waiting
+  while( connection->pendingMessagesCount > 0 || !PushMessage( connection->readQueue, message ) )
+  {
+    if( connection->queuePolicy == IP_QUEUE_DROP_OLDEST )
+    {
+      Message oldestMessage = PopMessage( connection->readQueue );
+      if( oldestMessage != NULL ) 
+      {
+        atomic_fetch_add_explicit( &(connection->readDropsCount), 1, memory_order_relaxed );
+        Stats_AddCount( &(connection->stats.droppedMessagesCount), 1 );
+      }
+      ReleaseMessage( oldestMessage );
+      continue;
+    }
+    // Keep message and stop reading from the connection (leaving data on socket buffers) until the application makes room
+    if( connection->queuePolicy == IP_QUEUE_DEFAULT || connection->queuePolicy == IP_QUEUE_BLOCK )
+    {
+      PauseConnection( connection, message );
+      return;
+    }
+    // There's no caller to report errors to: new message is dropped
+    atomic_fetch_add_explicit( &(connection->readDropsCount), 1, memory_order_relaxed );
+    Stats_AddCount( &(connection->stats.droppedMessagesCount), 1 );
+    ReleaseMessage( message );
+    return;
+  }
+  
+  Stats_UpdateMaximum( &(connection->stats.readQueueHighWater), GetRingMessagesCount( connection->readQueue ) );
+}
+
+// Store message on the given connection write queue, handling a full queue according to the connection policy.
+// Returns false if the message could not be stored (including dropped ones, so that they don't count as written)
+static bool EnqueueSentMessage( IPConnection connection, Message message )
+{
+  const struct timespec QUEUE_RETRY_TIME = { .tv_nsec = QUEUE_RETRY_TIME_NS };
+  const size_t QUEUE_MAX_RETRIES = SEND_WAIT_TIME_MS * 1000000 / QUEUE_RETRY_TIME_NS;
+  
+  size_t retriesCount = 0;
+  while( !PushMessage( connection->writeQueue, message ) )
+  {
+    if( connection->queuePolicy == IP_QUEUE_DROP_OLDEST )
+    {
+      Message oldestMessage = PopMessage( connection->writeQueue );
+      if( oldestMessage != NULL ) 
+      {
+        atomic_fetch_add_explicit( &(connection->writeDropsCount), 1, memory_order_relaxed );
+        Stats_AddCount( &(connection->stats.droppedMessagesCount), 1 );
+      }
+      ReleaseMessage( oldestMessage );
+      continue;
+    }
+    else if( connection->queuePolicy == IP_QUEUE_DROP_NEWEST )
+    {
+      atomic_fetch_add_explicit( &(connection->writeDropsCount), 1, memory_order_relaxed );
+      Stats_AddCount( &(connection->stats.droppedMessagesCount), 1 );
+      ReleaseMessage( message );
+      return false;
+    }
+    // Wait for the reactor to send queued messages, but not forever: it could be waiting for this thread to read
+    else if( connection->queuePolicy == IP_QUEUE_BLOCK && retriesCount++ < QUEUE_MAX_RETRIES )
+    {
+      SignalWriteEvent( connection->reactor );
+      nanosleep( &QUEUE_RETRY_TIME, NULL );
+      continue;
+    }
+    
+    fprintf( stderr, "connection %p write queue is full\n", connection );
+    Stats_AddCount( &(connection->stats.writeErrorsCount), 1 );
+    ReleaseMessage( message );
+    return false;
+  }
+  
+  Stats_UpdateMaximum( &(connection->stats.writeQueueHighWater), GetRingMessagesCount( connection->writeQueue ) );
+  
   return true;
 }
 
-bool BindServerSocket( int socketFD, IPAddress address )
+bool IP_ReceiveMessage( void* ref_connection, uint8_t* buffer, size_t maxLength, size_t* ref_length )
 {
-  if( address->sa_family == AF_INET6 )
+  uint64_t peerID;
+  return IP_ReceivePeerMessage( ref_connection, buffer, maxLength, ref_length, &peerID );
+}
+
+bool IP_ReceivePeerMessage( void* ref_connection, uint8_t* buffer, size_t maxLength, size_t* ref_length, uint64_t* ref_peerID )
+{  
+  if( ref_connection == NULL ) return false;
+  IPConnection connection = (IPConnection) ref_connection;
+  //if( bsearch( connection, globalConnectionsList, activeConnectionsCount, sizeof(IPConnection), CompareConnections ) == NULL ) return false;
+    
+  Message message = PopMessage( connection->readQueue );
+  if( message == NULL ) return false;
+  
+  // Let the reactor know there's room for messages it's holding
+  atomic_thread_fence( memory_order_seq_cst );
+  if( atomic_load_explicit( &(connection->isReadPaused), memory_order_relaxed ) ) SignalWriteEvent( connection->reactor );
+  
+  *ref_length = ( message->length < maxLength ) ? message->length : maxLength;
+  memcpy( buffer, message->data, *ref_length );
+  *ref_peerID = message->peerID;
+  Stats_AddRead( &(connection->stats), message->length, message->queueTime );
+  ReleaseMessage( message );
+  
+  return true;
+}
+
+size_t IP_GetMessagesCount( void* ref_connection )
+{
+  if( ref_connection == NULL ) return 0;
+  IPConnection connection = (IPConnection) ref_connection;
+  
+  return GetRingMessagesCount( connection->readQueue );
+}
+
+uint64_t IP_GetReceiveEventsCount( void )
+{
+  return atomic_load( &receiveEventsCount );
+}
+
+// Block until messages are received on any connection after the given events count was read (or timeout)
+bool IP_WaitReceiveEvent( uint64_t lastEventsCount, unsigned long milliseconds )
+{
+  struct timespec waitTime;
+  clock_gettime( CLOCK_REALTIME, &waitTime );
+  waitTime.tv_sec += milliseconds / 1000;
+  waitTime.tv_nsec += ( milliseconds % 1000 ) * 1000000;
+  if( waitTime.tv_nsec >= 1000000000 )
   {
-    int ipv6Only = 0; // Let IPV6 servers accept IPV4 clients
-    if( setsockopt( socketFD, IPPROTO_IPV6, IPV6_V6ONLY, (const char*) &ipv6Only, sizeof(ipv6Only) ) == SOCKET_ERROR )
-    {
-      fprintf( stderr, "setsockopt: failed setting socket %d option IPV6_V6ONLY\n", socketFD );
-      close( socketFD );
-      return false;
-    }
+    waitTime.tv_sec++;
+    waitTime.tv_nsec -= 1000000000;
   }
   
-  // Bind server socket to the given local address
-  size_t addressLength = ( address->sa_family == AF_INET6 ) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
-  if( bind( socketFD, address, addressLength ) == SOCKET_ERROR )
+  atomic_fetch_add( &receiveEventWaitersCount, 1 );
+  pthread_mutex_lock( &receiveEventLock );
+  while( atomic_load( &receiveEventsCount ) == lastEventsCount )
   {
-    fprintf( stderr, "bind: failed on binding socket %d\n", socketFD );
-    close( socketFD );
-    return false;
+    if( pthread_cond_timedwait( &receiveEventCondition, &receiveEventLock, &waitTime ) != 0 ) break;
   }
+  pthread_mutex_unlock( &receiveEventLock );
+  atomic_fetch_sub( &receiveEventWaitersCount, 1 );
+  
+  return ( atomic_load( &receiveEventsCount ) != lastEventsCount );
+}
+
+bool IP_GetReceiveCounters( void* ref_connection, uint64_t* ref_callsCount, uint64_t* ref_messagesCount, uint64_t* ref_largestBatch )
+{
+  if( ref_connection == NULL ) return false;
+  IPConnection connection = (IPConnection) ref_connection;
+  
+  *ref_callsCount = atomic_load_explicit( &(connection->receiveCallsCount), memory_order_relaxed );
+  *ref_messagesCount = atomic_load_explicit( &(connection->messagesReceivedCount), memory_order_relaxed );
+  *ref_largestBatch = atomic_load_explicit( &(connection->largestReceiveBatch), memory_order_relaxed );
   
   return true;
 }
 
-bool BindTCPServerSocket( int socketFD, IPAddress address )
+bool IP_GetQueueCounters( void* ref_connection, uint64_t* ref_readDropsCount, uint64_t* ref_writeDropsCount )
 {
-  const size_t QUEUE_SIZE = 20;
+  if( ref_connection == NULL ) return false;
+  IPConnection connection = (IPConnection) ref_connection;
   
-  if( !BindServerSocket( socketFD, address ) ) return false;
+  *ref_readDropsCount = atomic_load_explicit( &(connection->readDropsCount), memory_order_relaxed );
+  *ref_writeDropsCount = atomic_load_explicit( &(connection->writeDropsCount), memory_order_relaxed );
   
-  // Set server socket to listen to remote connections
-  if( listen( socketFD, QUEUE_SIZE ) == SOCKET_ERROR )
+  return true;
+}
+
+bool IP_GetStats( void* ref_connection, IPCStats* ref_stats )
+{
+  if( ref_connection == NULL ) return false;
+  IPConnection connection = (IPConnection) ref_connection;
+  
+  Stats_Load( &(connection->stats), ref_stats );
+  
+  return true;
+}
+
+bool IP_SendMessage( void* ref_connection, const uint8_t* data, size_t length )
+{
+  return IP_SendPeerMessage( ref_connection, 0, data, length );
+}
+
+// Messages to unknown (e.g. disconnected) remotes are only discarded by the reactor, as remotes are not tracked by callers
+bool IP_SendPeerMessage( void* ref_connection, uint64_t peerID, const uint8_t* data, size_t length )
+{  
+  if( ref_connection == NULL ) return false;
+  IPConnection connection = (IPConnection) ref_connection;
+  //if( bsearch( connection, globalConnectionsList, activeConnectionsCount, sizeof(IPConnection), CompareConnections ) == NULL ) return false;
+  
+  if( length > IP_MAX_MESSAGE_LENGTH )
   {
-    fprintf( stderr, "listen: failed listening on socket %d\n", socketFD );
-    close( socketFD );
+    fprintf( stderr, "message length %zu exceeds maximum of %d\n", length, IP_MAX_MESSAGE_LENGTH );
     return false;
   }
   
+  Message message = CreateMessage( data, length );
+  message->peerID = peerID;
+  if( !EnqueueSentMessage( connection, message ) ) return false;
+  Stats_AddWrite( &(connection->stats), length );
+  
+  SignalWriteEvent( connection->reactor );
+  
   return true;
 }
 
-bool BindUDPServerSocket( int socketFD, IPAddress address )
+/////////////////////////////////////////////////////////////////////////////////////////
+/////                      SPECIFIC TRANSPORT/ROLE COMMUNICATION                    /////
+/////////////////////////////////////////////////////////////////////////////////////////
+
+static void RemoveSocket( SocketPoller* );
+static void RemoveTCPClient( IPConnection, TCPClient );
+
+// Account messages delivered by a single receive system call (only called from the connection reactor thread)
+static void UpdateReceiveCounters( IPConnection connection, size_t messagesCount )
 {
-  if( !BindServerSocket( socketFD, address ) ) return false;
-  
-  #ifndef IP_NETWORK_LEGACY
-  int multicastTTL = 255; // Set TTL of multicast packet
-  if( address->sa_family == AF_INET6 )
+  atomic_fetch_add_explicit( &(connection->receiveCallsCount), 1, memory_order_relaxed );
+  atomic_fetch_add_explicit( &(connection->messagesReceivedCount), messagesCount, memory_order_relaxed );
+  if( messagesCount > atomic_load_explicit( &(connection->largestReceiveBatch), memory_order_relaxed ) )
+    atomic_store_explicit( &(connection->largestReceiveBatch), messagesCount, memory_order_relaxed );
+}
+
+// Enqueue every complete frame found on the given stream data, tagged with the given remote identifier, adding them to the
+// given count. The length of the frames taken is stored, so that the remaining partial frame is kept. Returns false on invalid frames
+static bool ExtractStreamFrames( Socket socketFD, const uint8_t* data, size_t length, IPConnection connection, uint64_t peerID,
+                                 size_t* ref_frameOffset, size_t* ref_framesCount )
+{
+  size_t frameOffset = 0;
+  while( length - frameOffset >= TCP_FRAME_HEADER_LENGTH )
   {
-    if( setsockopt( socketFD, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, (const char*) &multicastTTL, sizeof(multicastTTL)) != 0 ) 
-    {
-      fprintf( stderr, "setsockopt: failed setting socket %d option IPV6_MULTICAST_HOPS\n", socketFD );
-      close( socketFD );
-      return false;
-    }
-    unsigned int interfaceIndex = 0; // 0 means default interface
-    if( setsockopt( socketFD, IPPROTO_IPV6, IPV6_MULTICAST_IF, (const char*) &interfaceIndex, sizeof(interfaceIndex)) != 0 ) 
+    uint32_t frameLength;
+    memcpy( &frameLength, data + frameOffset, TCP_FRAME_HEADER_LENGTH );
+    frameLength = ntohl( frameLength );
+    if( frameLength > IP_MAX_MESSAGE_LENGTH )
     {
-      fprintf( stderr, "setsockopt: failed setting socket %d option IPV6_MULTICAST_IF\n", socketFD );
-      close( socketFD );
+      fprintf( stderr, "recv: invalid frame length %u on socket %d\n", frameLength, socketFD );
       return false;
     }
+    // Wait for the rest of an incomplete frame
+    if( length - frameOffset - TCP_FRAME_HEADER_LENGTH < frameLength ) break;
+    
+    Message message = CreateMessage( data + frameOffset + TCP_FRAME_HEADER_LENGTH, frameLength );
+    message->peerID = peerID;
+    EnqueueReceivedMessage( connection, message );
+    frameOffset += TCP_FRAME_HEADER_LENGTH + frameLength;
+    (*ref_framesCount)++;
   }
-  else //if( address->sa_family == AF_INET )
+  *ref_frameOffset = frameOffset;
+  
+  return true;
+}
+
+// Read as much stream data as available into the given buffer and enqueue every complete frame found on it, tagged with
+// the given remote identifier. Returns false if the stream was closed or became invalid (and should be discarded)
+static bool ReadStreamFrames( Socket socketFD, StreamBuffer buffer, IPConnection connection, uint64_t peerID )
+{
+  if( buffer->data == NULL ) buffer->data = (uint8_t*) malloc( STREAM_BUFFER_CAPACITY );
+  
+  // A single (large) read may deliver many messages at once
+  int bytesReceived = recv( socketFD, (void*) ( buffer->data + buffer->length ), STREAM_BUFFER_CAPACITY - buffer->length, 0 );
+  if( bytesReceived == SOCKET_ERROR )
   {
-    if( setsockopt( socketFD, IPPROTO_IP, IP_MULTICAST_TTL, (const char*) &multicastTTL, sizeof(multicastTTL)) != 0 ) 
-    {
-      fprintf( stderr, "setsockopt: failed setting socket %d option IP_MULTICAST_TTL\n", socketFD );
-      close( socketFD );
-      return false;
-    }
-    in_addr_t interface = htonl( INADDR_ANY );
-	  if( setsockopt( socketFD, IPPROTO_IP, IP_MULTICAST_IF, (const char*) &interface, sizeof(interface)) != 0 ) 
-    {
-      fprintf( stderr, "setsockopt: failed setting socket %d option IP_MULTICAST_IF\n", socketFD );
-      close( socketFD );
-      return false;
-    }
+    if( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) return true;
+    fprintf( stderr, "recv: error reading from socket %d\n", socketFD );
+    return false;
   }
-  #else
-  int broadcast = 1; // Enable broadcast for IPv4 connections
-  if( setsockopt( socketFD, SOL_SOCKET, SO_BROADCAST, (const char*) &broadcast, sizeof(broadcast) ) == SOCKET_ERROR )
+  else if( bytesReceived == 0 )
   {
-    fprintf( stderr, "setsockopt: failed setting socket %d option SO_BROADCAST\n", socketFD );
-    close( socketFD );
+    fprintf( stderr, "recv: remote connection with socket %d closed\n", socketFD );
     return false;
   }
-  #endif
+  buffer->length += bytesReceived;
+  
+  size_t frameOffset = 0, framesCount = 0;
+  if( !ExtractStreamFrames( socketFD, buffer->data, buffer->length, connection, peerID, &frameOffset, &framesCount ) ) return false;
+  UpdateReceiveCounters( connection, framesCount );
+  
+  // Keep only the remaining partial frame, at the beginning of the buffer
+  buffer->length -= frameOffset;
+  if( buffer->length > 0 && frameOffset > 0 ) memmove( buffer->data, buffer->data + frameOffset, buffer->length );
   
   return true;
 }
 
-bool ConnectTCPClientSocket( int socketFD, IPAddress address )
+// Fill the length prefix stored right before the message data, so that whole frames are sent from a single buffer
+static inline void SetFrameHeader( Message message )
 {
-  // Connect TCP client socket to given remote address
-  size_t addressLength = ( address->sa_family == AF_INET6 ) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
-  if( connect( socketFD, address, addressLength ) == SOCKET_ERROR )
+  uint32_t frameLength = htonl( (uint32_t) message->length );
+  memcpy( message->frameHeader, &frameLength, TCP_FRAME_HEADER_LENGTH );
+}
+
+// Write as many pending frames as the given stream accepts without blocking, and keep waiting for it to become writable
+// while any is left. Returns false if the stream became invalid (and should be discarded)
+static bool FlushStreamOutput( SocketPoller* socket, StreamOutput output )
+{
+  size_t headerLength = socket->connection->frameHeaderLength;
+  
+  bool isValid = true;
+  size_t framesSentCount = 0;
+  while( framesSentCount < output->messagesCount )
   {
-    fprintf( stderr, "connect: failed on connecting socket %d to remote address\n", socketFD );
-    close( socketFD );
-    return false;
+    Message message = output->messagesList[ framesSentCount ];
+    size_t frameLength = headerLength + message->length;
+    const uint8_t* frameData = message->data - headerLength;
+    int bytesSent = send( socket->fd, (void*) ( frameData + output->sentLength ), frameLength - output->sentLength, SEND_FLAGS );
+    if( bytesSent == SOCKET_ERROR )
+    {
+      if( errno == EINTR ) continue;
+      // The rest is written when the socket becomes writable again, without holding the reactor
+      if( errno == EAGAIN || errno == EWOULDBLOCK ) break;
+      fprintf( stderr, "send: error writing to socket %d\n", socket->fd );
+      isValid = false;
+      break;
+    }
+    output->sentLength += bytesSent;
+    output->queuedLength -= bytesSent;
+    if( output->sentLength < frameLength ) continue;
+    ReleaseMessage( message );
+    output->sentLength = 0;
+    framesSentCount++;
   }
+  output->messagesCount -= framesSentCount;
+  memmove( output->messagesList, output->messagesList + framesSentCount, output->messagesCount * sizeof(Message) );
   
-  return true;
+  if( isValid ) SetSocketWriteEvents( socket, ( output->messagesCount > 0 ) );
+  
+  return isValid;
 }
 
-bool ConnectUDPClientSocket( int socketFD, IPAddress address )
+// Release frames still pending on the given output buffer
+static void DiscardStreamOutput( StreamOutput output )
 {
-  // Bind UDP client socket to available local address
-  static struct sockaddr_storage localAddress;
-  localAddress.ss_family = address->sa_family;
-  if( bind( socketFD, (struct sockaddr*) &localAddress, sizeof(localAddress) ) == SOCKET_ERROR )
+  for( size_t messageIndex = 0; messageIndex < output->messagesCount; messageIndex++ )
+    ReleaseMessage( output->messagesList[ messageIndex ] );
+  free( output->messagesList );
+  memset( output, 0, sizeof(StreamOutputData) );
+}
+
+// Write numeric host and port representation of the given address to string
+static const char* GetAddressString( IPAddress address, char* addressString )
+{
+  #ifdef IP_LOCAL_SOCKETS
+  // Local socket path (truncated to the string length used for IP addresses), or abstract name (of clients) left unprinted
+  const char* localPath = ((struct sockaddr_un*) address)->sun_path;
+  if( IS_LOCAL_ADDRESS( address ) )
   {
-    fprintf( stderr, "bind: failed on binding socket %d to arbitrary local port\n", socketFD );
-    close( socketFD );
-    return false;
+    const int MAX_PATH_LENGTH = ADDRESS_LENGTH + PORT_LENGTH - 1;
+    snprintf( addressString, ADDRESS_LENGTH + PORT_LENGTH, "%.*s", MAX_PATH_LENGTH, ( localPath[ 0 ] != '\0' ) ? localPath : "<abstract>" );
+    return addressString;
   }
+  #endif
   
-  #ifndef IP_NETWORK_LEGACY
-  // Joint the multicast group
-  if( address->sa_family == AF_INET6 )
+  char hostString[ ADDRESS_LENGTH ], portString[ PORT_LENGTH ];
+  if( getnameinfo( address, GetAddressLength( address ), hostString, ADDRESS_LENGTH, portString, PORT_LENGTH, NI_NUMERICHOST | NI_NUMERICSERV ) != 0 )
+    return strcpy( addressString, "<unknown>" );
+  sprintf( addressString, "%s:%s", hostString, portString );
+  return addressString;
+}
+
+// Full socket buffers (of the sender, or of local receivers) are the datagram equivalent of full queues: messages are dropped
+static inline bool IsDatagramDropError( int errorCode )
+{
+  return ( errorCode == EAGAIN || errorCode == EWOULDBLOCK || errorCode == ENOBUFS );
+}
+
+#ifdef IP_MULTIPLE_MESSAGES
+// Send prepared datagrams, skipping the failed ones without stopping the rest of the batch. Datagrams dropped for lack of
+// buffer space are only counted on the given drops count. Returns the number of failed datagrams
+static size_t FlushDatagrams( Socket socketFD, struct mmsghdr* datagramsList, size_t datagramsCount, size_t* ref_dropsCount )
+{
+  char addressString[ ADDRESS_LENGTH + PORT_LENGTH ];
+  
+  size_t failuresCount = 0;
+  size_t datagramIndex = 0;
+  while( datagramIndex < datagramsCount )
   {
-    if( IS_IPV6_MULTICAST_ADDRESS( address ) )
+    int datagramsSent = sendmmsg( socketFD, datagramsList + datagramIndex, datagramsCount - datagramIndex, 0 );
+    if( datagramsSent == SOCKET_ERROR )
     {
-      struct ipv6_mreq multicastRequest;  // Specify the multicast group
-      memcpy( &multicastRequest.ipv6mr_multiaddr, &(((struct sockaddr_in6*) address)->sin6_addr), sizeof(multicastRequest.ipv6mr_multiaddr) );
+      if( errno == EINTR ) continue;
+      // First datagram of the remaining batch failed: it's the only one affected by this error
+      datagramsSent = 1;
+      if( IsDatagramDropError( errno ) )
+      {
+        (*ref_dropsCount)++;
+      }
+      else
+      {
+        IPAddress address = (IPAddress) datagramsList[ datagramIndex ].msg_hdr.msg_name;
+        fprintf( stderr, "sendmmsg: error writing to %s on socket %d: %s\n", GetAddressString( address, addressString ), socketFD, strerror( errno ) );
+        failuresCount++;
+      }
+    }
+    datagramIndex += datagramsSent;
+  }
+  
+  return failuresCount;
+}
+#endif
 
-      multicastRequest.ipv6mr_interface = 0; // Accept multicast from any interface
+// Get destinations of the given message: the remote it replies to, if still registered, or all the given addresses otherwise
+static size_t GetDatagramTargets( IPConnection connection, Message message, IPAddressData* addressesList, size_t addressesCount,
+                                  IPAddressData** ref_targetsList )
+{
+  *ref_targetsList = addressesList;
+  if( message->peerID == 0 ) return addressesCount;
+  
+  *ref_targetsList = FindUDPPeerAddress( connection, message->peerID );
+  return ( *ref_targetsList != NULL ) ? 1 : 0;
+}
 
-      // Join the multicast address
-      if ( setsockopt( socketFD, IPPROTO_IPV6, IPV6_ADD_MEMBERSHIP, (char*) &multicastRequest, sizeof(multicastRequest) ) != 0 ) 
+// Send each given message to each given address (replies only to their remote), with as few system calls as possible
+static void SendDatagrams( IPConnection connection, Message* messagesList, size_t messagesCount, IPAddressData* addressesList, size_t addressesCount )
+{
+  Socket socketFD = connection->socket->fd;
+  size_t failuresCount = 0, dropsCount = 0;
+  IPAddressData* targetsList;
+  #ifdef IP_MULTIPLE_MESSAGES
+  struct mmsghdr* datagramsList = connection->reactor->datagramsBatch->sendDatagramsList;
+  struct iovec* buffersList = connection->reactor->datagramsBatch->sendBuffersList;
+  
+  size_t datagramsCount = 0;
+  for( size_t messageIndex = 0; messageIndex < messagesCount; messageIndex++ )
+  {
+    // Message buffers are shared by all its destinations
+    buffersList[ messageIndex ].iov_base = messagesList[ messageIndex ]->data;
+    buffersList[ messageIndex ].iov_len = messagesList[ messageIndex ]->length;
+    size_t targetsCount = GetDatagramTargets( connection, messagesList[ messageIndex ], addressesList, addressesCount, &targetsList );
+    if( messagesList[ messageIndex ]->peerID != 0 && targetsCount == 0 ) failuresCount++;
+    for( size_t addressIndex = 0; addressIndex < targetsCount; addressIndex++ )
+    {
+      struct msghdr* header = &(datagramsList[ datagramsCount ].msg_hdr);
+      memset( header, 0, sizeof(struct msghdr) );
+      header->msg_name = &(targetsList[ addressIndex ]);
+      header->msg_namelen = GetAddressLength( (IPAddress) &(targetsList[ addressIndex ]) );
+      header->msg_iov = &(buffersList[ messageIndex ]);
+      header->msg_iovlen = 1;
+      if( ++datagramsCount == DATAGRAMS_BATCH_LENGTH )
       {
-        fprintf( stderr, "setsockopt: failed setting socket %d option IPV6_ADD_MEMBERSHIP\n", socketFD );
-        close( socketFD );
-        return false;
+        failuresCount += FlushDatagrams( socketFD, datagramsList, datagramsCount, &dropsCount );
+        datagramsCount = 0;
       }
     }
   }
-  else //if( address->sa_family == AF_INET )
+  failuresCount += FlushDatagrams( socketFD, datagramsList, datagramsCount, &dropsCount );
+  #else
+  char addressString[ ADDRESS_LENGTH + PORT_LENGTH ];
+  for( size_t messageIndex = 0; messageIndex < messagesCount; messageIndex++ )
   {
-    if( IS_IPV4_MULTICAST_ADDRESS( address ) )
+    size_t targetsCount = GetDatagramTargets( connection, messagesList[ messageIndex ], addressesList, addressesCount, &targetsList );
+    if( messagesList[ messageIndex ]->peerID != 0 && targetsCount == 0 ) failuresCount++;
+    for( size_t addressIndex = 0; addressIndex < targetsCount; addressIndex++ )
     {
-      struct ip_mreq multicastRequest;  // Specify the multicast group
-      memcpy( &(multicastRequest.imr_multiaddr), &(((struct sockaddr_in*) address)->sin_addr), sizeof(multicastRequest.imr_multiaddr) );
+      IPAddress address = (IPAddress) &(targetsList[ addressIndex ]);
+      if( sendto( socketFD, (void*) messagesList[ messageIndex ]->data, messagesList[ messageIndex ]->length, 0, address, GetAddressLength( address ) ) != SOCKET_ERROR ) continue;
+      if( IsDatagramDropError( errno ) )
+      {
+        dropsCount++;
+        continue;
+      }
+      fprintf( stderr, "sendto: error writing to %s on socket %d\n", GetAddressString( address, addressString ), socketFD );
+      failuresCount++;
+    }
+  }
+  #endif
+  if( failuresCount > 0 ) Stats_AddCount( &(connection->stats.writeErrorsCount), failuresCount );
+  // Each destination missed counts as a dropped message
+  if( dropsCount > 0 )
+  {
+    atomic_fetch_add_explicit( &(connection->writeDropsCount), dropsCount, memory_order_relaxed );
+    Stats_AddCount( &(connection->stats.droppedMessagesCount), dropsCount );
+  }
+}
 
-      multicastRequest.imr_interface.s_addr = htonl( INADDR_ANY ); // Accept multicast from any interface
+// Get message for a datagram received on the given batch buffer. Large datagrams keep the buffer (replaced on the batch),
+// while smaller ones are copied to a buffer of their size class, so that queued messages don't hold much more memory than needed
+static Message TakeDatagramMessage( Message* messagesList, size_t datagramIndex, size_t length )
+{
+  Message message = messagesList[ datagramIndex ];
+  if( message->sizeClass != GetMessageSizeClass( length ) ) return CreateMessage( message->data, length );
+  
+  messagesList[ datagramIndex ] = AllocateMessage( IP_MAX_MESSAGE_LENGTH );
+  message->queueTime = Stats_GetTimeNS();
+  message->length = length;
+  return message;
+}
 
-      // Join the multicast address
-      if( setsockopt( socketFD, IPPROTO_IP, IP_ADD_MEMBERSHIP, (char*) &multicastRequest, sizeof(multicastRequest)) != 0 ) 
-      {
-        fprintf( stderr, "setsockopt: failed setting socket %d option IP_ADD_MEMBERSHIP\n", socketFD );
-        close( socketFD );
-        return false;
+// Store received datagram on the given connection read queue. Sources are registered as remotes by server connections,
+// and their identifiers attached to the messages, so that replies can be sent only to them
+static void EnqueueDatagram( IPConnection connection, Message message, IPAddress address, socklen_t addressLength )
+{
+  // Local addresses are compared as a whole: clear what is left from previous sources
+  if( IS_LOCAL_ADDRESS( address ) && addressLength < sizeof(IPAddressData) ) memset( (uint8_t*) address + addressLength, 0, sizeof(IPAddressData) - addressLength );
+  if( connection->ref_ReceiveMessage == ReceiveUDPServerMessages )
+  {
+    message->peerID = UpdateUDPPeer( connection, address, message->queueTime );
+    // Empty datagrams are keepalives of idle clients, only refreshing their registration
+    if( message->length == 0 )
+    {
+      ReleaseMessage( message );
+      return;
+    }
+  }
+  EnqueueReceivedMessage( connection, message );
+}
+
+// Read available datagrams (as many as possible per system call) and enqueue them
+static size_t ReceiveDatagrams( IPConnection connection )
+{
+  DatagramsBatch batch = connection->reactor->datagramsBatch;
+  Message* messagesList = batch->messagesList;
+  IPAddressData* addressesList = batch->addressesList;
+  
+  size_t datagramsCount = 0;
+  #ifdef IP_MULTIPLE_MESSAGES
+  struct mmsghdr* datagramsList = batch->receiveDatagramsList;
+  struct iovec* buffersList = batch->receiveBuffersList;
+  for( size_t datagramIndex = 0; datagramIndex < RECEIVE_BATCH_LENGTH; datagramIndex++ )
+  {
+    buffersList[ datagramIndex ] = (struct iovec) { .iov_base = messagesList[ datagramIndex ]->data, .iov_len = IP_MAX_MESSAGE_LENGTH };
+    datagramsList[ datagramIndex ].msg_hdr = (struct msghdr) { .msg_name = &(addressesList[ datagramIndex ]), .msg_namelen = sizeof(IPAddressData),
+                                                               .msg_iov = &(buffersList[ datagramIndex ]), .msg_iovlen = 1 };
+  }
+  int datagramsReceived = recvmmsg( connection->socket->fd, datagramsList, RECEIVE_BATCH_LENGTH, MSG_DONTWAIT, NULL );
+  if( datagramsReceived == SOCKET_ERROR )
+  {
+    if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) fprintf( stderr, "recvmmsg: error reading from socket %d\n", connection->socket->fd );
+    return 0;
+  }
+  
+  for( ; datagramsCount < (size_t) datagramsReceived; datagramsCount++ )
+  {
+    Message message = TakeDatagramMessage( messagesList, datagramsCount, datagramsList[ datagramsCount ].msg_len );
+    EnqueueDatagram( connection, message, (IPAddress) &(addressesList[ datagramsCount ]), datagramsList[ datagramsCount ].msg_hdr.msg_namelen );
+  }
+  #else
+  socklen_t addressLength = sizeof(IPAddressData);
+  int bytesReceived = recvfrom( connection->socket->fd, (void*) messagesList[ 0 ]->data, IP_MAX_MESSAGE_LENGTH, 0, (IPAddress) &(addressesList[ 0 ]), &addressLength );
+  if( bytesReceived == SOCKET_ERROR )
+  {
+    fprintf( stderr, "recvfrom: error reading from socket %d\n", connection->socket->fd );
+    return 0;
+  }
+  
+  EnqueueDatagram( connection, TakeDatagramMessage( messagesList, 0, bytesReceived ), (IPAddress) &(addressesList[ 0 ]), addressLength );
+  datagramsCount = 1;
+  #endif
+  
+  UpdateReceiveCounters( connection, datagramsCount );
+  
+  return datagramsCount;
+}
+
+#ifdef IP_LOCAL_SOCKETS
+// Empty packets are valid messages: the end of the connection is told by the hang up state of its socket
+static bool IsPacketStreamClosed( Socket socketFD )
+{
+  struct pollfd socketPoller = { .fd = socketFD, .events = POLLRDHUP };
+  if( poll( &socketPoller, 1, 0 ) <= 0 || !( socketPoller.revents & ( POLLRDHUP | POLLHUP ) ) ) return false;
+  
+  fprintf( stderr, "recv: remote connection with socket %d closed\n", socketFD );
+  return true;
+}
+
+// Read available packets (each one a whole message) from the given local sequenced packet socket and enqueue them, tagged
+// with the given remote identifier. Returns false if the connection was closed or became invalid (and should be discarded)
+static bool ReadPackets( Socket socketFD, IPConnection connection, uint64_t peerID )
+{
+  Message* messagesList = connection->reactor->datagramsBatch->messagesList;
+  
+  bool isValid = true;
+  size_t packetsCount = 0;
+  while( packetsCount < RECEIVE_BATCH_LENGTH )
+  {
+    int bytesReceived = recv( socketFD, (void*) messagesList[ 0 ]->data, IP_MAX_MESSAGE_LENGTH, 0 );
+    if( bytesReceived == SOCKET_ERROR )
+    {
+      if( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) break;
+      fprintf( stderr, "recv: error reading from socket %d\n", socketFD );
+      isValid = false;
+      break;
+    }
+    else if( bytesReceived == 0 )
+    {
+      if( IsPacketStreamClosed( socketFD ) )
+      {
+        isValid = false;
+        break;
       }
     }
+    
+    Message message = TakeDatagramMessage( messagesList, 0, bytesReceived );
+    message->peerID = peerID;
+    EnqueueReceivedMessage( connection, message );
+    packetsCount++;
   }
-  #endif
+  UpdateReceiveCounters( connection, packetsCount );
   
-  return true;
+  return isValid;
 }
+#endif
 
-// Generic method for opening a new socket and providing a corresponding IPConnection structure for use
-void* IP_OpenConnection( uint8_t connectionType, const char* host, const char* port )
+// Read available messages from the given connected socket: length prefixed frames on TCP streams,
+// or single packets on local sockets. Returns false if the connection was closed or became invalid
+static bool ReadStreamMessages( Socket socketFD, StreamBuffer buffer, IPConnection connection, uint64_t peerID )
 {
-  const uint8_t TRANSPORT_MASK = 0xF0, ROLE_MASK = 0x0F;
-  
-  // Ensure that the port number is in the Dynamic/Private range (49152-65535)
-  uint16_t portNumber = ( port != NULL ) ? (uint16_t) strtoul( port, NULL, 0 ) : 0;
-  if( portNumber > 0 && portNumber < 49152 )
-  {
-    fprintf( stderr, "invalid port number value: %u\n", portNumber );
-    return NULL;
-  }
+  #ifdef IP_LOCAL_SOCKETS
+  if( connection->frameHeaderLength == 0 ) return ReadPackets( socketFD, connection, peerID );
+  #endif
+  return ReadStreamFrames( socketFD, buffer, connection, peerID );
+}
 
-  IPAddress address = LoadAddressInfo( host, port, (connectionType & ROLE_MASK) );
-  if( address == NULL ) return NULL;
+// Try to receive incoming messages from the given TCP client connection and store them on its buffer
+static void ReceiveTCPClientMessage( IPConnection connection, SocketPoller* socket )
+{
+  (void) socket;
+  if( connection->socket->fd == INVALID_SOCKET ) return;
 
-  Socket socketFD = CreateSocket( (connectionType & TRANSPORT_MASK), address );
-  if( socketFD == INVALID_SOCKET ) return NULL;
-  
-  if( !SetSocketConfig( socketFD ) ) return NULL;
-  
-  switch( connectionType )
+  if( !ReadStreamMessages( connection->socket->fd, &(connection->inputBuffer), connection, 0 ) )
+    RemoveSocket( connection->socket );
+}
+
+// Queue given messages on the output buffer of the given TCP connection and write as much of it as possible. The rest is
+// written when the socket becomes writable, without ever holding the reactor (partial frames are resumed where they stopped)
+static void SendTCPClientMessages( IPConnection connection, Message* messagesList, size_t messagesCount )
+{
+  if( connection->socket->fd == INVALID_SOCKET )
   {
-    case( IP_TCP | IP_SERVER ): if( !BindTCPServerSocket( socketFD, address ) ) return NULL;
-      break;
-    case( IP_UDP | IP_SERVER ): if( !BindUDPServerSocket( socketFD, address ) ) return NULL;
-      break;
-    case( IP_TCP | IP_CLIENT ): if( !ConnectTCPClientSocket( socketFD, address ) ) return NULL;
-      break;
-    case( IP_UDP | IP_CLIENT ): if( !ConnectUDPClientSocket( socketFD, address ) ) return NULL;
-      break;
-    default: fprintf( stderr, "invalid connection type: %x\n", connectionType );
-      return NULL;
-  } 
-  
-  // Build the IPConnection structure
-  IPConnection newConnection =  AddConnection( socketFD, address, (connectionType & TRANSPORT_MASK), (connectionType & ROLE_MASK) );
+    Stats_AddCount( &(connection->stats.writeErrorsCount), messagesCount );
+    return;
+  }
   
-  if( newConnection != NULL )
+  StreamOutput output = &(connection->outputBuffer);
+  output->messagesList = (Message*) realloc( output->messagesList, ( output->messagesCount + messagesCount ) * sizeof(Message) );
+  for( size_t messageIndex = 0; messageIndex < messagesCount; messageIndex++ )
   {
-    globalConnectionsList = (IPConnection*) realloc( globalConnectionsList, (activeConnectionsCount + 1 ) * sizeof(IPConnection) );
-    globalConnectionsList[ activeConnectionsCount ] = newConnection;
-    if( activeConnectionsCount == 0 )
-    {
-      globalReadThread = Thread_Start( AsyncReadQueues, NULL, THREAD_JOINABLE );
-      globalWriteThread = Thread_Start( AsyncWriteQueues, NULL, THREAD_JOINABLE );
-    }
-    activeConnectionsCount++;
+    Message message = messagesList[ messageIndex ];
+    if( connection->frameHeaderLength > 0 ) SetFrameHeader( message );
+    output->messagesList[ output->messagesCount++ ] = RetainMessage( message );
+    output->queuedLength += connection->frameHeaderLength + message->length;
   }
   
-  return (void*) newConnection;
+  FlushTCPClientOutput( connection, NULL );
 }
 
-///////////////////////////////////////////////////////////////////////////////////////////////////////////
-/////                                     ASYNCRONOUS UPDATE                                          /////
-///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Try to receive incoming message from the given UDP client connection and store it on its buffer
+static void ReceiveUDPClientMessage( IPConnection connection, SocketPoller* socket )
+{
+  (void) socket;
+  ReceiveDatagrams( connection );
+}
+
+// Send given message through the given UDP connection
+static void SendUDPClientMessages( IPConnection connection, Message* messagesList, size_t messagesCount )
+{
+  SendDatagrams( connection, messagesList, messagesCount, &(connection->addressData), 1 );
+  connection->lastSendTime = Stats_GetTimeNS();
+}
 
-// Loop of message reading (storing in queue) to be called asyncronously for client/server connections
-static void* AsyncReadQueues( void* args )
+// Queue given messages on the output buffer of a TCP server client and write as much of it as possible. Returns false if the
+// client should be disconnected, as its buffer limit would be exceeded (slow consumer) or its stream became invalid
+static bool WriteTCPClientMessages( IPConnection server, TCPClient client, Message* messagesList, size_t messagesCount )
 {
-  isNetworkRunning = true;
+  StreamOutput output = &(client->outputBuffer);
   
-  while( isNetworkRunning )
-  { 
-    // Blocking call
-    #ifndef IP_NETWORK_LEGACY
-    int eventsNumber = poll( polledSocketsList, polledSocketsNumber, EVENT_WAIT_TIME_MS );
-    #else
-    struct timeval waitTime = { .tv_sec = EVENT_WAIT_TIME_MS / 1000, .tv_usec = ( EVENT_WAIT_TIME_MS % 1000 ) * 1000 };
-    activeSocketsSet = polledSocketsSet;
-    int eventsNumber = select( polledSocketsNumber, &activeSocketsSet, NULL, NULL, &waitTime );
-    #endif
-    if( eventsNumber == SOCKET_ERROR ) fprintf( stderr, "select: error waiting for events on %lu FDs\n", polledSocketsNumber );
-    
-    if( eventsNumber > 0 ) 
+  output->messagesList = (Message*) realloc( output->messagesList, ( output->messagesCount + messagesCount ) * sizeof(Message) );
+  for( size_t messageIndex = 0; messageIndex < messagesCount; messageIndex++ )
+  {
+    size_t frameLength = server->frameHeaderLength + messagesList[ messageIndex ]->length;
+    // A single frame is always accepted, so that small limits don't refuse large messages
+    if( output->messagesCount > 0 && output->queuedLength + frameLength > server->outputBufferSize )
     {
-      for( size_t connectionIndex = 0; connectionIndex < activeConnectionsCount; connectionIndex++ )
-      {
-        IPConnection connection = globalConnectionsList[ connectionIndex ];
-        if( connection == NULL ) continue;
-        
-        connection->ref_ReceiveMessage( connection );
-      }
+      fprintf( stderr, "send: output buffer of socket %d full (%zu bytes pending)\n", client->socket->fd, output->queuedLength );
+      Stats_AddCount( &(server->stats.writeErrorsCount), output->messagesCount + messagesCount - messageIndex );
+      return false;
     }
+    output->messagesList[ output->messagesCount++ ] = RetainMessage( messagesList[ messageIndex ] );
+    output->queuedLength += frameLength;
   }
   
-  return NULL;
+  return FlushStreamOutput( client->socket, output );
 }
 
-// Loop of message writing (removing in order from queue) to be called asyncronously for client connections
-static void* AsyncWriteQueues( void* args )
+// Send given messages to all the clients of the given TCP server connection, except for replies, which only go to the client
+// that sent the request. Each client has its own output buffer, so that clients not reading fast enough don't hold the other ones
+static void SendTCPServerMessages( IPConnection connection, Message* messagesList, size_t messagesCount )
 {
-  Message messageOut;
+  Message clientMessagesList[ SEND_BATCH_LENGTH ];
   
-  isNetworkRunning = true;
+  size_t repliesCount = 0, repliesSentCount = 0;
+  for( size_t messageIndex = 0; messageIndex < messagesCount; messageIndex++ )
+  {
+    if( connection->frameHeaderLength > 0 ) SetFrameHeader( messagesList[ messageIndex ] );
+    if( messagesList[ messageIndex ]->peerID != 0 ) repliesCount++;
+  }
   
-  while( isNetworkRunning )
+  size_t clientIndex = 0;
+  while( clientIndex < connection->remotesCount )
   {
-    for( size_t connectionIndex = 0; connectionIndex < activeConnectionsCount; connectionIndex++ )
+    TCPClient client = connection->clientsList[ clientIndex ];
+    size_t clientMessagesCount = messagesCount;
+    if( repliesCount > 0 )
     {
-      IPConnection connection = globalConnectionsList[ connectionIndex ];
-      if( connection == NULL ) continue;
-
-      // Do not proceed if queue is empty
-      if( TSQ_GetItemsCount( connection->writeQueue ) == 0 ) continue;
-      
-      memset( &(messageOut), 0, sizeof(Message) );
-      
-      TSQ_Dequeue( connection->writeQueue, (void*) &messageOut, TSQUEUE_WAIT );
-      
-      connection->ref_SendMessage( connection, (const uint8_t*) messageOut );
+      clientMessagesCount = 0;
+      for( size_t messageIndex = 0; messageIndex < messagesCount; messageIndex++ )
+      {
+        uint64_t peerID = messagesList[ messageIndex ]->peerID;
+        if( peerID != 0 && peerID != client->peerID ) continue;
+        clientMessagesList[ clientMessagesCount++ ] = messagesList[ messageIndex ];
+        if( peerID != 0 ) repliesSentCount++;
+      }
     }
-    
-// Sleep for 1 millisecond
-#ifdef _WIN32
-    Sleep( 1 );
-#else
-    usleep( 1000 );
-#endif
+    Message* sentMessagesList = ( repliesCount > 0 ) ? clientMessagesList : messagesList;
+    if( clientMessagesCount == 0 || WriteTCPClientMessages( connection, client, sentMessagesList, clientMessagesCount ) ) clientIndex++;
+    else RemoveTCPClient( connection, client ); // Replaced by the last client of the list
   }
   
-  return NULL;
+  // Remotes disconnected before getting their replies
+  if( repliesSentCount < repliesCount ) Stats_AddCount( &(connection->stats.writeErrorsCount), repliesCount - repliesSentCount );
 }
 
-///////////////////////////////////////////////////////////////////////////////////////////////////////////
-/////                                      SYNCRONOUS UPDATE                                          /////
-///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send given message to all the clients of the given server connection
+static void SendUDPServerMessages( IPConnection connection, Message* messagesList, size_t messagesCount )
+{
+  ExpireUDPPeers( connection, Stats_GetTimeNS() );
+  SendDatagrams( connection, messagesList, messagesCount, connection->addressesList, connection->remotesCount );
+}
 
-// Get (and remove) message from the beginning (oldest) of the given index corresponding read queue
-// Method to be called from the main thread
-bool IP_ReceiveMessage( void* ref_connection, uint8_t* message )
-{  
-  if( ref_connection == NULL ) return false;
-  IPConnection connection = (IPConnection) ref_connection;
-  //if( bsearch( connection, globalConnectionsList, activeConnectionsCount, sizeof(IPConnection), CompareConnections ) == NULL ) return false;
-    
-  if( TSQ_GetItemsCount( connection->readQueue ) == 0 ) return false;
+// Add accepted socket to the client list of the given TCP server connection
+static void AddTCPClient( IPConnection server, Socket clientSocketFD )
+{
+  // Accepted sockets don't inherit the non-blocking state on every system, and writes should never hold the reactor
+  if( !SetSocketConfig( clientSocketFD ) ) return;
+  
+  TCPClient newClient = (TCPClient) malloc( sizeof(TCPClientData) );
+  memset( newClient, 0, sizeof(TCPClientData) );
+  server->clientsList = (TCPClient*) realloc( server->clientsList, ++server->remotesCount * sizeof(TCPClient) );
+  server->clientsList[ server->remotesCount - 1 ] = newClient;
+  newClient->peerID = ++server->lastPeerID;
+  newClient->socket = AddSocketPoller( server->reactor, clientSocketFD, server, newClient );
+}
 
-  TSQ_Dequeue( connection->readQueue, (void*) message, TSQUEUE_WAIT );
+// Waits for a remote connection to be added to the client list of the given TCP server connection
+static void ReceiveTCPServerMessages( IPConnection server, SocketPoller* socket )
+{ 
+  if( socket == server->socket )
+  {
+    Socket clientSocketFD = accept( server->socket->fd, NULL, NULL );
+    if( clientSocketFD == INVALID_SOCKET )
+      fprintf( stderr, "accept: failed accepting connection on socket %d\n", server->socket->fd );
+    else
+      AddTCPClient( server, clientSocketFD );
+    return;
+  }
   
-  return true;
+  TCPClient client = socket->client;
+  if( !ReadStreamMessages( client->socket->fd, &(client->inputBuffer), server, client->peerID ) ) RemoveTCPClient( server, client );
 }
 
-bool IP_SendMessage( void* ref_connection, const uint8_t* message )
-{  
-  if( ref_connection == NULL ) return false;
-  IPConnection connection = (IPConnection) ref_connection;
-  //if( bsearch( connection, globalConnectionsList, activeConnectionsCount, sizeof(IPConnection), CompareConnections ) == NULL ) return false;
-  
-  if( TSQ_GetItemsCount( connection->writeQueue ) >= QUEUE_MAX_ITEMS )
-    fprintf( stderr, "connection %p write queue is full\n", connection );
-  
-  TSQ_Enqueue( connection->writeQueue, (void*) message, TSQUEUE_NOWAIT );
+// Write frames pending for the given TCP server client (or the given TCP client connection itself, if NULL). Returns false
+// if it was disconnected
+static bool FlushTCPClientOutput( IPConnection connection, TCPClient client )
+{
+  SocketPoller* socket = ( client != NULL ) ? client->socket : connection->socket;
+  StreamOutput output = ( client != NULL ) ? &(client->outputBuffer) : &(connection->outputBuffer);
+  if( FlushStreamOutput( socket, output ) ) return true;
   
-  return true;
+  Stats_AddCount( &(connection->stats.writeErrorsCount), output->messagesCount );
+  if( client != NULL )
+  {
+    RemoveTCPClient( connection, client );
+    return false;
+  }
+  DiscardStreamOutput( output );
+  RemoveSocket( socket );
+  return false;
 }
 
-// Verify available incoming messages for the given connection, preventing unnecessary blocking calls (for syncronous networking)
-int WaitEvents( unsigned int milliseconds )
+// Hash of host address and port (FNV-1a), ignoring unused bytes of the address structure
+static uint32_t GetAddressHash( IPAddress address )
 {
+  const uint8_t* hostData = (const uint8_t*) &(((struct sockaddr_in*) address)->sin_addr);
+  size_t hostLength = sizeof(struct in_addr);
+  uint16_t portNumber = ((struct sockaddr_in*) address)->sin_port;
   #ifndef IP_NETWORK_LEGACY
-  int eventsNumber = poll( polledSocketsList, polledSocketsNumber, milliseconds );
-  #else
-  struct timeval waitTime = { .tv_sec = milliseconds / 1000, .tv_usec = ( milliseconds % 1000 ) * 1000 };
-  activeSocketsSet = polledSocketsSet;
-  int eventsNumber = select( polledSocketsNumber, &activeSocketsSet, NULL, NULL, &waitTime );
+  if( address->sa_family == AF_INET6 )
+  {
+    hostData = ((struct sockaddr_in6*) address)->sin6_addr.s6_addr;
+    hostLength = sizeof(struct in6_addr);
+    portNumber = ((struct sockaddr_in6*) address)->sin6_port;
+  }
   #endif
-  if( eventsNumber == SOCKET_ERROR ) fprintf( stderr, "select: error waiting for events on %lu FDs\n", polledSocketsNumber );
+  #ifdef IP_LOCAL_SOCKETS
+  if( IS_LOCAL_ADDRESS( address ) )
+  {
+    hostData = (const uint8_t*) ((struct sockaddr_un*) address)->sun_path;
+    hostLength = GetAddressLength( address ) - offsetof( struct sockaddr_un, sun_path );
+    portNumber = 0;
+  }
+  #endif
+  
+  uint32_t hash = 2166136261u;
+  for( size_t byteIndex = 0; byteIndex < hostLength; byteIndex++ )
+    hash = ( hash ^ hostData[ byteIndex ] ) * 16777619u;
+  hash = ( hash ^ ( portNumber & 0xFF ) ) * 16777619u;
+  hash = ( hash ^ ( portNumber >> 8 ) ) * 16777619u;
   
-  return eventsNumber;
+  return hash;
 }
 
-bool IsDataAvailable( SocketPoller* socket )
-{ 
-  #ifndef IP_NETWORK_LEGACY
-  if( socket->revents & POLLRDNORM ) return true;
-  else if( socket->revents & POLLRDBAND ) return true;
-  #else
-  if( FD_ISSET( socket->fd, &activeSocketsSet ) ) return true;
-  #endif
+// Find the table slot of given address (with the given hash) among the remotes of a UDP server, or the empty slot where it should be added
+static size_t FindUDPPeerSlot( IPConnection server, IPAddress address, uint32_t hash )
+{
+  size_t slotMask = server->peersTableSize - 1;
+  size_t slotIndex = hash & slotMask;
+  while( server->peersTable[ slotIndex ] != 0 )
+  {
+    if( ARE_EQUAL_IP_ADDRESSES( &(server->addressesList[ server->peersTable[ slotIndex ] - 1 ]), address ) ) break;
+    slotIndex = ( slotIndex + 1 ) & slotMask;
+  }
   
-  return false;
+  return slotIndex;
 }
 
-/////////////////////////////////////////////////////////////////////////////////////////
-/////                      SPECIFIC TRANSPORT/ROLE COMMUNICATION                    /////
-/////////////////////////////////////////////////////////////////////////////////////////
+// Get position of the UDP server remote with the given identifier, or NULL if it's not registered (anymore)
+static IPAddressData* FindUDPPeerAddress( IPConnection server, uint64_t peerID )
+{
+  if( server->peersTableSize == 0 ) return NULL;
+  // Identifiers carry the address hash, so the remote is on the same probing sequence as for its address
+  size_t slotMask = server->peersTableSize - 1;
+  size_t slotIndex = ( peerID >> 32 ) & slotMask;
+  while( server->peersTable[ slotIndex ] != 0 )
+  {
+    size_t peerIndex = server->peersTable[ slotIndex ] - 1;
+    if( server->peerIDsList[ peerIndex ] == peerID ) return &(server->addressesList[ peerIndex ]);
+    slotIndex = ( slotIndex + 1 ) & slotMask;
+  }
+  
+  return NULL;
+}
 
-static void RemoveSocket( Socket );
+// Index all remotes of a UDP server again, after the table is resized or remotes are removed
+static void RebuildUDPPeersTable( IPConnection server )
+{
+  memset( server->peersTable, 0, server->peersTableSize * sizeof(uint32_t) );
+  for( size_t peerIndex = 0; peerIndex < server->remotesCount; peerIndex++ )
+  {
+    uint32_t hash = (uint32_t) ( server->peerIDsList[ peerIndex ] >> 32 );
+    size_t slotIndex = FindUDPPeerSlot( server, (IPAddress) &(server->addressesList[ peerIndex ]), hash );
+    server->peersTable[ slotIndex ] = (uint32_t) ( peerIndex + 1 );
+  }
+}
 
-// Try to receive incoming message from the given TCP client connection and store it on its buffer
-static void ReceiveTCPClientMessage( IPConnection connection )
+// Stop sending messages to remotes of a UDP server that haven't sent anything for a while. Remaining ones keep their order
+static void ExpireUDPPeers( IPConnection server, uint64_t currentTime )
 {
-  static Message messageIn;
+  const uint64_t CHECK_TIME_NS = UDP_PEERS_CHECK_TIME_MS * 1000000ULL, IDLE_TIME_NS = UDP_PEER_IDLE_TIME_MS * 1000000ULL;
   
-  if( connection->socket->fd == INVALID_SOCKET ) return;
-
-  //if( TSQ_GetItemsCount( connection->readQueue ) >= QUEUE_MAX_ITEMS ) return;
+  if( currentTime - server->lastPeersCheckTime < CHECK_TIME_NS ) return;
+  server->lastPeersCheckTime = currentTime;
   
-  if( IsDataAvailable( connection->socket ) == false ) return;
+  size_t activePeersCount = 0;
+  for( size_t peerIndex = 0; peerIndex < server->remotesCount; peerIndex++ )
+  {
+    if( currentTime - server->peerTimesList[ peerIndex ] > IDLE_TIME_NS ) continue;
+    server->addressesList[ activePeersCount ] = server->addressesList[ peerIndex ];
+    server->peerIDsList[ activePeersCount ] = server->peerIDsList[ peerIndex ];
+    server->peerTimesList[ activePeersCount++ ] = server->peerTimesList[ peerIndex ];
+  }
+  if( activePeersCount == server->remotesCount ) return;
   
-  // Blocks until there is something to be read in the socket
-  int bytesReceived = recv( connection->socket->fd, (void*) messageIn, IP_MAX_MESSAGE_LENGTH, 0 );
+  fprintf( stderr, "%s: %zu idle remotes removed\n", __func__, server->remotesCount - activePeersCount );
+  server->remotesCount = activePeersCount;
+  RebuildUDPPeersTable( server );
+}
 
-  if( bytesReceived == SOCKET_ERROR )
+// Register (or refresh) the given remote of a UDP server, so that it gets sent messages. Returns the remote identifier
+static uint64_t UpdateUDPPeer( IPConnection server, IPAddress address, uint64_t currentTime )
+{
+  // Keep at most half the slots used, so that probing stays short
+  if( 2 * ( server->remotesCount + 1 ) > server->peersTableSize )
   {
-    fprintf( stderr, "recv: error reading from socket %d\n", connection->socket->fd );
-    //connection->socket->fd = INVALID_SOCKET;
-    //RemoveSocket( connection->socket->fd );
-    return;
+    server->peersTableSize = ( server->peersTableSize > 0 ) ? 2 * server->peersTableSize : UDP_PEERS_MIN_TABLE_SIZE;
+    server->peersTable = (uint32_t*) realloc( server->peersTable, server->peersTableSize * sizeof(uint32_t) );
+    server->addressesList = (IPAddressData*) realloc( server->addressesList, server->peersTableSize / 2 * sizeof(IPAddressData) );
+    server->peerIDsList = (uint64_t*) realloc( server->peerIDsList, server->peersTableSize / 2 * sizeof(uint64_t) );
+    server->peerTimesList = (uint64_t*) realloc( server->peerTimesList, server->peersTableSize / 2 * sizeof(uint64_t) );
+    RebuildUDPPeersTable( server );
   }
-  else if( bytesReceived == 0 )
+  
+  uint32_t hash = GetAddressHash( address );
+  size_t slotIndex = FindUDPPeerSlot( server, address, hash );
+  if( server->peersTable[ slotIndex ] == 0 )
   {
-    fprintf( stderr, "recv: remote connection with socket %d closed\n", connection->socket->fd );
-    //connection->socket->fd = INVALID_SOCKET;
-    RemoveSocket( connection->socket->fd );
-    return;
+    // Remotes coming back after expiring get a new identifier (lower 32 bits never 0)
+    if( (uint32_t) ++server->lastPeerID == 0 ) server->lastPeerID++;
+    memcpy( &(server->addressesList[ server->remotesCount ]), address, sizeof(IPAddressData) );
+    server->peerIDsList[ server->remotesCount ] = ( (uint64_t) hash << 32 ) | (uint32_t) server->lastPeerID;
+    server->peersTable[ slotIndex ] = (uint32_t) ++server->remotesCount;
   }
+  size_t peerIndex = server->peersTable[ slotIndex ] - 1;
+  server->peerTimesList[ peerIndex ] = currentTime;
   
-  TSQ_Enqueue( connection->readQueue, &(messageIn), TSQUEUE_WAIT );
+  return server->peerIDsList[ peerIndex ];
 }
 
-// Send given message through the given TCP connection
-static void SendTCPClientMessage( IPConnection connection, const uint8_t* message )
+// Register the remotes of datagrams received by the given UDP server connection (already read by the reactor)
+static void ReceiveUDPServerMessages( IPConnection server, SocketPoller* socket )
 {
-  if( send( connection->socket->fd, (void*) message, IP_MAX_MESSAGE_LENGTH, 0 ) == SOCKET_ERROR )
-    fprintf( stderr, "send: error writing to socket %d\n", connection->socket->fd );
+  (void) socket;
+  ReceiveDatagrams( server );
+  
+  ExpireUDPPeers( server, Stats_GetTimeNS() );
 }
 
-// Try to receive incoming message from the given UDP client connection and store it on its buffer
-static void ReceiveUDPClientMessage( IPConnection connection )
+#ifdef IP_EVENTS_RING
+// Enqueue frames from stream data received on a ring buffer, parsed in place unless a partial frame is waiting for the rest
+// of its data on the given stream buffer. Returns false if the stream became invalid (and should be discarded)
+static bool ReceiveStreamData( Socket socketFD, StreamBuffer buffer, IPConnection connection, uint64_t peerID, const uint8_t* data, size_t length )
 {
-  static Message messageIn;
-  
-  if( IsDataAvailable( connection->socket ) == false ) return;
-  
-  // Blocks until there is something to be read in the socket
-  IPAddressData address;
-  socklen_t addressLength = sizeof(IPAddressData);
-  if( recvfrom( connection->socket->fd, (void*) messageIn, IP_MAX_MESSAGE_LENGTH, 0, (IPAddress) &(address), &addressLength ) == SOCKET_ERROR )
+  size_t frameOffset = 0, framesCount = 0;
+  if( buffer->length == 0 )
   {
-    //fprintf( stderr, "recvfrom: error reading from socket %d", connection->socket->fd );
-    return;
+    if( !ExtractStreamFrames( socketFD, data, length, connection, peerID, &frameOffset, &framesCount ) ) return false;
+    data += frameOffset;
+    length -= frameOffset;
   }
+  
+  // Ring buffers may be larger than the room left after a partial frame
+  if( length > 0 && buffer->data == NULL ) buffer->data = (uint8_t*) malloc( STREAM_BUFFER_CAPACITY );
+  while( length > 0 )
+  {
+    size_t chunkLength = STREAM_BUFFER_CAPACITY - buffer->length;
+    if( chunkLength > length ) chunkLength = length;
+    memcpy( buffer->data + buffer->length, data, chunkLength );
+    buffer->length += chunkLength;
+    data += chunkLength;
+    length -= chunkLength;
     
-  TSQ_Enqueue( connection->readQueue, &(messageIn), TSQUEUE_WAIT );
-}
-
-// Send given message through the given UDP connection
-static void SendUDPClientMessage( IPConnection connection, const uint8_t* message )
-{
-  if( sendto( connection->socket->fd, message, IP_MAX_MESSAGE_LENGTH, 0, (IPAddress) &(connection->addressData), sizeof(IPAddressData) ) == SOCKET_ERROR )
-    fprintf( stderr, "sendto: error writing to socket %d\n", connection->socket->fd );
+    if( !ExtractStreamFrames( socketFD, buffer->data, buffer->length, connection, peerID, &frameOffset, &framesCount ) ) return false;
+    buffer->length -= frameOffset;
+    if( buffer->length > 0 && frameOffset > 0 ) memmove( buffer->data, buffer->data + frameOffset, buffer->length );
+  }
+  UpdateReceiveCounters( connection, framesCount );
+  
+  return true;
 }
 
-// Send given message to all the clients of the given TCP server connection
-static void SendTCPServerMessages( IPConnection connection, const uint8_t* message )
+// Enqueue datagram received on a ring buffer, laid out as the receive header, the source address and then the payload
+static void ReceiveRingDatagram( EventsRing ring, IPConnection connection, const uint8_t* data, size_t length )
 {
-  for( size_t clientIndex = 0; clientIndex < connection->remotesCount; clientIndex++ )
-  {
-    SocketPoller* clientSocket = (SocketPoller*) connection->clientsList[ clientIndex ];
-    if( send( clientSocket->fd, message, IP_MAX_MESSAGE_LENGTH, 0 ) == SOCKET_ERROR )
-      fprintf( stderr, "send: error writing to socket %d\n", clientSocket->fd );
-  }
+  const struct io_uring_recvmsg_out* header = (const struct io_uring_recvmsg_out*) data;
+  const uint8_t* payload = data + sizeof(struct io_uring_recvmsg_out) + ring->datagramHeader.msg_namelen;
+  size_t payloadLength = length - ( payload - data );
+  if( header->payloadlen < payloadLength ) payloadLength = header->payloadlen;
+  
+  IPAddress address = (IPAddress) &(connection->reactor->datagramsBatch->addressesList[ 0 ]);
+  socklen_t addressLength = ( header->namelen < sizeof(IPAddressData) ) ? header->namelen : sizeof(IPAddressData);
+  memcpy( address, data + sizeof(struct io_uring_recvmsg_out), addressLength );
+  
+  Message message = CreateMessage( payload, payloadLength );
+  uint64_t receiveTime = message->queueTime;
+  EnqueueDatagram( connection, message, address, addressLength );
+  UpdateReceiveCounters( connection, 1 );
+  
+  if( connection->ref_ReceiveMessage == ReceiveUDPServerMessages ) ExpireUDPPeers( connection, receiveTime );
 }
 
-// Send given message to all the clients of the given server connection
-static void SendUDPServerMessages( IPConnection connection, const uint8_t* message )
+// Handle completion of the read request of given socket: new connection, received data or end of the request (after
+// errors, cancelation or lack of free buffers), restarted unless the connection is paused. Returns true if data was enqueued
+static bool ProcessRingRead( EventsRing ring, SocketPoller* socket, struct io_uring_cqe* completion )
 {
-  for( size_t clientIndex = 0; clientIndex < connection->remotesCount; clientIndex++ )
+  IPConnection connection = socket->connection;
+  const uint8_t* data = NULL;
+  uint16_t bufferID = (uint16_t) ( completion->flags >> IORING_CQE_BUFFER_SHIFT );
+  if( completion->flags & IORING_CQE_F_BUFFER ) data = ring->buffersData + bufferID * RING_BUFFER_LENGTH;
+  if( !( completion->flags & IORING_CQE_F_MORE ) ) socket->ringRequests &= ~( RING_READ | RING_CANCEL );
+  
+  bool isDatagram = ( connection->ref_ReceiveMessage == ReceiveUDPClientMessage || connection->ref_ReceiveMessage == ReceiveUDPServerMessages );
+  bool isValid = true, hasData = false;
+  if( connection->ref_ReceiveMessage == ReceiveTCPServerMessages && socket->client == NULL )
   {
-    socklen_t addressLength = sizeof(IPAddressData);
-    IPAddress clientAddress = (IPAddress) &(connection->addressesList[ clientIndex ]);
-    if( sendto( connection->socket->fd, (void*) message, IP_MAX_MESSAGE_LENGTH, 0, clientAddress, addressLength ) == SOCKET_ERROR )
-      fprintf( stderr, "send: error writing to socket %d\n", connection->socket->fd );
+    if( completion->res >= 0 ) AddTCPClient( connection, (Socket) completion->res );
+    else if( completion->res != -ECANCELED ) fprintf( stderr, "accept: failed accepting connection on socket %d\n", socket->fd );
   }
-}
-
-// Waits for a remote connection to be added to the client list of the given TCP server connection
-static void ReceiveTCPServerMessages( IPConnection server )
-{ 
-  static Message messageIn;
-  
-  if( IsDataAvailable( server->socket ) )
+  else if( completion->res < 0 )
   {
-    Socket clientSocketFD = accept( server->socket->fd, NULL, NULL );
-    if( clientSocketFD == INVALID_SOCKET )
-      fprintf( stderr, "accept: failed accepting connection on socket %d\n", server->socket->fd );
-    else
+    // Running out of free buffers only ends the request. Datagram sockets are also kept after errors (like refused connections)
+    if( completion->res != -ENOBUFS && completion->res != -ECANCELED )
     {
-      server->clientsList = (SocketPoller**) realloc( server->clientsList, ++server->remotesCount * sizeof(SocketPoller*) );
-      server->clientsList[ server->remotesCount - 1 ] = AddSocketPoller( clientSocketFD );
+      fprintf( stderr, "%s: error reading from socket %d\n", isDatagram ? "recvmsg" : "recv", socket->fd );
+      isValid = isDatagram;
     }
   }
-  
-  for( size_t clientIndex = 0; clientIndex < server->remotesCount; clientIndex++ )
+  else if( isDatagram )
+  {
+    if( data != NULL ) ReceiveRingDatagram( ring, connection, data, completion->res );
+    hasData = ( data != NULL );
+  }
+  else
   {
-    SocketPoller* clientSocket = (SocketPoller*) server->clientsList[ clientIndex ];
-    if( IsDataAvailable( clientSocket ) )
+    StreamBuffer buffer = ( socket->client != NULL ) ? &(socket->client->inputBuffer) : &(connection->inputBuffer);
+    uint64_t peerID = ( socket->client != NULL ) ? socket->client->peerID : 0;
+    #ifdef IP_LOCAL_SOCKETS
+    if( connection->frameHeaderLength == 0 )
     {
-      int bytesReceived = recv( clientSocket->fd, (void*) messageIn, IP_MAX_MESSAGE_LENGTH, 0 );
-      if( bytesReceived == SOCKET_ERROR ) 
-      {
-        fprintf( stderr, "recv: error reading from socket %d\n", clientSocket->fd );
-        continue;
-      }
-      else if( bytesReceived == 0 )
+      isValid = ( completion->res > 0 || !IsPacketStreamClosed( socket->fd ) );
+      if( isValid && data != NULL )
       {
-        fprintf( stderr, "recv: remote connection with socket %d closed\n", clientSocket->fd );
-        clientSocket->fd = INVALID_SOCKET;
-        continue;
+        Message message = CreateMessage( data, completion->res );
+        message->peerID = peerID;
+        EnqueueReceivedMessage( connection, message );
+        UpdateReceiveCounters( connection, 1 );
+        hasData = true;
       }
-
-      TSQ_Enqueue( server->readQueue, &(messageIn), TSQUEUE_WAIT );
+    }
+    else
+    #endif
+    if( completion->res == 0 )
+    {
+      fprintf( stderr, "recv: remote connection with socket %d closed\n", socket->fd );
+      isValid = false;
+    }
+    else if( data != NULL )
+    {
+      isValid = ReceiveStreamData( socket->fd, buffer, connection, peerID, data, completion->res );
+      hasData = true;
     }
   }
-}
-
-// Waits for a remote connection to be added to the client list of the given UDP server connection
-static void ReceiveUDPServerMessages( IPConnection server )
-{
-  static Message messageIn;
   
-  if( IsDataAvailable( server->socket ) == false ) return;
+  // Handlers may submit requests (e.g. for accepted clients) and the kernel could fill a recycled buffer right away,
+  // so it's only handed back once its data is copied to messages or stream buffers
+  if( data != NULL ) RecycleRingBuffer( ring, bufferID );
   
-  IPAddressData addressData;
-  socklen_t addressLength = sizeof(IPAddressData);
-  if( recvfrom( server->socket->fd, (void*) messageIn, IP_MAX_MESSAGE_LENGTH, 0, (IPAddress) &(addressData), &addressLength ) == SOCKET_ERROR )
+  if( !isValid )
   {
-    fprintf( stderr, "recvfrom: error reading from socket %d\n", server->socket->fd );
-    return;
+    if( socket->client != NULL ) RemoveTCPClient( connection, socket->client );
+    else RemoveSocket( socket );
+    return hasData;
   }
   
-  TSQ_Enqueue( server->readQueue, &(messageIn), TSQUEUE_WAIT );
+  if( !( socket->ringRequests & RING_READ ) && !IsSocketPaused( socket ) ) SubmitRingRead( ring, socket );
   
-  // Verify if incoming message belongs to unregistered client (returns default value if not)
-  for( size_t clientIndex = 0; clientIndex < server->remotesCount; clientIndex++ )
+  return hasData;
+}
+
+// Handle completion of the write request of given socket, writing pending output (and waiting again if some is left).
+// Returns true if output was written, so that messages held on write queues are taken again
+static bool ProcessRingWrite( EventsRing ring, SocketPoller* socket )
+{
+  socket->ringRequests &= ~RING_WRITE;
+  if( !socket->isWriting ) return false;
+  // Failures discard the remote client (along with its socket)
+  if( !FlushTCPClientOutput( socket->connection, socket->client ) ) return false;
+  if( socket->isWriting && !( socket->ringRequests & RING_WRITE ) ) SubmitRingWrite( ring, socket );
+  return true;
+}
+
+// Submit queued requests and wait for completions on the given reactor ring, handling them right away. Only the wake up
+// notification is stored as a ready poller, and write queues are checked if sockets became writable or nothing happened
+static size_t WaitRingEvents( Reactor reactor, SocketPoller** readyPollersList, unsigned long milliseconds, bool* ref_hasWriteEvent )
+{
+  EventsRing ring = reactor->eventsRing;
+  struct __kernel_timespec waitTime = { .tv_sec = milliseconds / 1000, .tv_nsec = ( milliseconds % 1000 ) * 1000000 };
+  struct io_uring_getevents_arg waitArguments = { .ts = (uint64_t) (uintptr_t) &waitTime };
+  
+  // Requests queued by other threads after this point are submitted on the next wait (they signal the reactor)
+  if( ring->overflowCount > 0 ) FlushRingOverflow( ring );
+  uint32_t submissionsCount = atomic_load_explicit( ring->submissionTail, memory_order_acquire ) - atomic_load_explicit( ring->submissionHead, memory_order_acquire );
+  pthread_mutex_unlock( &(reactor->lock) );
+  int waitResult = (int) syscall( __NR_io_uring_enter, ring->fd, submissionsCount, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                                  &waitArguments, sizeof(struct io_uring_getevents_arg) );
+  int waitError = errno;
+  pthread_mutex_lock( &(reactor->lock) );
+  if( waitResult == SOCKET_ERROR && waitError != ETIME && waitError != EINTR ) fprintf( stderr, "%s: error waiting for ring events\n", __func__ );
+  
+  size_t readyPollersNumber = 0;
+  bool hasReadEvents = false, hasWriteEvents = false, hasCompletions = false;
+  uint32_t head = atomic_load_explicit( ring->completionHead, memory_order_relaxed );
+  while( head != atomic_load_explicit( ring->completionTail, memory_order_acquire ) )
   {
-    if( ARE_EQUAL_IP_ADDRESSES( &(server->addressesList[ clientIndex ]), &(addressData) ) )
-      return;
+    // Handlers may queue new requests, so that entries are copied and released first
+    struct io_uring_cqe completion = ring->completionsList[ head & ring->completionMask ];
+    atomic_store_explicit( ring->completionHead, ++head, memory_order_release );
+    hasCompletions = true;
+    
+    SocketPoller* socket = GetRingRequestSocket( ring, completion.user_data );
+    if( socket == NULL )
+    {
+      // Requests of removed sockets (and cancelations) only have their buffers recycled
+      if( completion.flags & IORING_CQE_F_BUFFER ) RecycleRingBuffer( ring, (uint16_t) ( completion.flags >> IORING_CQE_BUFFER_SHIFT ) );
+      continue;
+    }
+    if( ( completion.user_data & 0x07 ) == RING_WRITE )
+    {
+      if( ProcessRingWrite( ring, socket ) ) hasWriteEvents = true;
+    }
+    else if( socket == reactor->writeEventPoller )
+    {
+      if( !( completion.flags & IORING_CQE_F_MORE ) ) socket->ringRequests &= ~RING_READ;
+      if( !( socket->ringRequests & RING_READ ) ) SubmitRingRead( ring, socket );
+      if( readyPollersNumber == 0 ) readyPollersList[ readyPollersNumber++ ] = socket;
+    }
+    else if( ProcessRingRead( ring, socket, &completion ) ) hasReadEvents = true;
   }
   
-  server->addressesList = (IPAddressData*) realloc( server->addressesList, ++server->remotesCount * sizeof(IPAddressData) );
-  memcpy( &(server->addressesList[ server->remotesCount - 1 ]), &(addressData), sizeof(IPAddressData) );
+  if( hasReadEvents ) SignalReceiveEvent();
+  *ref_hasWriteEvent = ( hasWriteEvents || !hasCompletions );
+  
+  return readyPollersNumber;
 }
+#endif
 
 
 //////////////////////////////////////////////////////////////////////////////////
@@ -876,80 +3041,167 @@ static void ReceiveUDPServerMessages( IPConnection server )
 
 // Handle proper destruction of any given connection type
 
-void RemoveSocket( Socket socketFD )
+// Stop receiving events for the given socket and close it (poller memory is released by its owner)
+void RemoveSocket( SocketPoller* socket )
 {
-  #ifndef IP_NETWORK_LEGACY
-  SocketPoller cmpPoller = { .fd = socketFD };
-  SocketPoller* poller = bsearch( &cmpPoller, polledSocketsList, polledSocketsNumber, sizeof(SocketPoller), CompareSockets );
-  if( poller != NULL )
+  if( socket->fd == INVALID_SOCKET ) return;
+  Reactor reactor = socket->connection->reactor;
+  #ifdef IP_EVENTS_EPOLL
+  #ifdef IP_EVENTS_RING
+  if( reactor->eventsRing != NULL ) RemoveRingSocket( reactor->eventsRing, socket );
+  else
+  #endif
+  epoll_ctl( reactor->eventsPollerFD, EPOLL_CTL_DEL, socket->fd, NULL );
+  #else
+  for( size_t pollerIndex = 0; pollerIndex < reactor->polledSocketsNumber; pollerIndex++ )
+  {
+    if( reactor->polledSocketsList[ pollerIndex ] != socket ) continue;
+    reactor->polledSocketsList[ pollerIndex ] = reactor->polledSocketsList[ --reactor->polledSocketsNumber ];
+    break;
+  }
+  #endif
+  close( socket->fd );
+  socket->fd = INVALID_SOCKET;
+}
+
+// Close the socket of given TCP server client and release its buffers (including frames not written yet)
+static void DiscardTCPClient( TCPClient client )
+{
+  RemoveSocket( client->socket );
+  free( client->socket );
+  free( client->inputBuffer.data );
+  DiscardStreamOutput( &(client->outputBuffer) );
+  free( client );
+}
+
+// Disconnect given client of a TCP server connection, replacing it with the last one of the clients list
+static void RemoveTCPClient( IPConnection server, TCPClient client )
+{
+  for( size_t clientIndex = 0; clientIndex < server->remotesCount; clientIndex++ )
   {
-    poller->fd = (Socket) 0xFFFF;
-    qsort( polledSocketsList, polledSocketsNumber, sizeof(SocketPoller), CompareSockets );
-    polledSocketsNumber--;
+    if( server->clientsList[ clientIndex ] != client ) continue;
+    server->clientsList[ clientIndex ] = server->clientsList[ --server->remotesCount ];
+    break;
   }
+  DiscardTCPClient( client );
+}
+
+// Remove the socket file bound by the given server connection, if it's local, so that its path can be used again
+static void RemoveLocalPath( IPConnection server )
+{
+  #ifdef IP_LOCAL_SOCKETS
+  const char* localPath = ((struct sockaddr_un*) &(server->addressData))->sun_path;
+  if( IS_LOCAL_ADDRESS( &(server->addressData) ) && localPath[ 0 ] != '\0' ) unlink( localPath );
   #else
-  FD_CLR( socketFD, &polledSocketsSet );
-  if( socketFD + 1 >= polledSocketsNumber ) polledSocketsNumber = socketFD - 1;
+  (void) server;
   #endif
-  close( socketFD );
 }
 
 void CloseTCPServer( IPConnection server )
 {
   for( size_t clientIndex = 0; clientIndex < server->remotesCount; clientIndex++ )
-    RemoveSocket( server->clientsList[ clientIndex ]->fd );
+    DiscardTCPClient( server->clientsList[ clientIndex ] );
   shutdown( server->socket->fd, SHUT_RDWR );
-  RemoveSocket( server->socket->fd );
+  RemoveSocket( server->socket );
+  RemoveLocalPath( server );
   if( server->clientsList != NULL ) free( server->clientsList );
 }
 
 void CloseUDPServer( IPConnection server )
 {
   // Check number of client connections of a server (also of sharers of a socket for UDP connections)
-  RemoveSocket( server->socket->fd );
+  RemoveSocket( server->socket );
+  RemoveLocalPath( server );
   if( server->addressesList != NULL ) free( server->addressesList );
+  free( server->peerIDsList );
+  free( server->peerTimesList );
+  free( server->peersTable );
 }
 
 void CloseTCPClient( IPConnection client )
 {
-  shutdown( client->socket->fd, SHUT_RDWR );
-  RemoveSocket( client->socket->fd );
+  if( client->socket->fd != INVALID_SOCKET ) shutdown( client->socket->fd, SHUT_RDWR );
+  RemoveSocket( client->socket );
+  free( client->inputBuffer.data );
+  DiscardStreamOutput( &(client->outputBuffer) );
 }
 
 void CloseUDPClient( IPConnection client )
 {
-  RemoveSocket( client->socket->fd );
+  RemoveSocket( client->socket );
 }
 
-static int CompareConnections( const void* connection_1, const void* connection_2 )
+// Stop all reactor threads and release their resources (only called after the last connection is closed)
+static void StopReactors( void )
 {
-  return ( ((IPConnection) connection_1)->socket - ((IPConnection) connection_2)->socket );
+  for( size_t reactorIndex = 0; reactorIndex < reactorsCount; reactorIndex++ )
+  {
+    Reactor reactor = &(reactorsList[ reactorIndex ]);
+    pthread_mutex_lock( &(reactor->lock) );
+    reactor->isRunning = false;
+    atomic_store( &(reactor->isWriteEventPending), false );
+    SignalWriteEvent( reactor );
+    pthread_mutex_unlock( &(reactor->lock) );
+    Thread_WaitExit( reactor->thread, 5000 );
+    
+    #ifdef IP_EVENTS_EPOLL
+    close( reactor->eventsPollerFD );
+    #ifdef IP_EVENTS_RING
+    if( reactor->eventsRing != NULL ) DiscardEventsRing( reactor->eventsRing );
+    #endif
+    #else
+    free( reactor->polledSocketsList );
+    #endif
+    #ifdef IP_EVENTS_POLL
+    free( reactor->pollRequestsList );
+    #endif
+    #ifndef WIN32
+    close( reactor->writeEventFDs[ 0 ] );
+    if( reactor->writeEventFDs[ 1 ] != reactor->writeEventFDs[ 0 ] ) close( reactor->writeEventFDs[ 1 ] );
+    #endif
+    free( reactor->writeEventPoller );
+    free( reactor->connectionsList );
+    for( size_t datagramIndex = 0; datagramIndex < RECEIVE_BATCH_LENGTH; datagramIndex++ )
+      ReleaseMessage( reactor->datagramsBatch->messagesList[ datagramIndex ] );
+    free( reactor->datagramsBatch );
+    pthread_cond_destroy( &(reactor->closeCondition) );
+    pthread_mutex_destroy( &(reactor->lock) );
+  }
+  free( reactorsList );
+  reactorsList = NULL;
+  
+  DiscardMessagePools();
 }
 
 void IP_CloseConnection( void* ref_connection )
 {
   if( ref_connection == NULL ) return;
   IPConnection connection = (IPConnection) ref_connection;
-  //if( bsearch( connection, globalConnectionsList, activeConnectionsCount, sizeof(IPConnection), CompareConnections ) == NULL ) return;
-  
-  // Each TCP connection has its own socket, so we can close it without problem. But UDP connections
-  // from the same server share the socket, so we need to wait for all of them to be stopped to close the socket
-  connection->ref_Close( connection );
-  
-  connection->socket = (SocketPoller*) 0xFFFF;
-  qsort( globalConnectionsList, activeConnectionsCount, sizeof(IPConnection), CompareConnections );
   
-  TSQ_Discard( connection->readQueue );
-  TSQ_Discard( connection->writeQueue );
+  // Sockets are only closed by the reactor thread, between event batches, so wait for it to release the connection
+  Reactor reactor = connection->reactor;
+  pthread_mutex_lock( &(reactor->lock) );
+  connection->isClosing = true;
+  SignalWriteEvent( reactor );
+  while( connection->reactor != NULL )
+    pthread_cond_wait( &(reactor->closeCondition), &(reactor->lock) );
+  pthread_mutex_unlock( &(reactor->lock) );
+  
+  free( connection->socket );
+  
+  for( size_t messageIndex = 0; messageIndex < connection->pendingMessagesCount; messageIndex++ )
+    ReleaseMessage( connection->pendingMessagesList[ messageIndex ] );
+  free( connection->pendingMessagesList );
+  DiscardMessageRing( connection->readQueue );
+  DiscardMessageRing( connection->writeQueue );
   free( connection );
   
-  globalConnectionsList = (IPConnection*) realloc( globalConnectionsList, --activeConnectionsCount * sizeof(IPConnection) );
-  if( activeConnectionsCount <= 0 )
+  pthread_mutex_lock( &connectionsLock );
+  reactor->assignedConnectionsCount--;
+  if( --activeConnectionsCount <= 0 )
   {
-    Thread_WaitExit( globalReadThread, 5000 );
-    Thread_WaitExit( globalWriteThread, 5000 );
-    free( globalConnectionsList );
-    globalConnectionsList = NULL;
+    StopReactors();
     activeConnectionsCount = 0;
   }
+  pthread_mutex_unlock( &connectionsLock );
 }
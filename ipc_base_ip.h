@@ -25,6 +25,9 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+#include "ipc_stats.h"
 
 #define IP_SERVER 0x01                  
 #define IP_CLIENT 0x02                  
@@ -32,15 +35,41 @@
 #define IP_TCP 0x10                    
 #define IP_UDP 0x20                     
 
+#define IP_QUEUE_DEFAULT 0x00           // Pause reading on full read queues, fail on full write queues
+#define IP_QUEUE_BLOCK 0x01
+#define IP_QUEUE_DROP_NEWEST 0x02
+#define IP_QUEUE_DROP_OLDEST 0x03
+#define IP_QUEUE_ERROR 0x04
+
 
 bool IP_IsValidAddress( const char* addressString );
 
-void* IP_OpenConnection( uint8_t connectionType, const char* host, const char* port );
+bool IP_IsLocalAddress( const char* addressString );
+
+bool IP_SetReactorsCount( size_t threadsCount );
+
+void* IP_OpenConnection( uint8_t connectionType, const char* host, const char* port, size_t queueLength, uint8_t queuePolicy, size_t outputBufferSize );
 
 void IP_CloseConnection( void* connection );
  
-bool IP_ReceiveMessage( void* connection, uint8_t* message );
+bool IP_ReceiveMessage( void* connection, uint8_t* buffer, size_t maxLength, size_t* ref_length );
                                                                              
-bool IP_SendMessage( void* connection, const uint8_t* message );
+bool IP_SendMessage( void* connection, const uint8_t* data, size_t length );
+
+bool IP_ReceivePeerMessage( void* connection, uint8_t* buffer, size_t maxLength, size_t* ref_length, uint64_t* ref_peerID );
+
+bool IP_SendPeerMessage( void* connection, uint64_t peerID, const uint8_t* data, size_t length );
+
+size_t IP_GetMessagesCount( void* connection );
+
+uint64_t IP_GetReceiveEventsCount( void );
+
+bool IP_WaitReceiveEvent( uint64_t lastEventsCount, unsigned long milliseconds );
+
+bool IP_GetReceiveCounters( void* connection, uint64_t* ref_callsCount, uint64_t* ref_messagesCount, uint64_t* ref_largestBatch );
+
+bool IP_GetQueueCounters( void* connection, uint64_t* ref_readDropsCount, uint64_t* ref_writeDropsCount );
+
+bool IP_GetStats( void* connection, IPCStats* ref_stats );
 
 #endif // IPC_BASE_IP_H
@@ -28,8 +28,15 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-#define SHARED_OBJECT_BUFFER_LENGTH 512
+#ifndef MAX_MESSAGE_LENGTH
+  #define MAX_MESSAGE_LENGTH 65507
+#endif
+#define SHARED_OBJECT_BUFFER_LENGTH MAX_MESSAGE_LENGTH
 #define SHARED_OBJECT_PATH_MAX_LENGTH 256
+
+#ifndef SHM_QUEUE_LENGTH
+  #define SHM_QUEUE_LENGTH 64                                   // Number of message slots per direction (rounded up to a power of 2)
+#endif
   
 typedef struct _SHMMappingData SHMMappingData;
 typedef SHMMappingData* SHMMapping;  
@@ -165,107 +172,1036 @@ void SharedObjects_DestroyObject( void* sharedObjectData )
 
 #include <sys/mman.h>
 #include <sys/types.h>
-#include <sys/ipc.h>
-#include <sys/shm.h>
 #include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "ipc_stats_counters.h"
+
+#ifdef __linux__
+  #include <linux/futex.h>
+  #include <sys/syscall.h>
+  #include <limits.h>
+#endif
+
+#define CACHE_LINE_SIZE 64
+#define HUGE_PAGE_SIZE ( 2 * 1024 * 1024 )
+#define DOORBELL_POLL_INTERVAL_US 100                           // Wait granularity on systems without futexes
+#define SEGMENT_OPEN_TIMEOUT_MS 1000                            // Longest wait for another process to initialize (or remove) a segment
+
+enum { SHM_SEGMENT_UNINITIALIZED, SHM_SEGMENT_READY };
+enum { SHM_SEGMENT_QUEUE = 1, SHM_SEGMENT_VALUE, SHM_SEGMENT_SHARED_QUEUE, SHM_SEGMENT_BROADCAST_QUEUE };
+
+// Beginning of every shared segment, checked by processes that attach to an existing one
+typedef struct _SHMSegmentHeaderData
+{
+  atomic_uint state;                                            // Set to SHM_SEGMENT_READY after creator fills the segment fields
+  uint32_t type;                                                // Queue or latest value
+  size_t dataSize;                                              // Bytes reserved for each message
+}
+SHMSegmentHeaderData;
+
+// Futex word for readers waiting on new data, incremented only when some reader sleeps on it
+typedef struct _SHMDoorbellData
+{
+  alignas(CACHE_LINE_SIZE) atomic_uint value;
+  atomic_uint waitersCount;                                     // Readers sleeping (or about to) on the doorbell
+}
+SHMDoorbellData;
+
+typedef SHMDoorbellData* SHMDoorbell;
+
+// Single-producer/single-consumer ring placed at the beginning of each shared segment.
+// Head and tail indexes grow monotonically and live on separate cache lines, so that
+// the writer and the reader process never invalidate each other's hot data
+typedef struct _SHMQueueData
+{
+  SHMSegmentHeaderData header;
+  size_t slotsCount;                                            // Power of 2, so that slot positions are given by masking
+  atomic_size_t lastPeerID;                                     // Last identifier given to a writer of the queue (shared queues)
+  alignas(CACHE_LINE_SIZE) atomic_size_t head;                  // Next slot to be written (only changed by the writer)
+  alignas(CACHE_LINE_SIZE) atomic_size_t tail;                  // Next slot to be read (only changed by the reader)
+  SHMDoorbellData doorbell;
+}
+SHMQueueData;
+
+typedef SHMQueueData* SHMQueue;
+
+// Each slot stores the actual message length before its data, so that only used bytes are copied
+typedef struct _SHMSlotData
+{
+  uint32_t length;
+  uint32_t requestID;                                           // Request identifier, echoed by its reply (0 for plain messages)
+  uint64_t queueTime;                                           // Writer clock when the message was published (for latency statistics)
+  uint64_t peerID;                                              // Writer of shared queue messages, or only reader of broadcast ones (0 for all)
+  uint8_t data[];
+}
+SHMSlotData;
+
+typedef SHMSlotData* SHMSlot;
+
+// Slots of queues with multiple writers or readers: each writer claims a position by advancing the
+// queue head, and marks the slot as filled through its sequence number when done. Readers claim
+// filled slots by advancing the queue tail in the same way, and free them when done.
+// Broadcast queues have a single writer that overwrites slots whether they were read or not, so readers
+// keep their own positions and use the sequence to detect messages replaced while being copied
+typedef struct _SHMSharedSlotData
+{
+  atomic_size_t sequence;                                       // Position + 1 once filled, position + slots count once read (0 while overwritten on broadcast)
+  SHMSlotData message;
+}
+SHMSharedSlotData;
+
+typedef SHMSharedSlotData* SHMSharedSlot;
+
+// Single message overwritten on each write, guarded by a sequence lock: readers never block
+// the writer and only retry when they catch it in the middle of an update
+typedef struct _SHMValueData
+{
+  SHMSegmentHeaderData header;
+  SHMDoorbellData doorbell;
+  alignas(CACHE_LINE_SIZE) atomic_size_t sequence;              // Odd while the writer is copying data
+  SHMSlotData slot;
+}
+SHMValueData;
+
+typedef SHMValueData* SHMValue;
+
+#define SHM_QUEUE_SLOT_SIZE ( ( ( sizeof(SHMSlotData) + SHARED_OBJECT_BUFFER_LENGTH + CACHE_LINE_SIZE - 1 ) / CACHE_LINE_SIZE ) * CACHE_LINE_SIZE )
+#define SHM_SHARED_QUEUE_SLOT_SIZE ( ( ( sizeof(SHMSharedSlotData) + SHARED_OBJECT_BUFFER_LENGTH + CACHE_LINE_SIZE - 1 ) / CACHE_LINE_SIZE ) * CACHE_LINE_SIZE )
+#define SHM_QUEUE_SLOT( queue, index ) ( (SHMSlot) ( ((uint8_t*) (queue)) + sizeof(SHMQueueData) + ( (index) & ( (queue)->slotsCount - 1 ) ) * (queue)->header.dataSize ) )
+
+// Copy of a reply kept aside until it is asked for
+typedef struct _SHMStoredReplyData
+{
+  uint32_t requestID;
+  size_t length;
+  uint64_t queueTime;
+  uint8_t* data;
+}
+SHMStoredReplyData;
 
 struct _SHMMappingData
 {
-  uint8_t* dataIn;
-  uint8_t* dataOut;
-  size_t readCount, writeCount;
+  SHMQueue queueIn;
+  SHMQueue queueOut;
+  SHMValue valueIn;                                             // Latest value segments replace queues when SHM_LATEST_VALUE is set
+  SHMValue valueOut;
+  SHMDoorbell doorbellIn;
+  bool isInputShared, isOutputShared;                           // Queues with multiple writers or readers (client/server connections)
+  bool isInputBroadcast, isOutputBroadcast;                     // Queues read by any number of processes, each one getting every message
+  size_t cachedHead;                                            // Last known writer position of input queue (avoids touching remote cache line)
+  size_t cachedTail;                                            // Last known reader position of output queue
+  size_t lastSequence;                                          // Sequence of the last input value read
+  size_t segmentInSize, segmentOutSize;                         // Mapped lengths, for unmapping
+  int segmentInFD, segmentOutFD;                                // Kept open (and locked) while segments are attached
+  char segmentInName[ SHARED_OBJECT_PATH_MAX_LENGTH ];          // For removal by the last process attached
+  char segmentOutName[ SHARED_OBJECT_PATH_MAX_LENGTH ];
+  size_t outputPosition;                                        // Output queue position acquired for the message being written
+  size_t inputPosition;                                         // Shared input queue position claimed for the message being read
+  size_t readPosition;                                          // Next broadcast input queue position read by this process
+  uint64_t peerID;                                              // Identifier of this process as a writer of the shared output queue
+  uint64_t lastPeerID;                                          // Writer of the last message read from the shared input queue
+  SHMSlot claimedInputSlot;                                     // Shared input slot claimed and not released yet
+  SHMSlot loanedOutputSlot;                                     // Slot handed to the caller for writing in place
+  SHMSlot loanedInputSlot;                                      // Slot (or stored reply) handed to the caller for reading in place
+  bool isReplier;                                               // Output messages answer input ones, in the order they were read
+  uint32_t lastRequestID;
+  uint32_t* pendingRequestIDsList;                              // Requests read and not answered yet
+  size_t pendingRequestsCount;
+  SHMStoredReplyData* storedRepliesList;                        // Replies read while looking for other requests' ones
+  size_t storedRepliesCount;
+  StatsCountersData stats;
 };
 
-uint8_t* OpenFileMapping( const char* mappingFilePath, int accessOption )
+// Segments hold as many slots as fit in the requested size (a power of 2, for index masking)
+static size_t GetQueueSlotsCount( size_t segmentSize, size_t slotSize )
 {
-  // Shared memory is mapped to a file. So we create a new file.
-  FILE* mappedFile = fopen( mappingFilePath, "r+" );
-  if( mappedFile == NULL )
+  size_t slotsCount = 1;
+  if( segmentSize == 0 )
+  {
+    while( slotsCount < SHM_QUEUE_LENGTH ) slotsCount <<= 1;
+  }
+  else
+  {
+    while( sizeof(SHMQueueData) + ( slotsCount << 1 ) * slotSize <= segmentSize ) slotsCount <<= 1;
+  }
+  return slotsCount;
+}
+
+// POSIX shared memory names have a single leading slash, so directory separators are replaced
+static void GetSegmentName( char* segmentName, const char* dirPath, const char* baseName, const char* suffix )
+{
+  snprintf( segmentName, SHARED_OBJECT_PATH_MAX_LENGTH, "/%s/%s_%s", ( dirPath != NULL ) ? dirPath : "", baseName, suffix );
+  for( char* nameChar = segmentName + 1; *nameChar != '\0'; nameChar++ )
   {
-    if( (mappedFile = fopen( mappingFilePath, "w+" )) == NULL )
+    if( *nameChar == '/' ) *nameChar = '_';
+  }
+}
+
+static void* MapSegment( int segmentFD, size_t segmentSize, uint16_t flags )
+{
+  int mappingFlags = MAP_SHARED;
+#ifdef MAP_POPULATE
+  if( flags & SHM_PREFAULT ) mappingFlags |= MAP_POPULATE;
+#endif
+  
+  void* sharedObject = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if( flags & SHM_HUGE_PAGES ) sharedObject = mmap( NULL, segmentSize, PROT_READ | PROT_WRITE, mappingFlags | MAP_HUGETLB, segmentFD, 0 );
+#endif
+  if( sharedObject == MAP_FAILED )
+  {
+    sharedObject = mmap( NULL, segmentSize, PROT_READ | PROT_WRITE, mappingFlags, segmentFD, 0 );
+#ifdef MADV_HUGEPAGE
+    // Explicit huge pages are only available on hugetlbfs: ask for transparent ones on regular shared memory
+    if( sharedObject != MAP_FAILED && ( flags & SHM_HUGE_PAGES ) ) madvise( sharedObject, segmentSize, MADV_HUGEPAGE );
+#endif
+  }
+  
+  return sharedObject;
+}
+
+static void RingDoorbell( SHMDoorbell doorbell )
+{
+  atomic_fetch_add( &(doorbell->value), 1 );
+#ifdef __linux__
+  // Segment is shared between processes: private futex operations can't be used
+  syscall( SYS_futex, &(doorbell->value), FUTEX_WAKE, INT_MAX, NULL, NULL, 0 );
+#endif
+}
+
+// Pairs with the fence in SHM_WaitData: either the reader sees the new data or we see it waiting.
+// Under load nobody sleeps, so no system call is made
+static inline void NotifyReaders( SHMDoorbell doorbell )
+{
+  atomic_thread_fence( memory_order_seq_cst );
+  if( atomic_load_explicit( &(doorbell->waitersCount), memory_order_relaxed ) > 0 ) RingDoorbell( doorbell );
+}
+
+static void WaitDoorbell( SHMDoorbell doorbell, unsigned int lastDoorbellValue, unsigned long milliseconds )
+{
+#ifdef __linux__
+  // Returns immediately if the doorbell rang after its value was read
+  struct timespec waitTime = { .tv_sec = milliseconds / 1000, .tv_nsec = ( milliseconds % 1000 ) * 1000000 };
+  syscall( SYS_futex, &(doorbell->value), FUTEX_WAIT, lastDoorbellValue, &waitTime, NULL, 0 );
+#else
+  struct timespec sleepTime = { .tv_sec = 0, .tv_nsec = DOORBELL_POLL_INTERVAL_US * 1000 };
+  unsigned long sleepsCount = ( milliseconds * 1000 + DOORBELL_POLL_INTERVAL_US - 1 ) / DOORBELL_POLL_INTERVAL_US;
+  while( sleepsCount-- > 0 && atomic_load( &(doorbell->value) ) == lastDoorbellValue ) nanosleep( &sleepTime, NULL );
+#endif
+}
+
+// Map named segment, creating it with the given size if needed. Attached processes hold a shared lock on
+// the segment file, released by the system even if they crash: whoever gets the exclusive lock is alone,
+// so the segment is either new or left behind, and gets (re)initialized with its size and layout.
+// Others wait for it to be ready and adopt them (returned size is the actual one)
+static SHMSegmentHeaderData* OpenSegment( const char* segmentName, uint16_t flags, size_t* ref_segmentSize, int* ref_segmentFD, bool* ref_isCreator )
+{
+  size_t pageSize = ( flags & SHM_HUGE_PAGES ) ? HUGE_PAGE_SIZE : (size_t) sysconf( _SC_PAGESIZE );
+  size_t mappedSize = ( ( *ref_segmentSize + pageSize - 1 ) / pageSize ) * pageSize;
+  
+  struct timespec retryTime = { .tv_sec = 0, .tv_nsec = DOORBELL_POLL_INTERVAL_US * 1000 };
+  uint64_t timeoutTime = Stats_GetTimeNS() + (uint64_t) SEGMENT_OPEN_TIMEOUT_MS * 1000000;
+  bool isCreator = false;
+  int segmentFD = -1;
+  while( segmentFD == -1 )
+  {
+    segmentFD = shm_open( segmentName, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR );
+    if( segmentFD == -1 )
+    {
+      perror( "Failed to open shared memory segment" );
+      return NULL;
+    }
+    
+    isCreator = ( flock( segmentFD, LOCK_EX | LOCK_NB ) == 0 );
+    // Exclusive lock held by another process initializing the segment, or removing it on close
+    if( !isCreator && flock( segmentFD, LOCK_SH | LOCK_NB ) == -1 )
+    {
+      close( segmentFD );
+      segmentFD = -1;
+      if( Stats_GetTimeNS() > timeoutTime )
+      {
+        fprintf( stderr, "shared memory segment %s is not getting ready\n", segmentName );
+        return NULL;
+      }
+      nanosleep( &retryTime, NULL );
+      continue;
+    }
+    
+    struct stat segmentStatus;
+    if( fstat( segmentFD, &segmentStatus ) == -1 )
     {
-      perror( "Failed to open memory mapped file" );
+      perror( "Failed to get shared memory segment size" );
+      close( segmentFD );
       return NULL;
     }
+    // Segment removed by the last process attached before the lock was taken: open the new one
+    if( segmentStatus.st_nlink == 0 )
+    {
+      close( segmentFD );
+      segmentFD = -1;
+      continue;
+    }
+    
+    if( !isCreator ) mappedSize = (size_t) segmentStatus.st_size;
   }
-  fclose( mappedFile );
   
-  // Generates exclusive key from the file name (same name generate same key)
-  key_t sharedKey = ftok( mappingFilePath, 1 );
-  if( sharedKey == -1 )
+  if( isCreator )
   {
-    perror( "Failed to aquire shared memory key" );
-    return NULL;
+    // Truncating first discards contents left behind (new pages are zero filled)
+    if( ftruncate( segmentFD, 0 ) == -1 || ftruncate( segmentFD, (off_t) mappedSize ) == -1 )
+    {
+      perror( "Failed to set shared memory segment size" );
+      shm_unlink( segmentName );
+      close( segmentFD );
+      return NULL;
+    }
   }
   
-  // Reserves shared memory area and returns a file descriptor to it
-  int sharedMemoryID = shmget( sharedKey, SHARED_OBJECT_BUFFER_LENGTH + 1, IPC_CREAT | accessOption );
-  if( sharedMemoryID == -1 )
+  void* sharedObject = MapSegment( segmentFD, mappedSize, flags );
+  if( sharedObject == MAP_FAILED ) 
   {
-    perror( "Failed to create shared memory segment" );
+    perror( "Failed to map shared memory segment" );
+    close( segmentFD );
     return NULL;
   }
   
-  //DEBUG_PRINT( "Got shared memory area ID %d", sharedMemoryID );
+  if( flags & SHM_LOCK_MEMORY )
+  {
+    if( mlock( sharedObject, mappedSize ) == -1 ) perror( "Failed to lock shared memory segment" );
+  }
+  
+  *ref_segmentSize = mappedSize;
+  *ref_segmentFD = segmentFD;
+  *ref_isCreator = isCreator;
   
-  // Maps created shared memory area to program address (pointer)
-  void* newSharedObject = shmat( sharedMemoryID, NULL, 0 );
-  if( newSharedObject == (void*) -1 ) 
+  return (SHMSegmentHeaderData*) sharedObject;
+}
+
+// Let other processes attach to a segment after its creator has filled it
+static void PublishSegment( SHMSegmentHeaderData* header, int segmentFD )
+{
+  atomic_store_explicit( &(header->state), SHM_SEGMENT_READY, memory_order_release );
+  flock( segmentFD, LOCK_SH );
+}
+
+// Last process attached removes the segment, so that the next ones start from an empty one
+static void CloseSegment( void* segment, size_t segmentSize, int segmentFD, const char* segmentName )
+{
+  if( segment != NULL ) munmap( segment, segmentSize );
+  if( segmentFD == -1 ) return;
+  if( flock( segmentFD, LOCK_EX | LOCK_NB ) == 0 ) shm_unlink( segmentName );
+  close( segmentFD );
+}
+
+// Check if an existing segment (ready, as its creator released the exclusive lock) is usable as expected
+static bool CheckSegmentLayout( SHMSegmentHeaderData* header, uint32_t type, size_t dataSize, const char* segmentName )
+{
+  if( atomic_load_explicit( &(header->state), memory_order_acquire ) != SHM_SEGMENT_READY
+      || header->type != type || header->dataSize != dataSize )
+  {
+    fprintf( stderr, "shared memory segment %s has incompatible layout\n", segmentName );
+    return false;
+  }
+  
+  return true;
+}
+
+static SHMQueue OpenSharedQueue( const char* segmentName, size_t segmentSize, uint16_t flags, uint32_t queueType, size_t* ref_mappedSize, int* ref_segmentFD )
+{
+  size_t slotSize = ( queueType == SHM_SEGMENT_QUEUE ) ? SHM_QUEUE_SLOT_SIZE : SHM_SHARED_QUEUE_SLOT_SIZE;
+  size_t slotsCount = GetQueueSlotsCount( segmentSize, slotSize );
+  size_t mappedSize = sizeof(SHMQueueData) + slotsCount * slotSize;
+  
+  bool isCreator;
+  int segmentFD;
+  SHMQueue queue = (SHMQueue) OpenSegment( segmentName, flags, &mappedSize, &segmentFD, &isCreator );
+  if( queue == NULL ) return NULL;
+  
+  // New segments are zero filled: their creator sets the queue properties
+  if( isCreator )
+  {
+    queue->header.type = queueType;
+    queue->header.dataSize = slotSize;
+    queue->slotsCount = slotsCount;
+    // Shared slots start free for writing at their own positions (zeroed broadcast ones are simply not written yet)
+    for( size_t slotIndex = 0; queueType == SHM_SEGMENT_SHARED_QUEUE && slotIndex < slotsCount; slotIndex++ )
+      atomic_store_explicit( &(((SHMSharedSlot) SHM_QUEUE_SLOT( queue, slotIndex ))->sequence), slotIndex, memory_order_relaxed );
+    PublishSegment( &(queue->header), segmentFD );
+  }
+  else if( !CheckSegmentLayout( &(queue->header), queueType, slotSize, segmentName ) 
+           || sizeof(SHMQueueData) + queue->slotsCount * queue->header.dataSize > mappedSize )
   {
-    perror( "Failed to bind object" );
+    munmap( queue, mappedSize );
+    close( segmentFD );
     return NULL;
   }
   
-  return (uint8_t*) newSharedObject;
+  *ref_mappedSize = mappedSize;
+  *ref_segmentFD = segmentFD;
+  
+  return queue;
 }
 
-void* SHM_OpenMapping( const char* dirPath, const char* baseName, const char* inSuffix, const char* outSuffix )
+static SHMValue OpenSharedValue( const char* segmentName, uint16_t flags, size_t* ref_mappedSize, int* ref_segmentFD )
 {
-  char mappingFilePath[ SHARED_OBJECT_PATH_MAX_LENGTH ];
+  size_t mappedSize = sizeof(SHMValueData) + SHARED_OBJECT_BUFFER_LENGTH;
+  
+  bool isCreator;
+  int segmentFD;
+  SHMValue value = (SHMValue) OpenSegment( segmentName, flags, &mappedSize, &segmentFD, &isCreator );
+  if( value == NULL ) return NULL;
+  
+  if( isCreator )
+  {
+    value->header.type = SHM_SEGMENT_VALUE;
+    value->header.dataSize = SHARED_OBJECT_BUFFER_LENGTH;
+    PublishSegment( &(value->header), segmentFD );
+  }
+  else if( !CheckSegmentLayout( &(value->header), SHM_SEGMENT_VALUE, SHARED_OBJECT_BUFFER_LENGTH, segmentName ) )
+  {
+    munmap( value, mappedSize );
+    close( segmentFD );
+    return NULL;
+  }
+  
+  *ref_mappedSize = mappedSize;
+  *ref_segmentFD = segmentFD;
   
+  return value;
+}
+
+void* SHM_OpenMapping( const char* dirPath, const char* baseName, const char* inSuffix, const char* outSuffix, size_t segmentSize, uint16_t flags )
+{
   SHMMapping newMapping = (SHMMapping) malloc( sizeof(SHMMappingData) );
+  memset( newMapping, 0, sizeof(SHMMappingData) );
+  newMapping->segmentInFD = newMapping->segmentOutFD = -1;
   
-  snprintf( mappingFilePath, SHARED_OBJECT_PATH_MAX_LENGTH, "%s/%s_%s", dirPath, baseName, inSuffix );
+  GetSegmentName( newMapping->segmentInName, dirPath, baseName, inSuffix );
+  GetSegmentName( newMapping->segmentOutName, dirPath, baseName, outSuffix );
   
-  newMapping->dataIn = OpenFileMapping( mappingFilePath, S_IRUSR );
+  if( flags & SHM_LATEST_VALUE )
+  {
+    newMapping->valueIn = OpenSharedValue( newMapping->segmentInName, flags, &(newMapping->segmentInSize), &(newMapping->segmentInFD) );
+    newMapping->valueOut = OpenSharedValue( newMapping->segmentOutName, flags, &(newMapping->segmentOutSize), &(newMapping->segmentOutFD) );
+    
+    if( newMapping->valueIn == NULL || newMapping->valueOut == NULL )
+    {
+      SHM_CloseMapping( newMapping );
+      return NULL;
+    }
+    
+    // Value already published before opening is still available for reading
+    newMapping->doorbellIn = &(newMapping->valueIn->doorbell);
+    newMapping->lastSequence = 0;
+    
+    return newMapping;
+  }
   
-  snprintf( mappingFilePath, SHARED_OBJECT_PATH_MAX_LENGTH, "%s/%s_%s", dirPath, baseName, outSuffix );
+  newMapping->isReplier = ( flags & SHM_REPLIER );
+  newMapping->isInputShared = ( flags & SHM_SHARED_INPUT );
+  newMapping->isOutputShared = ( flags & SHM_SHARED_OUTPUT );
+  newMapping->isInputBroadcast = ( flags & SHM_BROADCAST_INPUT );
+  newMapping->isOutputBroadcast = ( flags & SHM_BROADCAST_OUTPUT );
   
-  newMapping->dataOut = OpenFileMapping( mappingFilePath, S_IWUSR );
+  uint32_t queueInType = newMapping->isInputBroadcast ? SHM_SEGMENT_BROADCAST_QUEUE : ( newMapping->isInputShared ? SHM_SEGMENT_SHARED_QUEUE : SHM_SEGMENT_QUEUE );
+  uint32_t queueOutType = newMapping->isOutputBroadcast ? SHM_SEGMENT_BROADCAST_QUEUE : ( newMapping->isOutputShared ? SHM_SEGMENT_SHARED_QUEUE : SHM_SEGMENT_QUEUE );
+  newMapping->queueIn = OpenSharedQueue( newMapping->segmentInName, segmentSize, flags, queueInType,
+                                         &(newMapping->segmentInSize), &(newMapping->segmentInFD) );
+  newMapping->queueOut = OpenSharedQueue( newMapping->segmentOutName, segmentSize, flags, queueOutType,
+                                          &(newMapping->segmentOutSize), &(newMapping->segmentOutFD) );
   
-  if( newMapping->dataIn == NULL || newMapping->dataOut == NULL )
+  if( newMapping->queueIn == NULL || newMapping->queueOut == NULL )
   {
     SHM_CloseMapping( newMapping );
     return NULL;
   }
   
-  newMapping->readCount = newMapping->writeCount = 0;
+  newMapping->doorbellIn = &(newMapping->queueIn->doorbell);
+  newMapping->cachedHead = atomic_load_explicit( &(newMapping->queueIn->head), memory_order_acquire );
+  newMapping->cachedTail = atomic_load_explicit( &(newMapping->queueOut->tail), memory_order_acquire );
+  // Broadcast messages written before opening are not read, as with network subscribers
+  newMapping->readPosition = newMapping->cachedHead;
+  // Messages broadcast by a server can be addressed to a single client, known by its messages to the server
+  if( newMapping->isOutputShared ) newMapping->peerID = atomic_fetch_add( &(newMapping->queueOut->lastPeerID), 1 ) + 1;
   
   return newMapping;
 }
 
-bool SHM_ReadData( void* ref_mapping, uint8_t* message )
+// Copy newest value, if not read yet. Torn copies (writer updated the value meanwhile) are discarded and repeated
+static bool ReadValue( SHMMapping mapping, uint8_t* buffer, size_t maxLength, size_t* ref_length )
+{
+  SHMValue value = mapping->valueIn;
+  
+  while( true )
+  {
+    size_t sequence = atomic_load_explicit( &(value->sequence), memory_order_acquire );
+    if( sequence == mapping->lastSequence ) return false;
+    if( sequence & 1 ) continue;
+    
+    size_t length = value->slot.length;
+    if( length > SHARED_OBJECT_BUFFER_LENGTH ) length = SHARED_OBJECT_BUFFER_LENGTH;
+    if( length > maxLength ) length = maxLength;
+    uint64_t queueTime = value->slot.queueTime;
+    memcpy( buffer, value->slot.data, length );
+    
+    atomic_thread_fence( memory_order_acquire );
+    if( atomic_load_explicit( &(value->sequence), memory_order_relaxed ) == sequence ) 
+    {
+      // Each complete write advances the sequence by 2: values written between reads were never seen
+      if( mapping->lastSequence != 0 && sequence - mapping->lastSequence > 2 ) 
+        Stats_AddCount( &(mapping->stats.droppedMessagesCount), ( sequence - mapping->lastSequence ) / 2 - 1 );
+      Stats_AddRead( &(mapping->stats), length, queueTime );
+      mapping->lastSequence = sequence;
+      *ref_length = length;
+      return true;
+    }
+  }
+}
+
+static bool WriteValue( SHMMapping mapping, const uint8_t* data, size_t length )
+{
+  SHMValue value = mapping->valueOut;
+  
+  size_t sequence = atomic_load_explicit( &(value->sequence), memory_order_relaxed );
+  atomic_store_explicit( &(value->sequence), sequence + 1, memory_order_relaxed );
+  atomic_thread_fence( memory_order_release );
+  
+  value->slot.length = (uint32_t) length;
+  value->slot.queueTime = Stats_GetTimeNS();
+  memcpy( value->slot.data, data, length );
+  
+  atomic_store_explicit( &(value->sequence), sequence + 2, memory_order_release );
+  
+  NotifyReaders( &(value->doorbell) );
+  
+  Stats_AddWrite( &(mapping->stats), length );
+  
+  return true;
+}
+
+// Broadcast messages addressed to other processes are passed over, so that they don't count as available
+static void SkipOtherPeersMessages( SHMMapping mapping, size_t head )
+{
+  SHMQueue queue = mapping->queueIn;
+  
+  while( mapping->readPosition != head && head - mapping->readPosition <= queue->slotsCount )
+  {
+    SHMSharedSlot sharedSlot = (SHMSharedSlot) SHM_QUEUE_SLOT( queue, mapping->readPosition );
+    size_t sequence = atomic_load_explicit( &(sharedSlot->sequence), memory_order_acquire );
+    uint64_t peerID = sharedSlot->message.peerID;
+    atomic_thread_fence( memory_order_acquire );
+    // Overwritten messages are left for the next read, which counts them as dropped
+    if( sequence != mapping->readPosition + 1 || atomic_load_explicit( &(sharedSlot->sequence), memory_order_relaxed ) != sequence ) return;
+    if( peerID == 0 || peerID == mapping->peerID ) return;
+    mapping->readPosition++;
+  }
+}
+
+// Copy oldest broadcast message not read by this process yet. Messages overwritten before (or while) being
+// copied are skipped, counted as dropped: the writer never waits for readers
+static bool ReadBroadcastMessage( SHMMapping mapping, uint8_t* buffer, size_t maxLength, size_t* ref_length )
+{
+  SHMQueue queue = mapping->queueIn;
+  
+  while( true )
+  {
+    size_t head = atomic_load_explicit( &(queue->head), memory_order_acquire );
+    if( mapping->readPosition == head ) return false;
+    if( head - mapping->readPosition > queue->slotsCount )
+    {
+      Stats_AddCount( &(mapping->stats.droppedMessagesCount), head - queue->slotsCount - mapping->readPosition );
+      mapping->readPosition = head - queue->slotsCount;
+    }
+    Stats_UpdateMaximum( &(mapping->stats.readQueueHighWater), head - mapping->readPosition );
+    
+    size_t position = mapping->readPosition++;
+    SHMSharedSlot sharedSlot = (SHMSharedSlot) SHM_QUEUE_SLOT( queue, position );
+    if( atomic_load_explicit( &(sharedSlot->sequence), memory_order_acquire ) == position + 1 )
+    {
+      size_t messageLength = sharedSlot->message.length;
+      if( messageLength > SHARED_OBJECT_BUFFER_LENGTH ) messageLength = SHARED_OBJECT_BUFFER_LENGTH;
+      size_t length = ( messageLength < maxLength ) ? messageLength : maxLength;
+      uint64_t queueTime = sharedSlot->message.queueTime;
+      uint64_t peerID = sharedSlot->message.peerID;
+      memcpy( buffer, sharedSlot->message.data, length );
+      
+      atomic_thread_fence( memory_order_acquire );
+      if( atomic_load_explicit( &(sharedSlot->sequence), memory_order_relaxed ) == position + 1 )
+      {
+        if( peerID != 0 && peerID != mapping->peerID ) continue;
+        Stats_AddRead( &(mapping->stats), messageLength, queueTime );
+        *ref_length = length;
+        return true;
+      }
+    }
+    
+    Stats_AddCount( &(mapping->stats.droppedMessagesCount), 1 );
+  }
+}
+
+// Oldest unread message of the input queue, left in place until ReleaseInputSlot() is called
+static SHMSlot PeekInputSlot( SHMMapping mapping )
+{
+  SHMQueue queue = mapping->queueIn;
+  
+  size_t tail = atomic_load_explicit( &(queue->tail), memory_order_relaxed );
+  if( mapping->isInputShared ) // Readers compete for filled slots at the tail position, which stay theirs until released
+  {
+    if( mapping->claimedInputSlot != NULL ) return mapping->claimedInputSlot;
+    while( true )
+    {
+      SHMSharedSlot sharedSlot = (SHMSharedSlot) SHM_QUEUE_SLOT( queue, tail );
+      intptr_t positionsAhead = (intptr_t) atomic_load_explicit( &(sharedSlot->sequence), memory_order_acquire ) - (intptr_t) ( tail + 1 );
+      if( positionsAhead == 0 )
+      {
+        if( atomic_compare_exchange_weak_explicit( &(queue->tail), &tail, tail + 1, memory_order_relaxed, memory_order_relaxed ) ) break;
+      }
+      else if( positionsAhead < 0 ) return NULL; // Slot at the tail not filled yet
+      else tail = atomic_load_explicit( &(queue->tail), memory_order_relaxed );
+    }
+    
+    mapping->inputPosition = tail;
+    mapping->claimedInputSlot = &(((SHMSharedSlot) SHM_QUEUE_SLOT( queue, tail ))->message);
+    return mapping->claimedInputSlot;
+  }
+  
+  if( tail == mapping->cachedHead )
+  {
+    mapping->cachedHead = atomic_load_explicit( &(queue->head), memory_order_acquire );
+    if( tail == mapping->cachedHead ) return NULL;
+    Stats_UpdateMaximum( &(mapping->stats.readQueueHighWater), mapping->cachedHead - tail );
+  }
+  
+  return SHM_QUEUE_SLOT( queue, tail );
+}
+
+static void ReleaseInputSlot( SHMMapping mapping )
+{
+  SHMQueue queue = mapping->queueIn;
+  
+  if( mapping->isInputShared ) 
+  {
+    // Free slot for the writer that reaches this position on the next lap
+    SHMSharedSlot sharedSlot = (SHMSharedSlot) SHM_QUEUE_SLOT( queue, mapping->inputPosition );
+    atomic_store_explicit( &(sharedSlot->sequence), mapping->inputPosition + queue->slotsCount, memory_order_release );
+    mapping->claimedInputSlot = NULL;
+  }
+  else
+  {
+    size_t tail = atomic_load_explicit( &(queue->tail), memory_order_relaxed );
+    atomic_store_explicit( &(queue->tail), tail + 1, memory_order_release );
+  }
+  
+  mapping->loanedInputSlot = NULL; // Any peeked message is the one consumed
+}
+
+// Free slot at the output queue end, to be filled by the caller and published with CommitOutputSlot()
+static SHMSlot AcquireOutputSlot( SHMMapping mapping )
+{
+  SHMQueue queue = mapping->queueOut;
+  
+  size_t head = atomic_load_explicit( &(queue->head), memory_order_relaxed );
+  if( mapping->isOutputShared ) // Writers compete for the head position, then fill their slots independently
+  {
+    while( true )
+    {
+      SHMSharedSlot sharedSlot = (SHMSharedSlot) SHM_QUEUE_SLOT( queue, head );
+      intptr_t positionsAhead = (intptr_t) atomic_load_explicit( &(sharedSlot->sequence), memory_order_acquire ) - (intptr_t) head;
+      if( positionsAhead == 0 )
+      {
+        if( atomic_compare_exchange_weak_explicit( &(queue->head), &head, head + 1, memory_order_relaxed, memory_order_relaxed ) ) break;
+      }
+      else if( positionsAhead < 0 ) return NULL; // Queue full: slot from previous lap not read yet
+      else head = atomic_load_explicit( &(queue->head), memory_order_relaxed );
+    }
+    
+    mapping->outputPosition = head;
+    return &(((SHMSharedSlot) SHM_QUEUE_SLOT( queue, head ))->message);
+  }
+  
+  if( mapping->isOutputBroadcast ) // Oldest slot is reused right away: readers still copying it will notice the sequence change
+  {
+    SHMSharedSlot sharedSlot = (SHMSharedSlot) SHM_QUEUE_SLOT( queue, head );
+    atomic_store_explicit( &(sharedSlot->sequence), 0, memory_order_relaxed );
+    atomic_thread_fence( memory_order_release );
+    mapping->outputPosition = head;
+    return &(sharedSlot->message);
+  }
+  
+  if( head - mapping->cachedTail >= queue->slotsCount )
+  {
+    mapping->cachedTail = atomic_load_explicit( &(queue->tail), memory_order_acquire );
+    if( head - mapping->cachedTail >= queue->slotsCount ) return NULL; // Queue full: reader is not keeping up
+    Stats_UpdateMaximum( &(mapping->stats.writeQueueHighWater), head - mapping->cachedTail );
+  }
+  
+  mapping->outputPosition = head;
+  return SHM_QUEUE_SLOT( queue, head );
+}
+
+static void CommitOutputSlot( SHMMapping mapping, SHMSlot slot )
+{
+  SHMQueue queue = mapping->queueOut;
+  
+  slot->queueTime = Stats_GetTimeNS();
+  Stats_AddWrite( &(mapping->stats), slot->length );
+  
+  if( mapping->isOutputShared ) 
+  {
+    SHMSharedSlot sharedSlot = (SHMSharedSlot) SHM_QUEUE_SLOT( queue, mapping->outputPosition );
+    atomic_store_explicit( &(sharedSlot->sequence), mapping->outputPosition + 1, memory_order_release );
+  }
+  else
+  {
+    if( mapping->isOutputBroadcast )
+    {
+      SHMSharedSlot sharedSlot = (SHMSharedSlot) SHM_QUEUE_SLOT( queue, mapping->outputPosition );
+      atomic_store_explicit( &(sharedSlot->sequence), mapping->outputPosition + 1, memory_order_release );
+    }
+    atomic_store_explicit( &(queue->head), mapping->outputPosition + 1, memory_order_release );
+  }
+  
+  NotifyReaders( &(queue->doorbell) );
+}
+
+static bool WriteQueueMessage( SHMMapping mapping, const uint8_t* data, size_t length, uint32_t requestID, uint64_t peerID )
+{
+  SHMSlot slot = AcquireOutputSlot( mapping );
+  if( slot == NULL ) 
+  {
+    Stats_AddCount( &(mapping->stats.writeErrorsCount), 1 );
+    return false;
+  }
+  
+  slot->length = (uint32_t) length;
+  slot->requestID = requestID;
+  slot->peerID = peerID;
+  memcpy( slot->data, data, length );
+  
+  CommitOutputSlot( mapping, slot );
+  
+  return true;
+}
+
+static void StoreReply( SHMMapping mapping, SHMSlot slot )
+{
+  mapping->storedRepliesList = (SHMStoredReplyData*) realloc( mapping->storedRepliesList, ( mapping->storedRepliesCount + 1 ) * sizeof(SHMStoredReplyData) );
+  SHMStoredReplyData* reply = &(mapping->storedRepliesList[ mapping->storedRepliesCount++ ]);
+  reply->requestID = slot->requestID;
+  reply->length = slot->length;
+  reply->queueTime = slot->queueTime;
+  reply->data = (uint8_t*) malloc( slot->length );
+  memcpy( reply->data, slot->data, slot->length );
+}
+
+// Removal keeps remaining replies in arrival order
+static void RemoveStoredReply( SHMMapping mapping, size_t replyIndex )
+{
+  free( mapping->storedRepliesList[ replyIndex ].data );
+  mapping->storedRepliesCount--;
+  memmove( &(mapping->storedRepliesList[ replyIndex ]), &(mapping->storedRepliesList[ replyIndex + 1 ]), 
+           ( mapping->storedRepliesCount - replyIndex ) * sizeof(SHMStoredReplyData) );
+}
+
+static void TakeStoredReply( SHMMapping mapping, size_t replyIndex, uint8_t* buffer, size_t maxLength, size_t* ref_length )
+{
+  SHMStoredReplyData* reply = &(mapping->storedRepliesList[ replyIndex ]);
+  *ref_length = ( reply->length < maxLength ) ? reply->length : maxLength;
+  memcpy( buffer, reply->data, *ref_length );
+  Stats_AddRead( &(mapping->stats), reply->length, reply->queueTime );
+  RemoveStoredReply( mapping, replyIndex );
+}
+
+static void AddPendingRequest( SHMMapping mapping, uint32_t requestID )
+{
+  mapping->pendingRequestIDsList = (uint32_t*) realloc( mapping->pendingRequestIDsList, ( mapping->pendingRequestsCount + 1 ) * sizeof(uint32_t) );
+  mapping->pendingRequestIDsList[ mapping->pendingRequestsCount++ ] = requestID;
+}
+
+// Replies go to the oldest request read
+static uint32_t RemovePendingRequest( SHMMapping mapping )
+{
+  if( !mapping->isReplier || mapping->pendingRequestsCount == 0 ) return 0;
+  
+  uint32_t requestID = mapping->pendingRequestIDsList[ 0 ];
+  mapping->pendingRequestsCount--;
+  memmove( mapping->pendingRequestIDsList, mapping->pendingRequestIDsList + 1, mapping->pendingRequestsCount * sizeof(uint32_t) );
+  
+  return requestID;
+}
+
+bool SHM_ReadData( void* ref_mapping, uint8_t* buffer, size_t maxLength, size_t* ref_length )
 {  
   if( ref_mapping == NULL ) return false;
   SHMMapping mapping = (SHMMapping) ref_mapping;
-    
-  if( mapping->dataIn[ SHARED_OBJECT_BUFFER_LENGTH ] == mapping->readCount ) return false;
   
-  memcpy( message, mapping->dataIn, SHARED_OBJECT_BUFFER_LENGTH );
+  if( mapping->queueIn == NULL ) return ReadValue( mapping, buffer, maxLength, ref_length );
+  if( mapping->isInputBroadcast ) return ReadBroadcastMessage( mapping, buffer, maxLength, ref_length );
+  
+  if( mapping->storedRepliesCount > 0 )
+  {
+    TakeStoredReply( mapping, 0, buffer, maxLength, ref_length );
+    return true;
+  }
+  
+  SHMSlot slot = PeekInputSlot( mapping );
+  if( slot == NULL ) return false;
   
-  mapping->readCount = mapping->dataIn[ SHARED_OBJECT_BUFFER_LENGTH ];
+  *ref_length = ( slot->length < maxLength ) ? slot->length : maxLength;
+  memcpy( buffer, slot->data, *ref_length );
+  Stats_AddRead( &(mapping->stats), slot->length, slot->queueTime );
+  mapping->lastPeerID = slot->peerID;
+  
+  if( mapping->isReplier ) AddPendingRequest( mapping, slot->requestID );
+  
+  ReleaseInputSlot( mapping );
   
   return true;
 }
 
-bool SHM_WriteData( void* ref_mapping, const uint8_t* message )
+bool SHM_WriteData( void* ref_mapping, const uint8_t* data, size_t length )
 {  
   if( ref_mapping == NULL ) return false;
   SHMMapping mapping = (SHMMapping) ref_mapping;
   
-  memcpy( mapping->dataOut, message, SHARED_OBJECT_BUFFER_LENGTH );
+  if( length > SHARED_OBJECT_BUFFER_LENGTH ) return false;
+  
+  if( mapping->queueOut == NULL ) return WriteValue( mapping, data, length );
+  if( mapping->loanedOutputSlot != NULL ) return false; // Loaned slot must be committed first
+  
+  uint32_t requestID = ( mapping->isReplier && mapping->pendingRequestsCount > 0 ) ? mapping->pendingRequestIDsList[ 0 ] : 0;
+  if( !WriteQueueMessage( mapping, data, length, requestID, mapping->peerID ) ) return false;
+  RemovePendingRequest( mapping );
+  
+  return true;
+}
+
+bool SHM_ReadPeerData( void* ref_mapping, uint8_t* buffer, size_t maxLength, size_t* ref_length, uint64_t* ref_peerID )
+{
+  if( ref_mapping == NULL ) return false;
+  SHMMapping mapping = (SHMMapping) ref_mapping;
   
-  mapping->dataIn[ SHARED_OBJECT_BUFFER_LENGTH ] = ++mapping->writeCount;
+  if( !SHM_ReadData( mapping, buffer, maxLength, ref_length ) ) return false;
+  
+  *ref_peerID = mapping->isInputShared ? mapping->lastPeerID : 0;
+  
+  return true;
+}
+
+// Only broadcast messages reach a subset of their readers
+bool SHM_WritePeerData( void* ref_mapping, uint64_t peerID, const uint8_t* data, size_t length )
+{
+  if( ref_mapping == NULL ) return false;
+  SHMMapping mapping = (SHMMapping) ref_mapping;
+  
+  if( peerID == 0 ) return SHM_WriteData( mapping, data, length );
+  
+  if( length > SHARED_OBJECT_BUFFER_LENGTH ) return false;
+  if( !mapping->isOutputBroadcast || mapping->loanedOutputSlot != NULL ) return false;
+  
+  return WriteQueueMessage( mapping, data, length, 0, peerID );
+}
+
+uint8_t* SHM_AcquireWriteBuffer( void* ref_mapping, size_t* ref_capacity )
+{
+  if( ref_mapping == NULL ) return NULL;
+  SHMMapping mapping = (SHMMapping) ref_mapping;
+  
+  if( mapping->queueOut == NULL ) return NULL; // Latest values are overwritten in place, so they are never loaned
+  
+  // Acquiring twice without commit would leave a claimed position unfilled
+  if( mapping->loanedOutputSlot == NULL ) mapping->loanedOutputSlot = AcquireOutputSlot( mapping );
+  if( mapping->loanedOutputSlot == NULL ) 
+  {
+    Stats_AddCount( &(mapping->stats.writeErrorsCount), 1 );
+    return NULL;
+  }
+  
+  *ref_capacity = SHARED_OBJECT_BUFFER_LENGTH;
+  
+  return mapping->loanedOutputSlot->data;
+}
+
+bool SHM_CommitWrite( void* ref_mapping, size_t length )
+{
+  if( ref_mapping == NULL ) return false;
+  SHMMapping mapping = (SHMMapping) ref_mapping;
+  
+  if( mapping->loanedOutputSlot == NULL || length > SHARED_OBJECT_BUFFER_LENGTH ) return false;
+  
+  mapping->loanedOutputSlot->length = (uint32_t) length;
+  mapping->loanedOutputSlot->requestID = RemovePendingRequest( mapping );
+  mapping->loanedOutputSlot->peerID = mapping->peerID;
+  CommitOutputSlot( mapping, mapping->loanedOutputSlot );
+  mapping->loanedOutputSlot = NULL;
+  
+  return true;
+}
+
+const uint8_t* SHM_PeekData( void* ref_mapping, size_t* ref_length )
+{
+  if( ref_mapping == NULL ) return NULL;
+  SHMMapping mapping = (SHMMapping) ref_mapping;
+  
+  // Latest values and broadcast messages may be overwritten while being read
+  if( mapping->queueIn == NULL || mapping->isInputBroadcast ) return NULL;
+  
+  if( mapping->storedRepliesCount > 0 )
+  {
+    *ref_length = mapping->storedRepliesList[ 0 ].length;
+    return mapping->storedRepliesList[ 0 ].data;
+  }
+  
+  // Slot stays reserved for the reader (writers can't reuse it) until released
+  mapping->loanedInputSlot = PeekInputSlot( mapping );
+  if( mapping->loanedInputSlot == NULL ) return NULL;
+  
+  *ref_length = mapping->loanedInputSlot->length;
+  
+  return mapping->loanedInputSlot->data;
+}
+
+void SHM_ReleaseData( void* ref_mapping )
+{
+  if( ref_mapping == NULL ) return;
+  SHMMapping mapping = (SHMMapping) ref_mapping;
+  
+  if( mapping->queueIn == NULL ) return;
+  
+  if( mapping->storedRepliesCount > 0 ) 
+  {
+    Stats_AddRead( &(mapping->stats), mapping->storedRepliesList[ 0 ].length, mapping->storedRepliesList[ 0 ].queueTime );
+    RemoveStoredReply( mapping, 0 );
+  }
+  else if( mapping->loanedInputSlot != NULL )
+  {
+    Stats_AddRead( &(mapping->stats), mapping->loanedInputSlot->length, mapping->loanedInputSlot->queueTime );
+    if( mapping->isReplier ) AddPendingRequest( mapping, mapping->loanedInputSlot->requestID );
+    ReleaseInputSlot( mapping );
+  }
+}
+
+bool SHM_WriteRequest( void* ref_mapping, const uint8_t* data, size_t length, uint32_t* ref_requestID )
+{
+  if( ref_mapping == NULL ) return false;
+  SHMMapping mapping = (SHMMapping) ref_mapping;
+  
+  if( length > SHARED_OBJECT_BUFFER_LENGTH ) return false;
+  if( mapping->queueOut == NULL || mapping->isReplier || mapping->loanedOutputSlot != NULL ) return false;
+  
+  uint32_t requestID = mapping->lastRequestID + 1;
+  if( requestID == 0 ) requestID = 1;   // Skip identifier of plain messages on wrap around
+  
+  if( !WriteQueueMessage( mapping, data, length, requestID, mapping->peerID ) ) return false;
+  
+  mapping->lastRequestID = requestID;
+  *ref_requestID = requestID;
+  
+  return true;
+}
+
+bool SHM_ReadReply( void* ref_mapping, uint32_t requestID, uint8_t* buffer, size_t maxLength, size_t* ref_length )
+{
+  if( ref_mapping == NULL ) return false;
+  SHMMapping mapping = (SHMMapping) ref_mapping;
+  
+  if( mapping->queueIn == NULL ) return false;
+  
+  for( size_t replyIndex = 0; replyIndex < mapping->storedRepliesCount; replyIndex++ )
+  {
+    if( mapping->storedRepliesList[ replyIndex ].requestID != requestID ) continue;
+    TakeStoredReply( mapping, replyIndex, buffer, maxLength, ref_length );
+    return true;
+  }
+  
+  // Replies to other requests are set aside until asked for (or read in order by SHM_ReadData)
+  SHMSlot slot;
+  while( (slot = PeekInputSlot( mapping )) != NULL )
+  {
+    if( slot->requestID == requestID )
+    {
+      *ref_length = ( slot->length < maxLength ) ? slot->length : maxLength;
+      memcpy( buffer, slot->data, *ref_length );
+      Stats_AddRead( &(mapping->stats), slot->length, slot->queueTime );
+      ReleaseInputSlot( mapping );
+      return true;
+    }
+    
+    StoreReply( mapping, slot );
+    ReleaseInputSlot( mapping );
+  }
+  
+  return false;
+}
+
+size_t SHM_GetDataCount( void* ref_mapping )
+{
+  if( ref_mapping == NULL ) return 0;
+  SHMMapping mapping = (SHMMapping) ref_mapping;
+  SHMQueue queue = mapping->queueIn;
+  
+  // A value being written (odd sequence) will be available once the writer finishes
+  if( queue == NULL ) return ( atomic_load_explicit( &(mapping->valueIn->sequence), memory_order_acquire ) != mapping->lastSequence ) ? 1 : 0;
+  
+  mapping->cachedHead = atomic_load_explicit( &(queue->head), memory_order_acquire );
+  
+  // Messages older than a whole queue length are overwritten before being read
+  if( mapping->isInputBroadcast )
+  {
+    SkipOtherPeersMessages( mapping, mapping->cachedHead );
+    size_t unreadCount = mapping->cachedHead - mapping->readPosition;
+    return ( unreadCount < queue->slotsCount ) ? unreadCount : queue->slotsCount;
+  }
+  
+  size_t tail = atomic_load_explicit( &(queue->tail), memory_order_relaxed );
+  
+  // Messages already past the tail stay available to the reader that claimed them
+  size_t claimedCount = ( mapping->claimedInputSlot != NULL ) ? 1 : 0;
+  
+  // Claimed positions only count once the message at the tail is completely written
+  if( mapping->isInputShared )
+  {
+    SHMSharedSlot slot = (SHMSharedSlot) SHM_QUEUE_SLOT( queue, tail );
+    if( atomic_load_explicit( &(slot->sequence), memory_order_acquire ) != tail + 1 ) return mapping->storedRepliesCount + claimedCount;
+  }
+  
+  size_t messagesCount = mapping->storedRepliesCount + claimedCount + mapping->cachedHead - tail;
+  Stats_UpdateMaximum( &(mapping->stats.readQueueHighWater), messagesCount );
+  
+  return messagesCount;
+}
+
+bool SHM_WaitData( void* ref_mapping, unsigned long milliseconds )
+{
+  if( ref_mapping == NULL ) return false;
+  SHMMapping mapping = (SHMMapping) ref_mapping;
+  SHMDoorbell doorbell = mapping->doorbellIn;
+  
+  if( SHM_GetDataCount( mapping ) > 0 ) return true;
+  
+  // Announce the waiter before checking the queue again, so that the writer can't miss it
+  atomic_fetch_add( &(doorbell->waitersCount), 1 );
+  atomic_thread_fence( memory_order_seq_cst );
+  unsigned int doorbellValue = atomic_load( &(doorbell->value) );
+  if( SHM_GetDataCount( mapping ) == 0 ) WaitDoorbell( doorbell, doorbellValue, milliseconds );
+  atomic_fetch_sub( &(doorbell->waitersCount), 1 );
+  
+  return ( SHM_GetDataCount( mapping ) > 0 );
+}
+
+bool SHM_GetStats( void* ref_mapping, IPCStats* ref_stats )
+{
+  if( ref_mapping == NULL ) return false;
+  SHMMapping mapping = (SHMMapping) ref_mapping;
+  
+  Stats_Load( &(mapping->stats), ref_stats );
   
   return true;
 }
@@ -275,8 +1211,18 @@ void SHM_CloseMapping( void* ref_mapping )
   if( ref_mapping == NULL ) return;
   SHMMapping mapping = (SHMMapping) ref_mapping;
   
-  if( mapping->dataIn != NULL ) shmdt( mapping->dataIn );
-  if( mapping->dataOut != NULL ) shmdt( mapping->dataOut );
+  // Claimed slot would block writers when they get back to its position
+  if( mapping->claimedInputSlot != NULL ) ReleaseInputSlot( mapping );
+  
+  void* segmentIn = ( mapping->queueIn != NULL ) ? (void*) mapping->queueIn : (void*) mapping->valueIn;
+  void* segmentOut = ( mapping->queueOut != NULL ) ? (void*) mapping->queueOut : (void*) mapping->valueOut;
+  CloseSegment( segmentIn, mapping->segmentInSize, mapping->segmentInFD, mapping->segmentInName );
+  CloseSegment( segmentOut, mapping->segmentOutSize, mapping->segmentOutFD, mapping->segmentOutName );
+  
+  for( size_t replyIndex = 0; replyIndex < mapping->storedRepliesCount; replyIndex++ )
+    free( mapping->storedRepliesList[ replyIndex ].data );
+  free( mapping->storedRepliesList );
+  free( mapping->pendingRequestIDsList );
   
   free( mapping );
 }
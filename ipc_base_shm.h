@@ -26,15 +26,50 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
+#include "ipc_stats.h"
 
-void* SHM_OpenMapping( const char* dirPath, const char* baseName, const char* inSuffix, const char* outSuffix );
+#define SHM_HUGE_PAGES 0x01                   // Back segments with huge pages (fewer TLB misses)
+#define SHM_PREFAULT 0x02                     // Populate page tables when mapping (no page faults on first access)
+#define SHM_LOCK_MEMORY 0x04                  // Keep segments resident in RAM
+#define SHM_LATEST_VALUE 0x08                 // Keep only the newest message, readable by any number of processes
+#define SHM_SHARED_INPUT 0x10                 // Input queue is written or read by multiple processes
+#define SHM_SHARED_OUTPUT 0x20                // Output queue is written or read by multiple processes
+#define SHM_REPLIER 0x40                      // Written messages answer read ones, in the same order
+#define SHM_BROADCAST_INPUT 0x80              // Input queue is written by one process, and every reader gets all messages
+#define SHM_BROADCAST_OUTPUT 0x100            // Output queue is written only by this process, and read by any number of others
+
+
+void* SHM_OpenMapping( const char* dirPath, const char* baseName, const char* inSuffix, const char* outSuffix, size_t segmentSize, uint16_t flags );
 
 void SHM_CloseMapping( void* mapping );
  
-bool SHM_ReadData( void* mapping, uint8_t* message );
+bool SHM_ReadData( void* mapping, uint8_t* buffer, size_t maxLength, size_t* ref_length );
                                                                               
-bool SHM_WriteData( void* mapping, const uint8_t* message );
+bool SHM_WriteData( void* mapping, const uint8_t* data, size_t length );
+
+bool SHM_ReadPeerData( void* mapping, uint8_t* buffer, size_t maxLength, size_t* ref_length, uint64_t* ref_peerID );
+
+bool SHM_WritePeerData( void* mapping, uint64_t peerID, const uint8_t* data, size_t length );
+
+uint8_t* SHM_AcquireWriteBuffer( void* mapping, size_t* ref_capacity );
+
+bool SHM_CommitWrite( void* mapping, size_t length );
+
+const uint8_t* SHM_PeekData( void* mapping, size_t* ref_length );
+
+void SHM_ReleaseData( void* mapping );
+
+bool SHM_WriteRequest( void* mapping, const uint8_t* data, size_t length, uint32_t* ref_requestID );
+
+bool SHM_ReadReply( void* mapping, uint32_t requestID, uint8_t* buffer, size_t maxLength, size_t* ref_length );
+
+size_t SHM_GetDataCount( void* mapping );
+
+bool SHM_WaitData( void* mapping, unsigned long milliseconds );
+
+bool SHM_GetStats( void* mapping, IPCStats* ref_stats );
 
 
 #endif // IPC_BASE_SHM_H
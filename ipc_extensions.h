@@ -0,0 +1,228 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//                                                                                  //
+//  Copyright (c) 2016-2025 Leonardo Consoni <leonardojc@protonmail.com>            //
+//                                                                                  //
+//  This file is part of Simple Async IPC.                                          //
+//                                                                                  //
+//  Simple Async IPC is free software: you can redistribute it and/or modify        //
+//  it under the terms of the GNU Lesser General Public License as published        //
+//  by the Free Software Foundation, either version 3 of the License, or            //
+//  (at your option) any later version.                                             //
+//                                                                                  //
+//  Simple Async IPC is distributed in the hope that it will be useful,             //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of                  //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                    //
+//  GNU Lesser General Public License for more details.                             //
+//                                                                                  //
+//  You should have received a copy of the GNU Lesser General Public License        //
+//  along with Simple Async IPC. If not, see <http://www.gnu.org/licenses/>.        //
+//                                                                                  //
+//////////////////////////////////////////////////////////////////////////////////////
+                         
+                         
+
+/// @file ipc_extensions.h
+/// @brief Simple Async IPC specific extensions to the IPC Interface
+///
+/// Functions declared here are additions to the ones defined by @ref interface/ipc.h, available 
+/// for all connection modes and transports implemented by this library
+
+#ifndef IPC_EXTENSIONS_H
+#define IPC_EXTENSIONS_H
+
+#include "interface/ipc.h"
+#include "ipc_stats.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef MAX_MESSAGE_LENGTH
+  #define MAX_MESSAGE_LENGTH 65507            ///< Largest length (in bytes) of a variable length message
+#endif
+
+
+/// Handling of messages that don't fit on a full network connection queue
+enum IPCQueuePolicy
+{
+  IPC_QUEUE_DEFAULT,                          ///< Sockets are not read while the read queue is full, writes to full queues fail
+  IPC_QUEUE_BLOCK,                            ///< Sockets are not read while the read queue is full, writes wait for room (failing after about a second)
+  IPC_QUEUE_DROP_NEWEST,                      ///< Discard the message that doesn't fit (counted as dropped, and failing writes)
+  IPC_QUEUE_DROP_OLDEST,                      ///< Discard the oldest queued message to make room (counted as dropped)
+  IPC_QUEUE_ERROR                             ///< Writes fail immediately. Received messages are dropped, as there's no caller to report to
+};
+
+/// Optional connection settings for IPC_OpenConnectionWithOptions() (zero filled fields keep default behaviour)
+typedef struct _IPCOptions
+{
+  size_t sharedMemorySize;                    ///< Size (in bytes) of each shared memory segment (0 for SHM_QUEUE_LENGTH message slots, segments in use keep their size)
+  bool useHugePages;                          ///< Back shared memory with huge pages (falls back to transparent huge pages)
+  bool prefaultMemory;                        ///< Populate shared memory page tables when mapping, avoiding page faults later
+  bool lockMemory;                            ///< Prevent shared memory from being swapped out
+  bool keepLatestOnly;                        ///< PUB/SUB over shared memory: subscribers only read the newest message (state-like data)
+  size_t queueLength;                         ///< Network connections: capacity (in messages) of read and write queues (0 for IP_DEFAULT_QUEUE_LENGTH, 10 by default)
+  enum IPCQueuePolicy queuePolicy;            ///< Network connections: handling of full read and write queues
+  size_t outputBufferSize;                    ///< TCP servers: bytes waiting to be sent to each client before disconnecting it as too slow (0 for default)
+}
+IPCOptions;
+
+/// @brief Create IPC connection like IPC_OpenConnection(), with non default settings
+/// @param[in] mode desired IPC mode (see @ref IPCMode)
+/// @param[in] host IP address, local socket directory (path prefixed by "unix:", e.g. "unix:/tmp") or shared memory directory name (as in IPC_OpenConnection())
+/// @param[in] channel port number, local socket file name or shared memory channel name
+/// @param[in] options connection settings (NULL for defaults). Settings not applicable to the chosen transport are ignored
+/// @return connection handle, or IPC_INVALID_CONNECTION on errors
+IPCConnection IPC_OpenConnectionWithOptions( enum IPCMode mode, const char* host, const char* channel, const IPCOptions* options );
+
+/// @brief Read oldest available message of arbitrary length from given connection
+/// @param[in] connection connection handle returned by IPC_OpenConnection()
+/// @param[out] message buffer where message data will be copied to
+/// @param[in] maxLength capacity of message buffer (longer messages are truncated)
+/// @param[out] ref_length number of bytes copied to message buffer
+/// @return true if a message was available, false otherwise
+bool IPC_ReadSizedMessage( IPCConnection connection, Byte* message, size_t maxLength, size_t* ref_length );
+
+/// @brief Write message of arbitrary length (up to MAX_MESSAGE_LENGTH) to given connection
+/// @param[in] connection connection handle returned by IPC_OpenConnection()
+/// @param[in] message buffer with message data to be sent
+/// @param[in] length number of bytes from message buffer to be sent
+/// @return true if message could be written, false otherwise
+bool IPC_WriteSizedMessage( IPCConnection connection, const Byte* message, size_t length );
+
+/// Identifier of the remote that sent a message to a network server (REP/SERVER/PUB) or shared memory SERVER/PUB connection, used to reply only to it
+typedef uint64_t IPCPeer;
+
+#define IPC_ALL_PEERS 0                       ///< Peer of messages not tied to a single remote (writing to it reaches all of them)
+
+/// @brief Read oldest available message like IPC_ReadSizedMessage(), also identifying the remote that sent it
+/// @param[in] connection connection handle returned by IPC_OpenConnection()
+/// @param[out] message buffer where message data will be copied to
+/// @param[in] maxLength capacity of message buffer (longer messages are truncated)
+/// @param[out] ref_length number of bytes copied to message buffer
+/// @param[out] ref_peer sender of the message on network and shared memory server connections, IPC_ALL_PEERS otherwise
+/// @return true if a message was available, false otherwise
+bool IPC_ReadPeerMessage( IPCConnection connection, Byte* message, size_t maxLength, size_t* ref_length, IPCPeer* ref_peer );
+
+/// @brief Write message like IPC_WriteSizedMessage(), sending it only to the given remote instead of all of them
+/// @note Network messages to remotes that disconnected (or expired) meanwhile are discarded, and counted as write errors
+/// @note UDP servers only write to remotes heard from in the last UDP_PEER_IDLE_TIME_MS (30 seconds by default). Client
+/// connections that write nothing for a third of that time send empty keepalive datagrams, which servers don't deliver
+/// @param[in] connection connection handle returned by IPC_OpenConnection()
+/// @param[in] peer remote returned by IPC_ReadPeerMessage() for the same connection, or IPC_ALL_PEERS
+/// @param[in] message buffer with message data to be sent
+/// @param[in] length number of bytes from message buffer to be sent
+/// @return true if message could be written, false otherwise (including single peers on connections without them)
+bool IPC_WritePeerMessage( IPCConnection connection, IPCPeer peer, const Byte* message, size_t length );
+
+
+/// Counters of messages delivered by the receive system calls of a network connection
+typedef struct _IPCReceiveCounters
+{
+  uint64_t callsCount;                        ///< Number of receive system calls that returned data
+  uint64_t messagesCount;                     ///< Number of messages delivered by those calls
+  uint64_t largestBatch;                      ///< Most messages delivered by a single call
+}
+IPCReceiveCounters;
+
+/// @brief Get how many messages each receive system call of given connection delivered so far
+/// @param[in] connection connection handle returned by IPC_OpenConnection()
+/// @param[out] ref_counters structure to be filled with current counter values
+/// @return true if counters are available (IP connections only), false otherwise
+bool IPC_GetReceiveCounters( IPCConnection connection, IPCReceiveCounters* ref_counters );
+
+/// Counters of messages discarded by the full queue policy of a network connection
+typedef struct _IPCQueueCounters
+{
+  uint64_t readDropsCount;                    ///< Received messages discarded because the read queue was full
+  uint64_t writeDropsCount;                   ///< Written messages discarded because the write queue was full
+}
+IPCQueueCounters;
+
+/// @brief Get how many messages were dropped by given connection queues so far
+/// @param[in] connection connection handle returned by IPC_OpenConnection()
+/// @param[out] ref_counters structure to be filled with current counter values
+/// @return true if counters are available (IP connections only), false otherwise
+bool IPC_GetQueueCounters( IPCConnection connection, IPCQueueCounters* ref_counters );
+
+/// @brief Get traffic, queue and latency statistics of given connection, accumulated since it was opened
+/// @note Shared memory latencies include the time messages wait in the segment, as measured by the writer clock
+/// @param[in] connection connection handle returned by IPC_OpenConnection()
+/// @param[out] ref_stats structure to be filled with current statistics
+/// @return true on success, false otherwise
+bool IPC_GetStats( IPCConnection connection, IPCStats* ref_stats );
+
+
+/// @brief Get buffer inside shared memory where the next message can be written in place (no copies)
+/// @param[in] connection connection handle returned by IPC_OpenConnection() (shared memory queues only)
+/// @param[out] ref_capacity maximum number of bytes that can be written to the buffer
+/// @return pointer to message buffer, or NULL if the output queue is full or the connection does not support loans
+Byte* IPC_AcquireWriteBuffer( IPCConnection connection, size_t* ref_capacity );
+
+/// @brief Send message written to the buffer returned by IPC_AcquireWriteBuffer() (buffer can't be used afterwards)
+/// @note On REP connections, release the request with IPC_ReleaseMessage() before committing its reply
+/// @param[in] connection connection handle used to acquire the buffer
+/// @param[in] length number of bytes written to the buffer
+/// @return true if message was sent, false if no buffer was acquired or length exceeds its capacity
+bool IPC_CommitWrite( IPCConnection connection, size_t length );
+
+/// @brief Get pointer to the oldest available message, left in shared memory until released (no copies)
+/// @param[in] connection connection handle returned by IPC_OpenConnection() (shared memory queues only, except for subscribers)
+/// @param[out] ref_length length (in bytes) of the message
+/// @return pointer to message data, or NULL if no message is available or the connection does not support loans
+const Byte* IPC_PeekMessage( IPCConnection connection, size_t* ref_length );
+
+/// @brief Discard message returned by IPC_PeekMessage(), freeing its space for the writer (pointer can't be used afterwards)
+/// @param[in] connection connection handle used to peek the message
+void IPC_ReleaseMessage( IPCConnection connection );
+
+/// Identifier of a pipelined request, used to read its reply
+typedef uint32_t IPCRequestToken;
+
+#define IPC_INVALID_TOKEN 0                   ///< Token returned when a request could not be sent
+
+/// @brief Send request without waiting for replies to previous ones (REQ connections over shared memory)
+/// @param[in] connection REQ connection handle returned by IPC_OpenConnection()
+/// @param[in] message buffer with request data to be sent
+/// @param[in] length number of bytes from message buffer to be sent
+/// @return token for reading the corresponding reply, or IPC_INVALID_TOKEN on errors (including unsupported transports)
+IPCRequestToken IPC_Request( IPCConnection connection, const Byte* message, size_t length );
+
+/// @brief Read reply to given request, if already received (replies to other requests are kept for later)
+/// @param[in] connection REQ connection handle used for the request
+/// @param[in] token request token returned by IPC_Request()
+/// @param[out] message buffer where reply data will be copied to
+/// @param[in] maxLength capacity of message buffer (longer replies are truncated)
+/// @param[out] ref_length number of bytes copied to message buffer
+/// @return true if the reply was available, false otherwise
+bool IPC_ReadReply( IPCConnection connection, IPCRequestToken token, Byte* message, size_t maxLength, size_t* ref_length );
+
+
+/// Connection entry for IPC_Poll(), flagged when messages are available to be read
+typedef struct _IPCPollItem
+{
+  IPCConnection connection;                   ///< Connection handle to be checked (IPC_INVALID_CONNECTION entries are ignored)
+  bool isReadable;                            ///< Set if a message can be read from the connection without waiting
+}
+IPCPollItem;
+
+/// @brief Wait until at least one of given connections has messages to be read
+/// @param[in,out] itemsList list of connections to be checked, with readiness flags updated on return
+/// @param[in] itemsCount number of entries in connections list
+/// @param[in] timeoutMs maximum time to wait (in milliseconds): 0 returns immediately, negative waits indefinitely
+/// @return number of connections with available messages (0 on timeout)
+size_t IPC_Poll( IPCPollItem* itemsList, size_t itemsCount, long timeoutMs );
+
+/// @brief Wait until any of given connections has messages to be read
+/// @param[in] connectionsList list of connection handles to be checked
+/// @param[in] connectionsCount number of connection handles in list
+/// @param[in] timeoutMs maximum time to wait (in milliseconds): 0 returns immediately, negative waits indefinitely
+/// @return index of the first connection with available messages, or -1 on timeout or failure
+int IPC_WaitAny( IPCConnection* connectionsList, size_t connectionsCount, long timeoutMs );
+
+
+/// @brief Set number of threads servicing network (IP) connections. Each connection is handled by a single thread
+/// @param[in] threadsCount number of network threads (default defined by IP_REACTORS_COUNT build setting)
+/// @return true if the setting was applied, false if it's 0 or any network connection is currently open
+bool IPC_SetNetworkThreadsCount( size_t threadsCount );
+
+
+#endif // IPC_EXTENSIONS_H
@@ -0,0 +1,54 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//                                                                                  //
+//  Copyright (c) 2016-2025 Leonardo Consoni <leonardojc@protonmail.com>            //
+//                                                                                  //
+//  This file is part of Simple Async IPC.                                          //
+//                                                                                  //
+//  Simple Async IPC is free software: you can redistribute it and/or modify        //
+//  it under the terms of the GNU Lesser General Public License as published        //
+//  by the Free Software Foundation, either version 3 of the License, or            //
+//  (at your option) any later version.                                             //
+//                                                                                  //
+//  Simple Async IPC is distributed in the hope that it will be useful,             //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of                  //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                    //
+//  GNU Lesser General Public License for more details.                             //
+//                                                                                  //
+//  You should have received a copy of the GNU Lesser General Public License        //
+//  along with Simple Async IPC. If not, see <http://www.gnu.org/licenses/>.        //
+//                                                                                  //
+//////////////////////////////////////////////////////////////////////////////////////
+                        
+
+/// @file ipc_stats.h
+/// @brief Connection statistics shared by all transports
+///
+/// Counters are updated with relaxed atomic operations on the data path, and copied to an 
+/// IPCStats structure on request, so that monitoring never blocks communication.
+/// This header only holds the plain snapshot type, so that it can be included from C++
+
+#ifndef IPC_STATS_H
+#define IPC_STATS_H
+
+#include <stdint.h>
+
+#define IPC_LATENCY_BUCKETS_COUNT 32          ///< Bucket i counts latencies from 2^i to 2^(i+1) nanoseconds (the last one also counts longer ones)
+
+
+/// Snapshot of connection statistics, as returned by IPC_GetStats()
+typedef struct _IPCStats
+{
+  uint64_t messagesReadCount;                 ///< Messages delivered to the application
+  uint64_t bytesReadCount;
+  uint64_t messagesWrittenCount;              ///< Messages accepted from the application
+  uint64_t bytesWrittenCount;
+  uint64_t readQueueHighWater;                ///< Most messages seen waiting to be read
+  uint64_t writeQueueHighWater;               ///< Most messages seen waiting to be sent
+  uint64_t droppedMessagesCount;              ///< Messages discarded before being read (full queues or overwritten values)
+  uint64_t writeErrorsCount;                  ///< Writes refused on full queues and failed send calls
+  uint64_t readLatencyHistogram[ IPC_LATENCY_BUCKETS_COUNT ];   ///< Time between messages being queued and read by the application
+  uint64_t writeLatencyHistogram[ IPC_LATENCY_BUCKETS_COUNT ];  ///< Time between messages being written and sent (network connections only)
+}
+IPCStats;
+
+#endif // IPC_STATS_H
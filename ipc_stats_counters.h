@@ -0,0 +1,121 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//                                                                                  //
+//  Copyright (c) 2016-2025 Leonardo Consoni <leonardojc@protonmail.com>            //
+//                                                                                  //
+//  This file is part of Simple Async IPC.                                          //
+//                                                                                  //
+//  Simple Async IPC is free software: you can redistribute it and/or modify        //
+//  it under the terms of the GNU Lesser General Public License as published        //
+//  by the Free Software Foundation, either version 3 of the License, or            //
+//  (at your option) any later version.                                             //
+//                                                                                  //
+//  Simple Async IPC is distributed in the hope that it will be useful,             //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of                  //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                    //
+//  GNU Lesser General Public License for more details.                             //
+//                                                                                  //
+//  You should have received a copy of the GNU Lesser General Public License        //
+//  along with Simple Async IPC. If not, see <http://www.gnu.org/licenses/>.        //
+//                                                                                  //
+//////////////////////////////////////////////////////////////////////////////////////
+                        
+
+// Live statistics counters, private to transport implementations (see ipc_stats.h)
+
+#ifndef IPC_STATS_COUNTERS_H
+#define IPC_STATS_COUNTERS_H
+
+#include "ipc_stats.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <time.h>
+
+
+// Live counterpart of IPCStats, updated by transport implementations
+typedef struct _StatsCountersData
+{
+  atomic_uint_fast64_t messagesReadCount;
+  atomic_uint_fast64_t bytesReadCount;
+  atomic_uint_fast64_t messagesWrittenCount;
+  atomic_uint_fast64_t bytesWrittenCount;
+  atomic_uint_fast64_t readQueueHighWater;
+  atomic_uint_fast64_t writeQueueHighWater;
+  atomic_uint_fast64_t droppedMessagesCount;
+  atomic_uint_fast64_t writeErrorsCount;
+  atomic_uint_fast64_t readLatencyHistogram[ IPC_LATENCY_BUCKETS_COUNT ];
+  atomic_uint_fast64_t writeLatencyHistogram[ IPC_LATENCY_BUCKETS_COUNT ];
+}
+StatsCountersData;
+
+typedef StatsCountersData* StatsCounters;
+
+// Monotonic clock, comparable between processes of the same host
+static inline uint64_t Stats_GetTimeNS( void )
+{
+  struct timespec currentTime;
+  clock_gettime( CLOCK_MONOTONIC, &currentTime );
+  return (uint64_t) currentTime.tv_sec * 1000000000 + (uint64_t) currentTime.tv_nsec;
+}
+
+static inline void Stats_AddCount( atomic_uint_fast64_t* counter, uint64_t value )
+{
+  atomic_fetch_add_explicit( counter, value, memory_order_relaxed );
+}
+
+// Only written when the new value is larger, so that the common case is a single load
+static inline void Stats_UpdateMaximum( atomic_uint_fast64_t* counter, uint64_t value )
+{
+  uint64_t currentValue = atomic_load_explicit( counter, memory_order_relaxed );
+  while( value > currentValue )
+  {
+    if( atomic_compare_exchange_weak_explicit( counter, &currentValue, value, memory_order_relaxed, memory_order_relaxed ) ) break;
+  }
+}
+
+// Account time elapsed since given instant on the (base 2 logarithmic) histogram
+static inline void Stats_AddLatency( atomic_uint_fast64_t* histogram, uint64_t startTimeNS, uint64_t endTimeNS )
+{
+  uint64_t latency = ( endTimeNS > startTimeNS ) ? endTimeNS - startTimeNS : 0;
+  size_t bucketIndex = 0;
+  #if defined( __GNUC__ )
+  if( latency > 0 ) bucketIndex = 63 - __builtin_clzll( latency );
+  #else
+  while( ( latency >>= 1 ) > 0 ) bucketIndex++;
+  #endif
+  if( bucketIndex >= IPC_LATENCY_BUCKETS_COUNT ) bucketIndex = IPC_LATENCY_BUCKETS_COUNT - 1;
+  atomic_fetch_add_explicit( &(histogram[ bucketIndex ]), 1, memory_order_relaxed );
+}
+
+static inline void Stats_AddRead( StatsCounters counters, size_t length, uint64_t queueTimeNS )
+{
+  Stats_AddCount( &(counters->messagesReadCount), 1 );
+  Stats_AddCount( &(counters->bytesReadCount), length );
+  Stats_AddLatency( counters->readLatencyHistogram, queueTimeNS, Stats_GetTimeNS() );
+}
+
+static inline void Stats_AddWrite( StatsCounters counters, size_t length )
+{
+  Stats_AddCount( &(counters->messagesWrittenCount), 1 );
+  Stats_AddCount( &(counters->bytesWrittenCount), length );
+}
+
+static inline void Stats_Load( StatsCounters counters, IPCStats* ref_stats )
+{
+  ref_stats->messagesReadCount = atomic_load_explicit( &(counters->messagesReadCount), memory_order_relaxed );
+  ref_stats->bytesReadCount = atomic_load_explicit( &(counters->bytesReadCount), memory_order_relaxed );
+  ref_stats->messagesWrittenCount = atomic_load_explicit( &(counters->messagesWrittenCount), memory_order_relaxed );
+  ref_stats->bytesWrittenCount = atomic_load_explicit( &(counters->bytesWrittenCount), memory_order_relaxed );
+  ref_stats->readQueueHighWater = atomic_load_explicit( &(counters->readQueueHighWater), memory_order_relaxed );
+  ref_stats->writeQueueHighWater = atomic_load_explicit( &(counters->writeQueueHighWater), memory_order_relaxed );
+  ref_stats->droppedMessagesCount = atomic_load_explicit( &(counters->droppedMessagesCount), memory_order_relaxed );
+  ref_stats->writeErrorsCount = atomic_load_explicit( &(counters->writeErrorsCount), memory_order_relaxed );
+  for( size_t bucketIndex = 0; bucketIndex < IPC_LATENCY_BUCKETS_COUNT; bucketIndex++ )
+  {
+    ref_stats->readLatencyHistogram[ bucketIndex ] = atomic_load_explicit( &(counters->readLatencyHistogram[ bucketIndex ]), memory_order_relaxed );
+    ref_stats->writeLatencyHistogram[ bucketIndex ] = atomic_load_explicit( &(counters->writeLatencyHistogram[ bucketIndex ]), memory_order_relaxed );
+  }
+}
+
+#endif // IPC_STATS_COUNTERS_H
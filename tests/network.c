@@ -0,0 +1,451 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//                                                                                  //
+//  Copyright (c) 2016-2025 Leonardo Consoni <leonardojc@protonmail.com>            //
+//                                                                                  //
+//  This file is part of Simple Async IPC.                                          //
+//                                                                                  //
+//  Simple Async IPC is free software: you can redistribute it and/or modify        //
+//  it under the terms of the GNU Lesser General Public License as published        //
+//  by the Free Software Foundation, either version 3 of the License, or            //
+//  (at your option) any later version.                                             //
+//                                                                                  //
+//  Simple Async IPC is distributed in the hope that it will be useful,             //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of                  //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                    //
+//  GNU Lesser General Public License for more details.                             //
+//                                                                                  //
+//  You should have received a copy of the GNU Lesser General Public License        //
+//  along with Simple Async IPC. If not, see <http://www.gnu.org/licenses/>.        //
+//                                                                                  //
+//////////////////////////////////////////////////////////////////////////////////////
+
+
+/////////////////////////////////////////////////////////////////////////////////////
+///// Network transports: TCP framing, queue policies, peer routing and         /////
+///// connections written by several threads at once                            /////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include "test.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+
+#define TEST_IP_HOST "127.0.0.1"
+#define TEST_BASE_PORT 50200
+#define TEST_PORTS_PER_RUN 32                                   // Each process takes its own block of ports, so that test runs can overlap
+#define TEST_PORT_BLOCKS 300
+#define TEST_QUEUE_LENGTH 4
+#define TEST_MESSAGES_COUNT 20
+#define WRITER_THREADS_COUNT 4
+#define WRITER_MESSAGES_COUNT 5000
+
+static Byte buffer[ MAX_MESSAGE_LENGTH ];
+
+// Each connection pair gets a new port, so that sockets of previous tests don't interfere
+static void GetPortChannel( char* channel, size_t channelLength )
+{
+  static unsigned int portsCount = 0;
+  unsigned int basePort = TEST_BASE_PORT + ( (unsigned int) getpid() % TEST_PORT_BLOCKS ) * TEST_PORTS_PER_RUN;
+  snprintf( channel, channelLength, "%u", basePort + portsCount++ );
+}
+
+// Plain TCP socket connected to a library server, for sending streams split at chosen points
+static int ConnectTCPSocket( const char* channel )
+{
+  struct sockaddr_in address = { .sin_family = AF_INET, .sin_port = htons( (uint16_t) atoi( channel ) ) };
+  inet_pton( AF_INET, TEST_IP_HOST, &(address.sin_addr) );
+  
+  int socketFD = socket( AF_INET, SOCK_STREAM, 0 );
+  int isEnabled = 1;
+  setsockopt( socketFD, IPPROTO_TCP, TCP_NODELAY, &isEnabled, sizeof(isEnabled) ); // Each send goes out on its own
+  if( connect( socketFD, (struct sockaddr*) &address, sizeof(address) ) == -1 )
+  {
+    close( socketFD );
+    return -1;
+  }
+  
+  return socketFD;
+}
+
+// Receive exactly the given number of bytes, or less if the stream is closed or nothing arrives for a while
+static size_t ReceiveBytes( int socketFD, uint8_t* data, size_t length )
+{
+  size_t receivedLength = 0;
+  struct pollfd socketPoller = { .fd = socketFD, .events = POLLIN };
+  while( receivedLength < length && poll( &socketPoller, 1, TEST_TIMEOUT_MS ) > 0 )
+  {
+    ssize_t chunkLength = recv( socketFD, data + receivedLength, length - receivedLength, 0 );
+    if( chunkLength <= 0 ) break;
+    receivedLength += (size_t) chunkLength;
+  }
+  
+  return receivedLength;
+}
+
+static void FillMessage( Byte* message, size_t length, size_t seed )
+{
+  for( size_t byteIndex = 0; byteIndex < length; byteIndex++ )
+    message[ byteIndex ] = (Byte) ( seed + byteIndex * 7 );
+}
+
+static bool IsMessageFilled( const Byte* message, size_t length, size_t seed )
+{
+  for( size_t byteIndex = 0; byteIndex < length; byteIndex++ )
+  {
+    if( message[ byteIndex ] != (Byte) ( seed + byteIndex * 7 ) ) return false;
+  }
+  return true;
+}
+
+// Length prefixed frames are delivered whole, whether their headers and data arrive in pieces or together with other frames
+static void TestTCPFramesSplitAcrossReads( void )
+{
+  const size_t FRAME_LENGTHS_LIST[] = { 3, 1000, 20000, 1, MAX_MESSAGE_LENGTH };
+  const size_t FRAMES_COUNT = sizeof(FRAME_LENGTHS_LIST) / sizeof(size_t);
+  
+  char channel[ 16 ];
+  GetPortChannel( channel, sizeof(channel) );
+  IPCConnection replier = IPC_OpenConnection( IPC_REP, NULL, channel );
+  int socketFD = ConnectTCPSocket( channel );
+  if( !TEST_CHECK( replier != IPC_INVALID_CONNECTION && socketFD != -1 ) ) return;
+  
+  size_t streamLength = 0;
+  for( size_t frameIndex = 0; frameIndex < FRAMES_COUNT; frameIndex++ )
+    streamLength += sizeof(uint32_t) + FRAME_LENGTHS_LIST[ frameIndex ];
+  uint8_t* stream = (uint8_t*) malloc( streamLength );
+  uint8_t* frame = stream;
+  for( size_t frameIndex = 0; frameIndex < FRAMES_COUNT; frameIndex++ )
+  {
+    uint32_t frameHeader = htonl( (uint32_t) FRAME_LENGTHS_LIST[ frameIndex ] );
+    memcpy( frame, &frameHeader, sizeof(uint32_t) );
+    FillMessage( frame + sizeof(uint32_t), FRAME_LENGTHS_LIST[ frameIndex ], frameIndex );
+    frame += sizeof(uint32_t) + FRAME_LENGTHS_LIST[ frameIndex ];
+  }
+  
+  // Half a header, the rest of it with part of the data, up to the middle of the third frame, and then everything else
+  const size_t SPLIT_OFFSETS_LIST[] = { 2, 5, 4 + 3 + 4 + 1000 + 4 + 10000, streamLength };
+  size_t sentLength = 0;
+  for( size_t splitIndex = 0; splitIndex < sizeof(SPLIT_OFFSETS_LIST) / sizeof(size_t); splitIndex++ )
+  {
+    while( sentLength < SPLIT_OFFSETS_LIST[ splitIndex ] )
+    {
+      ssize_t chunkLength = send( socketFD, stream + sentLength, SPLIT_OFFSETS_LIST[ splitIndex ] - sentLength, 0 );
+      if( !TEST_CHECK( chunkLength > 0 ) ) break;
+      sentLength += (size_t) chunkLength;
+    }
+    Thread_Sleep( 20 );
+  }
+  free( stream );
+  
+  size_t length;
+  for( size_t frameIndex = 0; frameIndex < FRAMES_COUNT; frameIndex++ )
+  {
+    if( !TEST_CHECK( Test_Read( replier, buffer, sizeof(buffer), &length, TEST_TIMEOUT_MS ) ) ) break;
+    TEST_CHECK( length == FRAME_LENGTHS_LIST[ frameIndex ] && IsMessageFilled( buffer, length, frameIndex ) );
+  }
+  TEST_CHECK( !Test_Read( replier, buffer, sizeof(buffer), &length, 10 ) );
+  
+  // Replies get their own length prefix
+  TEST_CHECK( IPC_WriteSizedMessage( replier, (Byte*) "reply", 5 ) );
+  uint8_t replyFrame[ sizeof(uint32_t) + 5 ];
+  uint32_t replyHeader;
+  TEST_CHECK( ReceiveBytes( socketFD, replyFrame, sizeof(replyFrame) ) == sizeof(replyFrame) );
+  memcpy( &replyHeader, replyFrame, sizeof(uint32_t) );
+  TEST_CHECK( ntohl( replyHeader ) == 5 && memcmp( replyFrame + sizeof(uint32_t), "reply", 5 ) == 0 );
+  
+  close( socketFD );
+  IPC_CloseConnection( replier );
+}
+
+// Frames longer than the maximum message length invalidate their stream, and only their client is disconnected
+static void TestTCPInvalidFrameDisconnects( void )
+{
+  char channel[ 16 ];
+  GetPortChannel( channel, sizeof(channel) );
+  IPCConnection replier = IPC_OpenConnection( IPC_REP, NULL, channel );
+  int invalidSocketFD = ConnectTCPSocket( channel );
+  IPCConnection requester = IPC_OpenConnection( IPC_REQ, TEST_IP_HOST, channel );
+  if( !TEST_CHECK( replier != IPC_INVALID_CONNECTION && invalidSocketFD != -1 && requester != IPC_INVALID_CONNECTION ) ) return;
+  
+  uint32_t frameHeader = htonl( MAX_MESSAGE_LENGTH + 1 );
+  TEST_CHECK( send( invalidSocketFD, &frameHeader, sizeof(frameHeader), 0 ) == sizeof(frameHeader) );
+  uint8_t data;
+  TEST_CHECK( ReceiveBytes( invalidSocketFD, &data, 1 ) == 0 );
+  
+  size_t length;
+  TEST_CHECK( IPC_WriteSizedMessage( requester, (Byte*) "request", 7 ) );
+  TEST_CHECK( Test_Read( replier, buffer, sizeof(buffer), &length, TEST_TIMEOUT_MS ) && length == 7 );
+  
+  close( invalidSocketFD );
+  IPC_CloseConnection( requester );
+  IPC_CloseConnection( replier );
+}
+
+// Messages of any length make it through the library on both ends
+static void TestTCPMessageLengths( void )
+{
+  const size_t MESSAGE_LENGTHS_LIST[] = { 1, 1000, 40000, MAX_MESSAGE_LENGTH };
+  
+  char channel[ 16 ];
+  GetPortChannel( channel, sizeof(channel) );
+  IPCConnection replier = IPC_OpenConnection( IPC_REP, NULL, channel );
+  IPCConnection requester = IPC_OpenConnection( IPC_REQ, TEST_IP_HOST, channel );
+  if( !TEST_CHECK( replier != IPC_INVALID_CONNECTION && requester != IPC_INVALID_CONNECTION ) ) return;
+  
+  static Byte message[ MAX_MESSAGE_LENGTH ];
+  for( size_t messageIndex = 0; messageIndex < sizeof(MESSAGE_LENGTHS_LIST) / sizeof(size_t); messageIndex++ )
+  {
+    size_t messageLength = MESSAGE_LENGTHS_LIST[ messageIndex ], length;
+    FillMessage( message, messageLength, messageIndex );
+    TEST_CHECK( IPC_WriteSizedMessage( requester, message, messageLength ) );
+    if( !TEST_CHECK( Test_Read( replier, buffer, sizeof(buffer), &length, TEST_TIMEOUT_MS ) ) ) continue;
+    TEST_CHECK( length == messageLength && IsMessageFilled( buffer, length, messageIndex ) );
+    TEST_CHECK( IPC_WriteSizedMessage( replier, buffer, length ) );
+    TEST_CHECK( Test_Read( requester, buffer, sizeof(buffer), &length, TEST_TIMEOUT_MS ) );
+    TEST_CHECK( length == messageLength && IsMessageFilled( buffer, length, messageIndex ) );
+  }
+  
+  IPC_CloseConnection( requester );
+  IPC_CloseConnection( replier );
+}
+
+// Send numbered messages to a server with a short read queue, handled by the given policy, and read them only afterwards
+static void ReadFullQueue( enum IPCQueuePolicy queuePolicy, uint32_t* sequencesList, size_t* ref_readsCount, uint64_t* ref_dropsCount )
+{
+  char channel[ 16 ];
+  GetPortChannel( channel, sizeof(channel) );
+  IPCOptions options = { .queueLength = TEST_QUEUE_LENGTH, .queuePolicy = queuePolicy };
+  IPCConnection server = IPC_OpenConnectionWithOptions( IPC_SERVER, NULL, channel, &options );
+  IPCConnection client = IPC_OpenConnection( IPC_CLIENT, TEST_IP_HOST, channel );
+  
+  for( uint32_t sequence = 0; sequence < TEST_MESSAGES_COUNT; sequence++ )
+  {
+    TEST_CHECK( IPC_WriteSizedMessage( client, (Byte*) &sequence, sizeof(sequence) ) );
+    Thread_Sleep( 1 );
+  }
+  Thread_Sleep( 100 );
+  
+  size_t length;
+  *ref_readsCount = 0;
+  while( *ref_readsCount < TEST_MESSAGES_COUNT && Test_Read( server, (Byte*) &(sequencesList[ *ref_readsCount ]), sizeof(uint32_t), &length, 100 ) )
+    (*ref_readsCount)++;
+  
+  IPCQueueCounters counters;
+  TEST_CHECK( IPC_GetQueueCounters( server, &counters ) );
+  *ref_dropsCount = counters.readDropsCount;
+  
+  IPC_CloseConnection( client );
+  IPC_CloseConnection( server );
+}
+
+// Full read queues either hold the socket (and nothing is lost) or drop the newest or oldest messages
+static void TestReadQueuePolicies( void )
+{
+  const enum IPCQueuePolicy POLICIES_LIST[] = { IPC_QUEUE_DEFAULT, IPC_QUEUE_BLOCK, IPC_QUEUE_DROP_NEWEST, IPC_QUEUE_DROP_OLDEST, IPC_QUEUE_ERROR };
+  
+  for( size_t policyIndex = 0; policyIndex < sizeof(POLICIES_LIST) / sizeof(enum IPCQueuePolicy); policyIndex++ )
+  {
+    enum IPCQueuePolicy queuePolicy = POLICIES_LIST[ policyIndex ];
+    uint32_t sequencesList[ TEST_MESSAGES_COUNT ];
+    size_t readsCount;
+    uint64_t dropsCount;
+    ReadFullQueue( queuePolicy, sequencesList, &readsCount, &dropsCount );
+    
+    bool isHolding = ( queuePolicy == IPC_QUEUE_DEFAULT || queuePolicy == IPC_QUEUE_BLOCK );
+    size_t expectedCount = isHolding ? TEST_MESSAGES_COUNT : TEST_QUEUE_LENGTH;
+    uint32_t firstSequence = ( queuePolicy == IPC_QUEUE_DROP_OLDEST ) ? TEST_MESSAGES_COUNT - TEST_QUEUE_LENGTH : 0;
+    if( !TEST_CHECK( readsCount == expectedCount && dropsCount == TEST_MESSAGES_COUNT - expectedCount ) )
+      fprintf( stderr, "policy %d: %zu messages read, %lu dropped\n", (int) queuePolicy, readsCount, (unsigned long) dropsCount );
+    for( size_t readIndex = 0; readIndex < readsCount; readIndex++ )
+      TEST_CHECK( sequencesList[ readIndex ] == firstSequence + readIndex );
+  }
+}
+
+// Writes to full queues block, fail or drop messages, and each message is counted either as written or as not
+static void TestWriteQueuePolicies( void )
+{
+  const enum IPCQueuePolicy POLICIES_LIST[] = { IPC_QUEUE_DEFAULT, IPC_QUEUE_BLOCK, IPC_QUEUE_DROP_NEWEST, IPC_QUEUE_DROP_OLDEST, IPC_QUEUE_ERROR };
+  const size_t WRITES_COUNT = 2000;
+  
+  char channel[ 16 ];
+  GetPortChannel( channel, sizeof(channel) );
+  IPCConnection server = IPC_OpenConnection( IPC_SERVER, NULL, channel );
+  
+  for( size_t policyIndex = 0; policyIndex < sizeof(POLICIES_LIST) / sizeof(enum IPCQueuePolicy); policyIndex++ )
+  {
+    enum IPCQueuePolicy queuePolicy = POLICIES_LIST[ policyIndex ];
+    IPCOptions options = { .queueLength = 2, .queuePolicy = queuePolicy };
+    IPCConnection client = IPC_OpenConnectionWithOptions( IPC_CLIENT, TEST_IP_HOST, channel, &options );
+    
+    size_t writesCount = 0;
+    for( uint32_t sequence = 0; sequence < WRITES_COUNT; sequence++ )
+    {
+      if( IPC_WriteSizedMessage( client, (Byte*) &sequence, sizeof(sequence) ) ) writesCount++;
+    }
+    
+    IPCStats stats;
+    IPCQueueCounters counters;
+    TEST_CHECK( IPC_GetStats( client, &stats ) && IPC_GetQueueCounters( client, &counters ) );
+    TEST_CHECK( stats.messagesWrittenCount == writesCount );
+    if( queuePolicy == IPC_QUEUE_BLOCK || queuePolicy == IPC_QUEUE_DROP_OLDEST ) TEST_CHECK( writesCount == WRITES_COUNT );
+    if( queuePolicy == IPC_QUEUE_DROP_NEWEST ) TEST_CHECK( writesCount + counters.writeDropsCount == WRITES_COUNT );
+    else if( queuePolicy != IPC_QUEUE_DROP_OLDEST ) TEST_CHECK( counters.writeDropsCount == 0 && writesCount + stats.writeErrorsCount == WRITES_COUNT );
+    
+    IPC_CloseConnection( client );
+  }
+  
+  IPC_CloseConnection( server );
+}
+
+// Replies to a single peer only reach the client that sent the message read with it
+static void CheckPeerRouting( enum IPCMode serverMode, enum IPCMode clientMode )
+{
+  char channel[ 16 ];
+  GetPortChannel( channel, sizeof(channel) );
+  IPCConnection server = IPC_OpenConnection( serverMode, NULL, channel );
+  IPCConnection clientsList[ 2 ] = { IPC_OpenConnection( clientMode, TEST_IP_HOST, channel ), IPC_OpenConnection( clientMode, TEST_IP_HOST, channel ) };
+  if( !TEST_CHECK( server != IPC_INVALID_CONNECTION && clientsList[ 0 ] != IPC_INVALID_CONNECTION && clientsList[ 1 ] != IPC_INVALID_CONNECTION ) ) return;
+  
+  for( uint32_t clientIndex = 0; clientIndex < 2; clientIndex++ )
+    TEST_CHECK( IPC_WriteSizedMessage( clientsList[ clientIndex ], (Byte*) &clientIndex, sizeof(clientIndex) ) );
+  
+  for( size_t readIndex = 0; readIndex < 2; readIndex++ )
+  {
+    uint32_t clientIndex = UINT32_MAX;
+    size_t length;
+    IPCPeer peer = IPC_ALL_PEERS;
+    uint64_t deadline = Test_GetTimeNS() + (uint64_t) TEST_TIMEOUT_MS * 1000000;
+    while( !IPC_ReadPeerMessage( server, (Byte*) &clientIndex, sizeof(clientIndex), &length, &peer ) && Test_GetTimeNS() < deadline )
+      IPC_WaitAny( &server, 1, 10 );
+    TEST_CHECK( clientIndex < 2 && peer != IPC_ALL_PEERS );
+    TEST_CHECK( IPC_WritePeerMessage( server, peer, (Byte*) &clientIndex, sizeof(clientIndex) ) );
+  }
+  
+  for( uint32_t clientIndex = 0; clientIndex < 2; clientIndex++ )
+  {
+    uint32_t replyIndex = UINT32_MAX;
+    size_t length;
+    TEST_CHECK( Test_Read( clientsList[ clientIndex ], (Byte*) &replyIndex, sizeof(replyIndex), &length, TEST_TIMEOUT_MS ) );
+    TEST_CHECK( replyIndex == clientIndex );
+    TEST_CHECK( !Test_Read( clientsList[ clientIndex ], (Byte*) &replyIndex, sizeof(replyIndex), &length, 50 ) );
+  }
+  
+  IPC_CloseConnection( clientsList[ 0 ] );
+  IPC_CloseConnection( clientsList[ 1 ] );
+  IPC_CloseConnection( server );
+}
+
+static void TestPeerRouting( void )
+{
+  CheckPeerRouting( IPC_SERVER, IPC_CLIENT );
+  CheckPeerRouting( IPC_REP, IPC_REQ );
+}
+
+typedef struct _WriterMessageData
+{
+  uint32_t writerIndex;
+  uint32_t sequence;
+}
+WriterMessageData;
+
+typedef struct _WriterData
+{
+  IPCConnection connection;
+  uint32_t writerIndex;
+}
+WriterData;
+
+static void* AsyncWriteMessages( void* ref_writer )
+{
+  WriterData* writer = (WriterData*) ref_writer;
+  
+  WriterMessageData message = { .writerIndex = writer->writerIndex };
+  for( message.sequence = 0; message.sequence < WRITER_MESSAGES_COUNT; message.sequence++ )
+  {
+    while( !IPC_WriteSizedMessage( writer->connection, (Byte*) &message, sizeof(message) ) ) continue;
+  }
+  
+  return NULL;
+}
+
+// Threads writing to the same connection don't lose or reorder each other's messages on its lock-free write queue
+static void TestConcurrentWriters( void )
+{
+  char channel[ 16 ];
+  GetPortChannel( channel, sizeof(channel) );
+  IPCOptions options = { .queueLength = 16, .queuePolicy = IPC_QUEUE_BLOCK };
+  IPCConnection replier = IPC_OpenConnection( IPC_REP, NULL, channel );
+  IPCConnection requester = IPC_OpenConnectionWithOptions( IPC_REQ, TEST_IP_HOST, channel, &options );
+  if( !TEST_CHECK( replier != IPC_INVALID_CONNECTION && requester != IPC_INVALID_CONNECTION ) ) return;
+  
+  WriterData writersList[ WRITER_THREADS_COUNT ];
+  Thread writeThreadsList[ WRITER_THREADS_COUNT ];
+  for( uint32_t writerIndex = 0; writerIndex < WRITER_THREADS_COUNT; writerIndex++ )
+  {
+    writersList[ writerIndex ] = (WriterData) { .connection = requester, .writerIndex = writerIndex };
+    writeThreadsList[ writerIndex ] = Thread_Start( AsyncWriteMessages, (void*) &(writersList[ writerIndex ]), THREAD_JOINABLE );
+  }
+  
+  uint32_t nextSequencesList[ WRITER_THREADS_COUNT ] = { 0 };
+  WriterMessageData message;
+  size_t length, readsCount = 0;
+  bool isConsistent = true;
+  while( readsCount < WRITER_THREADS_COUNT * WRITER_MESSAGES_COUNT && Test_Read( replier, (Byte*) &message, sizeof(message), &length, TEST_TIMEOUT_MS ) )
+  {
+    if( message.writerIndex >= WRITER_THREADS_COUNT || message.sequence != nextSequencesList[ message.writerIndex ]++ ) isConsistent = false;
+    readsCount++;
+  }
+  TEST_CHECK( isConsistent );
+  TEST_CHECK( readsCount == WRITER_THREADS_COUNT * WRITER_MESSAGES_COUNT );
+  
+  for( uint32_t writerIndex = 0; writerIndex < WRITER_THREADS_COUNT; writerIndex++ )
+    Thread_WaitExit( writeThreadsList[ writerIndex ], TEST_TIMEOUT_MS );
+  
+  IPC_CloseConnection( requester );
+  IPC_CloseConnection( replier );
+}
+
+#ifdef UDP_PEER_IDLE_TIME_MS
+// Subscribers that never write keep getting publications after the UDP server idle time, thanks to their keepalives
+static void TestIdleSubscribersStay( void )
+{
+  char channel[ 16 ];
+  GetPortChannel( channel, sizeof(channel) );
+  IPCConnection publisher = IPC_OpenConnection( IPC_PUB, NULL, channel );
+  IPCConnection subscriber = IPC_OpenConnection( IPC_SUB, TEST_IP_HOST, channel );
+  
+  Thread_Sleep( UDP_PEER_IDLE_TIME_MS / 2 );
+  for( uint32_t sequence = 0; sequence < 3; sequence++ )
+  {
+    uint32_t readSequence = UINT32_MAX;
+    size_t length;
+    TEST_CHECK( IPC_WriteSizedMessage( publisher, (Byte*) &sequence, sizeof(sequence) ) );
+    TEST_CHECK( Test_Read( subscriber, (Byte*) &readSequence, sizeof(readSequence), &length, TEST_TIMEOUT_MS ) && readSequence == sequence );
+    // Keepalives are not delivered as messages
+    TEST_CHECK( !IPC_ReadSizedMessage( publisher, buffer, sizeof(buffer), &length ) );
+    Thread_Sleep( 3 * UDP_PEER_IDLE_TIME_MS / 2 );
+  }
+  
+  IPC_CloseConnection( subscriber );
+  IPC_CloseConnection( publisher );
+}
+#endif
+
+int main( int argc, char* argv[] )
+{
+  TEST_RUN( TestTCPFramesSplitAcrossReads );
+  TEST_RUN( TestTCPInvalidFrameDisconnects );
+  TEST_RUN( TestTCPMessageLengths );
+  TEST_RUN( TestReadQueuePolicies );
+  TEST_RUN( TestWriteQueuePolicies );
+  TEST_RUN( TestPeerRouting );
+  TEST_RUN( TestConcurrentWriters );
+#ifdef UDP_PEER_IDLE_TIME_MS
+  TEST_RUN( TestIdleSubscribersStay );
+#endif
+  
+  return Test_GetResult();
+}
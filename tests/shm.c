@@ -0,0 +1,408 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//                                                                                  //
+//  Copyright (c) 2016-2025 Leonardo Consoni <leonardojc@protonmail.com>            //
+//                                                                                  //
+//  This file is part of Simple Async IPC.                                          //
+//                                                                                  //
+//  Simple Async IPC is free software: you can redistribute it and/or modify        //
+//  it under the terms of the GNU Lesser General Public License as published        //
+//  by the Free Software Foundation, either version 3 of the License, or            //
+//  (at your option) any later version.                                             //
+//                                                                                  //
+//  Simple Async IPC is distributed in the hope that it will be useful,             //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of                  //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                    //
+//  GNU Lesser General Public License for more details.                             //
+//                                                                                  //
+//  You should have received a copy of the GNU Lesser General Public License        //
+//  along with Simple Async IPC. If not, see <http://www.gnu.org/licenses/>.        //
+//                                                                                  //
+//////////////////////////////////////////////////////////////////////////////////////
+
+
+/////////////////////////////////////////////////////////////////////////////////////
+///// Shared memory layouts with multiple readers and writers on the same       /////
+///// segments: every subscriber gets all publications, and so on               /////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include "test.h"
+
+#include <stdatomic.h>
+
+#define SUBSCRIBERS_COUNT 2
+#define CLIENTS_COUNT 4
+#define CLIENT_MESSAGES_COUNT 10000
+#define OVERRUN_MESSAGES_COUNT 4096                             // Well above the number of slots of any segment
+#define VALUE_LENGTH 1024
+#define REQUESTS_COUNT 3
+
+// Each subscriber reads every message, once and in order, no matter how many others read them
+static void TestSubscribersReadAllMessages( void )
+{
+  char channel[ 64 ];
+  Test_GetChannel( channel, sizeof(channel), "pubsub" );
+  
+  IPCConnection publisher = IPC_OpenConnection( IPC_PUB, TEST_SHM_HOST, channel );
+  IPCConnection subscribersList[ SUBSCRIBERS_COUNT ];
+  for( size_t subscriberIndex = 0; subscriberIndex < SUBSCRIBERS_COUNT; subscriberIndex++ )
+    subscribersList[ subscriberIndex ] = IPC_OpenConnection( IPC_SUB, TEST_SHM_HOST, channel );
+  
+  for( uint32_t sequence = 0; sequence < 4; sequence++ )
+    TEST_CHECK( IPC_WriteSizedMessage( publisher, (Byte*) &sequence, sizeof(sequence) ) );
+  
+  for( size_t subscriberIndex = 0; subscriberIndex < SUBSCRIBERS_COUNT; subscriberIndex++ )
+  {
+    uint32_t sequence;
+    size_t length;
+    for( uint32_t expectedSequence = 0; expectedSequence < 4; expectedSequence++ )
+    {
+      TEST_CHECK( Test_Read( subscribersList[ subscriberIndex ], (Byte*) &sequence, sizeof(sequence), &length, TEST_TIMEOUT_MS ) );
+      TEST_CHECK( length == sizeof(sequence) && sequence == expectedSequence );
+    }
+    TEST_CHECK( !IPC_ReadSizedMessage( subscribersList[ subscriberIndex ], (Byte*) &sequence, sizeof(sequence), &length ) );
+  }
+  
+  for( size_t subscriberIndex = 0; subscriberIndex < SUBSCRIBERS_COUNT; subscriberIndex++ )
+    IPC_CloseConnection( subscribersList[ subscriberIndex ] );
+  IPC_CloseConnection( publisher );
+}
+
+// Publisher never waits for subscribers: the ones left behind skip overwritten messages, counted as dropped
+static void TestSlowSubscriberSkipsMessages( void )
+{
+  char channel[ 64 ];
+  Test_GetChannel( channel, sizeof(channel), "overrun" );
+  
+  IPCConnection publisher = IPC_OpenConnection( IPC_PUB, TEST_SHM_HOST, channel );
+  IPCConnection subscriber = IPC_OpenConnection( IPC_SUB, TEST_SHM_HOST, channel );
+  
+  for( uint32_t sequence = 0; sequence < OVERRUN_MESSAGES_COUNT; sequence++ )
+    TEST_CHECK( IPC_WriteSizedMessage( publisher, (Byte*) &sequence, sizeof(sequence) ) );
+  
+  uint32_t sequence, lastSequence = 0;
+  size_t length, readsCount = 0;
+  bool isOrdered = true;
+  while( IPC_ReadSizedMessage( subscriber, (Byte*) &sequence, sizeof(sequence), &length ) )
+  {
+    if( readsCount > 0 && sequence <= lastSequence ) isOrdered = false;
+    lastSequence = sequence;
+    readsCount++;
+  }
+  TEST_CHECK( isOrdered );
+  TEST_CHECK( readsCount > 0 && readsCount < OVERRUN_MESSAGES_COUNT );
+  TEST_CHECK( lastSequence == OVERRUN_MESSAGES_COUNT - 1 );
+  
+  IPCStats stats;
+  TEST_CHECK( IPC_GetStats( subscriber, &stats ) );
+  TEST_CHECK( stats.messagesReadCount == readsCount && stats.droppedMessagesCount == OVERRUN_MESSAGES_COUNT - readsCount );
+  
+  IPC_CloseConnection( subscriber );
+  IPC_CloseConnection( publisher );
+}
+
+// Messages from all subscribers reach the publisher
+static void TestSubscribersWriteToPublisher( void )
+{
+  char channel[ 64 ];
+  Test_GetChannel( channel, sizeof(channel), "subpub" );
+  
+  IPCConnection publisher = IPC_OpenConnection( IPC_PUB, TEST_SHM_HOST, channel );
+  IPCConnection subscribersList[ SUBSCRIBERS_COUNT ];
+  for( uint32_t subscriberIndex = 0; subscriberIndex < SUBSCRIBERS_COUNT; subscriberIndex++ )
+  {
+    subscribersList[ subscriberIndex ] = IPC_OpenConnection( IPC_SUB, TEST_SHM_HOST, channel );
+    TEST_CHECK( IPC_WriteSizedMessage( subscribersList[ subscriberIndex ], (Byte*) &subscriberIndex, sizeof(subscriberIndex) ) );
+  }
+  
+  bool isReceivedList[ SUBSCRIBERS_COUNT ] = { false };
+  uint32_t subscriberIndex;
+  size_t length;
+  while( Test_Read( publisher, (Byte*) &subscriberIndex, sizeof(subscriberIndex), &length, 100 ) )
+  {
+    if( TEST_CHECK( subscriberIndex < SUBSCRIBERS_COUNT && !isReceivedList[ subscriberIndex ] ) ) isReceivedList[ subscriberIndex ] = true;
+  }
+  for( subscriberIndex = 0; subscriberIndex < SUBSCRIBERS_COUNT; subscriberIndex++ )
+    TEST_CHECK( isReceivedList[ subscriberIndex ] );
+  
+  for( subscriberIndex = 0; subscriberIndex < SUBSCRIBERS_COUNT; subscriberIndex++ )
+    IPC_CloseConnection( subscribersList[ subscriberIndex ] );
+  IPC_CloseConnection( publisher );
+}
+
+// Replies addressed to the client that sent a request are not read by the other ones
+static void TestServerRepliesToSender( void )
+{
+  char channel[ 64 ];
+  Test_GetChannel( channel, sizeof(channel), "reply" );
+  
+  IPCConnection server = IPC_OpenConnection( IPC_SERVER, TEST_SHM_HOST, channel );
+  IPCConnection clientsList[ 2 ] = { IPC_OpenConnection( IPC_CLIENT, TEST_SHM_HOST, channel ), IPC_OpenConnection( IPC_CLIENT, TEST_SHM_HOST, channel ) };
+  
+  for( uint32_t senderIndex = 2; senderIndex-- > 0; )
+  {
+    TEST_CHECK( IPC_WriteSizedMessage( clientsList[ senderIndex ], (Byte*) &senderIndex, sizeof(senderIndex) ) );
+    
+    uint32_t message = UINT32_MAX;
+    size_t length;
+    IPCPeer peer = IPC_ALL_PEERS;
+    uint64_t deadline = Test_GetTimeNS() + (uint64_t) TEST_TIMEOUT_MS * 1000000;
+    while( !IPC_ReadPeerMessage( server, (Byte*) &message, sizeof(message), &length, &peer ) && Test_GetTimeNS() < deadline )
+      IPC_WaitAny( &server, 1, 10 );
+    TEST_CHECK( message == senderIndex && peer != IPC_ALL_PEERS );
+    TEST_CHECK( IPC_WritePeerMessage( server, peer, (Byte*) &message, sizeof(message) ) );
+    
+    TEST_CHECK( Test_Read( clientsList[ senderIndex ], (Byte*) &message, sizeof(message), &length, TEST_TIMEOUT_MS ) );
+    TEST_CHECK( message == senderIndex );
+    TEST_CHECK( !Test_Read( clientsList[ 1 - senderIndex ], (Byte*) &message, sizeof(message), &length, 10 ) );
+  }
+  
+  IPC_CloseConnection( clientsList[ 0 ] );
+  IPC_CloseConnection( clientsList[ 1 ] );
+  IPC_CloseConnection( server );
+}
+
+// Messages not addressed to a single peer reach every client
+static void TestServerWritesToAllClients( void )
+{
+  char channel[ 64 ];
+  Test_GetChannel( channel, sizeof(channel), "all" );
+  
+  IPCConnection server = IPC_OpenConnection( IPC_SERVER, TEST_SHM_HOST, channel );
+  IPCConnection clientsList[ 2 ] = { IPC_OpenConnection( IPC_CLIENT, TEST_SHM_HOST, channel ), IPC_OpenConnection( IPC_CLIENT, TEST_SHM_HOST, channel ) };
+  
+  uint32_t message = 42;
+  TEST_CHECK( IPC_WriteSizedMessage( server, (Byte*) &message, sizeof(message) ) );
+  TEST_CHECK( IPC_WritePeerMessage( server, IPC_ALL_PEERS, (Byte*) &message, sizeof(message) ) );
+  
+  for( size_t clientIndex = 0; clientIndex < 2; clientIndex++ )
+  {
+    size_t length, readsCount = 0;
+    while( Test_Read( clientsList[ clientIndex ], (Byte*) &message, sizeof(message), &length, 10 ) )
+    {
+      TEST_CHECK( message == 42 );
+      readsCount++;
+    }
+    TEST_CHECK( readsCount == 2 );
+  }
+  
+  IPC_CloseConnection( clientsList[ 0 ] );
+  IPC_CloseConnection( clientsList[ 1 ] );
+  IPC_CloseConnection( server );
+}
+
+typedef struct _ClientMessageData
+{
+  uint32_t clientIndex;
+  uint32_t sequence;
+}
+ClientMessageData;
+
+typedef struct _ClientData
+{
+  IPCConnection connection;
+  uint32_t clientIndex;
+}
+ClientData;
+
+// Write numbered messages, retrying while the server queue is full
+static void* AsyncWriteMessages( void* ref_client )
+{
+  ClientData* client = (ClientData*) ref_client;
+  
+  ClientMessageData message = { .clientIndex = client->clientIndex };
+  for( message.sequence = 0; message.sequence < CLIENT_MESSAGES_COUNT; message.sequence++ )
+  {
+    uint64_t deadline = Test_GetTimeNS() + (uint64_t) TEST_TIMEOUT_MS * 1000000;
+    while( !IPC_WriteSizedMessage( client->connection, (Byte*) &message, sizeof(message) ) && Test_GetTimeNS() < deadline ) continue;
+  }
+  
+  return NULL;
+}
+
+// Clients writing at the same time don't overwrite or reorder each other's messages
+static void TestClientsWriteConcurrently( void )
+{
+  char channel[ 64 ];
+  Test_GetChannel( channel, sizeof(channel), "mpsc" );
+  
+  IPCConnection server = IPC_OpenConnection( IPC_SERVER, TEST_SHM_HOST, channel );
+  ClientData clientsList[ CLIENTS_COUNT ];
+  Thread writeThreadsList[ CLIENTS_COUNT ];
+  for( uint32_t clientIndex = 0; clientIndex < CLIENTS_COUNT; clientIndex++ )
+  {
+    clientsList[ clientIndex ].connection = IPC_OpenConnection( IPC_CLIENT, TEST_SHM_HOST, channel );
+    clientsList[ clientIndex ].clientIndex = clientIndex;
+  }
+  for( uint32_t clientIndex = 0; clientIndex < CLIENTS_COUNT; clientIndex++ )
+    writeThreadsList[ clientIndex ] = Thread_Start( AsyncWriteMessages, (void*) &(clientsList[ clientIndex ]), THREAD_JOINABLE );
+  
+  uint32_t nextSequencesList[ CLIENTS_COUNT ] = { 0 };
+  IPCPeer peersList[ CLIENTS_COUNT ] = { IPC_ALL_PEERS };
+  ClientMessageData message;
+  size_t length, readsCount = 0;
+  bool isConsistent = true;
+  while( readsCount < CLIENTS_COUNT * CLIENT_MESSAGES_COUNT && Test_Read( server, (Byte*) &message, sizeof(message), &length, TEST_TIMEOUT_MS ) )
+  {
+    if( message.clientIndex >= CLIENTS_COUNT || message.sequence != nextSequencesList[ message.clientIndex ]++ ) isConsistent = false;
+    readsCount++;
+  }
+  TEST_CHECK( isConsistent );
+  TEST_CHECK( readsCount == CLIENTS_COUNT * CLIENT_MESSAGES_COUNT );
+  
+  for( uint32_t clientIndex = 0; clientIndex < CLIENTS_COUNT; clientIndex++ )
+    Thread_WaitExit( writeThreadsList[ clientIndex ], TEST_TIMEOUT_MS );
+  
+  // Each client is identified by its own peer
+  for( uint32_t clientIndex = 0; clientIndex < CLIENTS_COUNT; clientIndex++ )
+  {
+    message.clientIndex = clientIndex;
+    TEST_CHECK( IPC_WriteSizedMessage( clientsList[ clientIndex ].connection, (Byte*) &message, sizeof(message) ) );
+  }
+  for( uint32_t clientIndex = 0; clientIndex < CLIENTS_COUNT; clientIndex++ )
+  {
+    IPCPeer peer = IPC_ALL_PEERS;
+    if( !TEST_CHECK( IPC_ReadPeerMessage( server, (Byte*) &message, sizeof(message), &length, &peer ) ) ) break;
+    if( !TEST_CHECK( message.clientIndex < CLIENTS_COUNT && peer != IPC_ALL_PEERS ) ) break;
+    peersList[ message.clientIndex ] = peer;
+    for( uint32_t otherClientIndex = 0; otherClientIndex < message.clientIndex; otherClientIndex++ )
+      TEST_CHECK( peersList[ otherClientIndex ] != peer );
+  }
+  
+  for( uint32_t clientIndex = 0; clientIndex < CLIENTS_COUNT; clientIndex++ )
+    IPC_CloseConnection( clientsList[ clientIndex ].connection );
+  IPC_CloseConnection( server );
+}
+
+// Subscribers keeping the latest value only read the newest publication, and only once
+static void TestLatestValueReplaces( void )
+{
+  char channel[ 64 ];
+  Test_GetChannel( channel, sizeof(channel), "latest" );
+  
+  IPCOptions options = { .keepLatestOnly = true };
+  IPCConnection publisher = IPC_OpenConnectionWithOptions( IPC_PUB, TEST_SHM_HOST, channel, &options );
+  IPCConnection subscriber = IPC_OpenConnectionWithOptions( IPC_SUB, TEST_SHM_HOST, channel, &options );
+  
+  for( uint32_t sequence = 0; sequence < 4; sequence++ )
+    TEST_CHECK( IPC_WriteSizedMessage( publisher, (Byte*) &sequence, sizeof(sequence) ) );
+  
+  uint32_t sequence = UINT32_MAX;
+  size_t length;
+  TEST_CHECK( Test_Read( subscriber, (Byte*) &sequence, sizeof(sequence), &length, TEST_TIMEOUT_MS ) && sequence == 3 );
+  TEST_CHECK( !IPC_ReadSizedMessage( subscriber, (Byte*) &sequence, sizeof(sequence), &length ) );
+  
+  IPC_CloseConnection( subscriber );
+  IPC_CloseConnection( publisher );
+}
+
+typedef struct _ValueWriterData
+{
+  IPCConnection connection;
+  atomic_bool isRunning;
+}
+ValueWriterData;
+
+// Keep publishing values with every byte set to the same sequence number
+static void* AsyncWriteValues( void* ref_writer )
+{
+  ValueWriterData* writer = (ValueWriterData*) ref_writer;
+  
+  Byte value[ VALUE_LENGTH ];
+  for( Byte sequence = 0; atomic_load( &(writer->isRunning) ); sequence++ )
+  {
+    memset( value, sequence, VALUE_LENGTH );
+    IPC_WriteSizedMessage( writer->connection, value, VALUE_LENGTH );
+  }
+  
+  return NULL;
+}
+
+// Values read while being overwritten are retried, never returned half old and half new
+static void TestLatestValueNotTorn( void )
+{
+  const uint64_t READ_TIME_NS = 200000000;
+  
+  char channel[ 64 ];
+  Test_GetChannel( channel, sizeof(channel), "torn" );
+  
+  IPCOptions options = { .keepLatestOnly = true };
+  ValueWriterData writer = { .connection = IPC_OpenConnectionWithOptions( IPC_PUB, TEST_SHM_HOST, channel, &options ) };
+  IPCConnection subscriber = IPC_OpenConnectionWithOptions( IPC_SUB, TEST_SHM_HOST, channel, &options );
+  atomic_init( &(writer.isRunning), true );
+  Thread writeThread = Thread_Start( AsyncWriteValues, (void*) &writer, THREAD_JOINABLE );
+  
+  Byte value[ VALUE_LENGTH ];
+  size_t length, readsCount = 0, tornsCount = 0;
+  uint64_t deadline = Test_GetTimeNS() + READ_TIME_NS;
+  while( Test_GetTimeNS() < deadline )
+  {
+    if( !IPC_ReadSizedMessage( subscriber, value, sizeof(value), &length ) ) continue;
+    readsCount++;
+    bool isTorn = ( length != VALUE_LENGTH );
+    for( size_t byteIndex = 1; byteIndex < length && !isTorn; byteIndex++ )
+      isTorn = ( value[ byteIndex ] != value[ 0 ] );
+    if( isTorn ) tornsCount++;
+  }
+  atomic_store( &(writer.isRunning), false );
+  Thread_WaitExit( writeThread, TEST_TIMEOUT_MS );
+  
+  TEST_CHECK( readsCount > 0 );
+  TEST_CHECK( tornsCount == 0 );
+  
+  IPC_CloseConnection( subscriber );
+  IPC_CloseConnection( writer.connection );
+}
+
+// Pipelined requests get their own replies, whatever the order they are read in
+static void TestPipelinedRequests( void )
+{
+  char channel[ 64 ];
+  Test_GetChannel( channel, sizeof(channel), "pipeline" );
+  
+  IPCConnection replier = IPC_OpenConnection( IPC_REP, TEST_SHM_HOST, channel );
+  IPCConnection requester = IPC_OpenConnection( IPC_REQ, TEST_SHM_HOST, channel );
+  
+  IPCRequestToken tokensList[ REQUESTS_COUNT ];
+  for( uint32_t requestIndex = 0; requestIndex < REQUESTS_COUNT; requestIndex++ )
+  {
+    tokensList[ requestIndex ] = IPC_Request( requester, (Byte*) &requestIndex, sizeof(requestIndex) );
+    TEST_CHECK( tokensList[ requestIndex ] != IPC_INVALID_TOKEN );
+  }
+  
+  uint32_t request, reply;
+  size_t length;
+  for( uint32_t requestIndex = 0; requestIndex < REQUESTS_COUNT; requestIndex++ )
+  {
+    if( !TEST_CHECK( Test_Read( replier, (Byte*) &request, sizeof(request), &length, TEST_TIMEOUT_MS ) ) ) break;
+    reply = request * 10;
+    TEST_CHECK( IPC_WriteSizedMessage( replier, (Byte*) &reply, sizeof(reply) ) );
+  }
+  
+  for( uint32_t readIndex = 0; readIndex < REQUESTS_COUNT; readIndex++ )
+  {
+    uint32_t requestIndex = REQUESTS_COUNT - 1 - readIndex;
+    reply = UINT32_MAX;
+    uint64_t deadline = Test_GetTimeNS() + (uint64_t) TEST_TIMEOUT_MS * 1000000;
+    while( !IPC_ReadReply( requester, tokensList[ requestIndex ], (Byte*) &reply, sizeof(reply), &length ) && Test_GetTimeNS() < deadline )
+      continue;
+    TEST_CHECK( reply == requestIndex * 10 );
+  }
+  
+  IPC_CloseConnection( requester );
+  IPC_CloseConnection( replier );
+}
+
+int main( int argc, char* argv[] )
+{
+  TEST_RUN( TestSubscribersReadAllMessages );
+  TEST_RUN( TestSlowSubscriberSkipsMessages );
+  TEST_RUN( TestSubscribersWriteToPublisher );
+  TEST_RUN( TestServerRepliesToSender );
+  TEST_RUN( TestServerWritesToAllClients );
+  TEST_RUN( TestClientsWriteConcurrently );
+  TEST_RUN( TestLatestValueReplaces );
+  TEST_RUN( TestLatestValueNotTorn );
+  TEST_RUN( TestPipelinedRequests );
+  
+  return Test_GetResult();
+}
@@ -0,0 +1,103 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//                                                                                  //
+//  Copyright (c) 2016-2025 Leonardo Consoni <leonardojc@protonmail.com>            //
+//                                                                                  //
+//  This file is part of Simple Async IPC.                                          //
+//                                                                                  //
+//  Simple Async IPC is free software: you can redistribute it and/or modify        //
+//  it under the terms of the GNU Lesser General Public License as published        //
+//  by the Free Software Foundation, either version 3 of the License, or            //
+//  (at your option) any later version.                                             //
+//                                                                                  //
+//  Simple Async IPC is distributed in the hope that it will be useful,             //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of                  //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                    //
+//  GNU Lesser General Public License for more details.                             //
+//                                                                                  //
+//  You should have received a copy of the GNU Lesser General Public License        //
+//  along with Simple Async IPC. If not, see <http://www.gnu.org/licenses/>.        //
+//                                                                                  //
+//////////////////////////////////////////////////////////////////////////////////////
+
+
+/////////////////////////////////////////////////////////////////////////////////////
+///// Checks and connection helpers shared by the behaviour tests              /////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef IPC_TEST_H
+#define IPC_TEST_H
+
+#include "ipc_extensions.h"
+
+#include "threads/threads.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TEST_SHM_HOST "ipc_test"                                // Shared memory directory name
+#define TEST_TIMEOUT_MS 1000                                    // Longest wait for a message expected to arrive
+
+static size_t failuresCount = 0;
+
+// Report failed condition without stopping the test, so that all failures of a run are listed
+#define TEST_CHECK( condition ) Test_Check( (condition), #condition, __func__, __LINE__ )
+
+static inline bool Test_Check( bool condition, const char* conditionString, const char* testName, int line )
+{
+  if( !condition )
+  {
+    fprintf( stderr, "%s (line %d): check failed: %s\n", testName, line, conditionString );
+    failuresCount++;
+  }
+  return condition;
+}
+
+// Monotonic clock, for timeouts
+static inline uint64_t Test_GetTimeNS( void )
+{
+  struct timespec currentTime;
+  clock_gettime( CLOCK_MONOTONIC, &currentTime );
+  return (uint64_t) currentTime.tv_sec * 1000000000 + (uint64_t) currentTime.tv_nsec;
+}
+
+// Channel names include the process identifier, so that concurrent or aborted runs don't share segments and ports
+static inline void Test_GetChannel( char* channel, size_t channelLength, const char* name )
+{
+  snprintf( channel, channelLength, "%s_%lu", name, (unsigned long) getpid() );
+}
+
+// Read next message, waiting for it up to the given time
+static inline bool Test_Read( IPCConnection connection, Byte* buffer, size_t maxLength, size_t* ref_length, unsigned long timeoutMs )
+{
+  uint64_t deadline = Test_GetTimeNS() + (uint64_t) timeoutMs * 1000000;
+  while( !IPC_ReadSizedMessage( connection, buffer, maxLength, ref_length ) )
+  {
+    uint64_t currentTime = Test_GetTimeNS();
+    if( currentTime >= deadline ) return false;
+    IPC_WaitAny( &connection, 1, (long) ( ( deadline - currentTime ) / 1000000 ) + 1 );
+  }
+  return true;
+}
+
+// Run test function, printing its name and result
+#define TEST_RUN( testFunction ) Test_Run( testFunction, #testFunction )
+
+static inline void Test_Run( void (*testFunction)( void ), const char* testName )
+{
+  size_t previousFailuresCount = failuresCount;
+  testFunction();
+  printf( "%s: %s\n", testName, ( failuresCount == previousFailuresCount ) ? "passed" : "FAILED" );
+  fflush( stdout );
+}
+
+// Exit code of test executables
+static inline int Test_GetResult( void )
+{
+  return ( failuresCount == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif // IPC_TEST_H